@@ -71,7 +71,7 @@ namespace robot {
     return impl->getSpeed_async();
   }
 
-  dds::rpc::future<robot::RobotControl_getStatus_Out> 
+  dds::rpc::future<robot::RobotControl_getStatus_AsyncOut> 
     RobotControlSupport::Client::getStatus_async()
   {
     auto impl = static_cast<dds::rpc::details::ClientImpl<robot::RobotControl> *>(impl_.get());
@@ -96,56 +96,136 @@ namespace dds {
         return outid;
       }
 
+      static const char * const robot_control_operation_names[] =
+        { "command", "setSpeed", "getSpeed", "getStatus" };
+
+      // A reply carrying an exception, standard or user-defined, is an
+      // error for the stats, unless the service dropped the call.
+      static OperationStatsRecorder::Outcome
+        outcome_of(const robot::RobotControl_Reply & reply)
+      {
+        switch (reply.header.remoteEx)
+        {
+          case dds::rpc::REMOTE_EX_OK:
+            break;
+          case dds::rpc::REMOTE_EX_DEADLINE_EXCEEDED:
+            return OperationStatsRecorder::OUTCOME_TIMEOUT;
+          case dds::rpc::REMOTE_EX_OUT_OF_RESOURCES:
+            return OperationStatsRecorder::OUTCOME_REJECTED;
+          default:
+            return OperationStatsRecorder::OUTCOME_ERROR;
+        }
+
+        boost::int32_t result;
+        switch (reply.data._d)
+        {
+          case robot::RobotControl_command_Hash:
+            result = reply.data._u.command._d;
+            break;
+          case robot::RobotControl_setSpeed_Hash:
+            result = reply.data._u.setSpeed._d;
+            break;
+          case robot::RobotControl_getSpeed_Hash:
+            result = reply.data._u.getSpeed._d;
+            break;
+          case robot::RobotControl_getStatus_Hash:
+            result = reply.data._u.getStatus._d;
+            break;
+          default:
+            return OperationStatsRecorder::OUTCOME_ERROR;
+        }
+
+        return result == dds::rpc::REMOTE_EX_OK
+          ? OperationStatsRecorder::OUTCOME_OK
+          : OperationStatsRecorder::OUTCOME_ERROR;
+      }
+
+      // The operations that only read the state of the service. None
+      // takes arguments, so any two calls to one are identical.
+      static bool is_read_only(boost::int32_t operation)
+      {
+        return operation == robot::RobotControl_getSpeed_Hash ||
+               operation == robot::RobotControl_getStatus_Hash;
+      }
+
+      // User exceptions are left to each operation.
+      static void check_remote_ex(const robot::RobotControl_Reply & reply)
+      {
+        switch (reply.header.remoteEx)
+        {
+          case dds::rpc::REMOTE_EX_OK:
+            return;
+          case dds::rpc::REMOTE_EX_DEADLINE_EXCEEDED:
+            throw std::runtime_error("The call expired before the service got to it.");
+          case dds::rpc::REMOTE_EX_OUT_OF_RESOURCES:
+            throw std::runtime_error("The service is overloaded and shed the call.");
+          case dds::rpc::REMOTE_EX_UNKNOWN_OPERATION:
+            throw std::runtime_error("The service doesn't know the operation.");
+          case dds::rpc::REMOTE_EX_UNKNOWN_EXCEPTION:
+            throw std::runtime_error("The service failed to carry out the call.");
+          default:
+            throw std::runtime_error("Received remote exception.");
+        }
+      }
+
       rpc::ReplierParams
         to_replier_params(const rpc::ServiceParams & service_params)
       {
         return rpc::ReplierParams()
                  .domain_participant(service_params.domain_participant())
-                 .service_name(service_params.service_name());
+                 .service_name(service_params.service_name())
+                 .reply_batch_size(service_params.reply_batch_size())
+                 .reply_flush_delay(service_params.reply_flush_delay());
+      }
+
+      template <class Cache>
+      static boost::shared_ptr<Cache>
+        make_duplicate_reply_cache(const rpc::ServiceParams & service_params)
+      {
+        if (service_params.duplicate_reply_cache_size() == 0)
+          return boost::shared_ptr<Cache>();
+
+        dds::Duration lifetime = service_params.duplicate_reply_lifetime();
+        return boost::make_shared<Cache>(
+          service_params.duplicate_reply_cache_size(),
+          std::chrono::duration_cast<typename Cache::clock::duration>(
+            std::chrono::seconds(lifetime.sec) +
+            std::chrono::nanoseconds(lifetime.nanosec)));
       }
 
       Dispatcher<robot::RobotControl>::Dispatcher(robot::RobotControl & service_impl)
         : robotimpl_(&service_impl),
-          replier_(to_replier_params(ServiceParams().service_name("RobotControl")))
+          replier_(to_replier_params(ServiceParams().service_name("RobotControl"))),
+          shared_payload_threshold_(0),
+          host_(0),
+          stats_(robot_control_operation_names)
       { }
 
       Dispatcher<robot::RobotControl>::Dispatcher(
             robot::RobotControl & service_impl,
             const ServiceParams & service_params)
         : robotimpl_(&service_impl),
-          replier_(to_replier_params(service_params))
-      { }
-
-      void Dispatcher<robot::RobotControl>::close()
-      {}
-
-      bool is_command(const Sample<robot::RobotControl_Request> & request_sample)
-      {
-        return request_sample.data().data._d == robot::RobotControl_command_Hash;
-      }
-
-      bool is_getSpeed(const Sample<robot::RobotControl_Request> & request_sample)
-      {
-        return request_sample.data().data._d == robot::RobotControl_getSpeed_Hash;
-      }
-
-      bool is_setSpeed(const Sample<robot::RobotControl_Request> & request_sample)
+          replier_(to_replier_params(service_params)),
+          shared_payload_threshold_(service_params.shared_payload_threshold()),
+          host_(shared_payload_threshold_ > 0 ? shared_payload_host() : 0),
+          stats_(robot_control_operation_names),
+          duplicates_(make_duplicate_reply_cache<Duplicates>(service_params))
       {
-        return request_sample.data().data._d == robot::RobotControl_setSpeed_Hash;
+        // Without shared memory there is nobody to share it with.
+        if (host_ == 0)
+          shared_payload_threshold_ = 0;
       }
 
-      bool is_getStatus(const Sample<robot::RobotControl_Request> & request_sample)
-      {
-        return request_sample.data().data._d == robot::RobotControl_getStatus_Hash;
-      }
+      void Dispatcher<robot::RobotControl>::close()
+      {}
 
       helper::unique_data<robot::RobotControl_Reply> do_command(
-        const Sample<robot::RobotControl_Request> & request_sample,
+        const robot::RobotControl_Request & request,
         robot::RobotControl * service_impl)
       {
         helper::unique_data<robot::RobotControl_Reply> reply;
 
-        service_impl->command(request_sample.data().data._u.command.com);
+        service_impl->command(request.data._u.command.com);
 
         reply->data._d = robot::RobotControl_command_Hash;
         reply->data._u.command._d = dds::rpc::REMOTE_EX_OK;
@@ -155,7 +235,7 @@ namespace dds {
       }
 
       helper::unique_data<robot::RobotControl_Reply> do_setSpeed(
-        const Sample<robot::RobotControl_Request> & request_sample,
+        const robot::RobotControl_Request & request,
         robot::RobotControl * service_impl)
       {
         helper::unique_data<robot::RobotControl_Reply> reply;
@@ -163,7 +243,7 @@ namespace dds {
         try
         {
           float speed =
-            service_impl->setSpeed(request_sample.data().data._u.setSpeed.speed);
+            service_impl->setSpeed(request.data._u.setSpeed.speed);
 
           reply->data._d = robot::RobotControl_setSpeed_Hash;
           reply->data._u.setSpeed._d = dds::rpc::REMOTE_EX_OK;
@@ -180,7 +260,7 @@ namespace dds {
       }
 
       helper::unique_data<robot::RobotControl_Reply> do_getSpeed(
-        const Sample<robot::RobotControl_Request> & request_sample,
+        const robot::RobotControl_Request & request,
         robot::RobotControl * service_impl)
       {
         helper::unique_data<robot::RobotControl_Reply> reply;
@@ -195,7 +275,7 @@ namespace dds {
       }
 
       helper::unique_data<robot::RobotControl_Reply> do_getStatus(
-        const Sample<robot::RobotControl_Request> & request_sample,
+        const robot::RobotControl_Request & request,
         robot::RobotControl * service_impl)
       {
         helper::unique_data<robot::RobotControl_Reply> reply;
@@ -207,31 +287,238 @@ namespace dds {
         return reply;
       }
 
+      static_assert(robot::RobotControl_command_Hash == operation_id("command"),
+                    "RobotControl_command_Hash in robot.idl is stale");
+      static_assert(robot::RobotControl_setSpeed_Hash == operation_id("setSpeed"),
+                    "RobotControl_setSpeed_Hash in robot.idl is stale");
+      static_assert(robot::RobotControl_getSpeed_Hash == operation_id("getSpeed"),
+                    "RobotControl_getSpeed_Hash in robot.idl is stale");
+      static_assert(robot::RobotControl_getStatus_Hash == operation_id("getStatus"),
+                    "RobotControl_getStatus_Hash in robot.idl is stale");
+
+      typedef helper::unique_data<robot::RobotControl_Reply>
+        (*RobotControlHandler)(const robot::RobotControl_Request &,
+                               robot::RobotControl *);
+
+      static const OperationTable<RobotControlHandler>::Entry robot_control_entries[] =
+      {
+        { robot::RobotControl_command_Hash,   &do_command },
+        { robot::RobotControl_setSpeed_Hash,  &do_setSpeed },
+        { robot::RobotControl_getSpeed_Hash,  &do_getSpeed },
+        { robot::RobotControl_getStatus_Hash, &do_getStatus }
+      };
+
+      static const OperationTable<RobotControlHandler>
+        robot_control_operations(robot_control_entries);
+
       void Dispatcher<robot::RobotControl>::dispatch(const dds::Duration & timeout)
       {
-        Sample<RequestType> request_sample;
+        // Take everything that is available in one loan and serve the
+        // requests straight out of the DataReader's buffers.
+        Replier::LoanedSamplesType requests =
+          replier_.receive_requests(1, DDS_LENGTH_UNLIMITED, timeout);
+
+        if (requests.length() == 0)
+        {
+          DDS_RPC_TRACE_EVENT(REQUEST, DISPATCH_TIMEOUT);
+          return;
+        }
+
+        for (int i = 0; i < requests.length(); ++i)
+          serve(requests[i]);
+
+        replier_.flush_replies();
+      }
+
+      // When the DataReader received the request, on the admission clock,
+      // given that it was taken at taken, or taken_wall_ns on the wall
+      // clock that reception timestamps use. Without a timestamp, or
+      // with one from the future, the request counts as received when it
+      // was taken.
+      static AdmissionControl::clock::time_point received_at(
+        const dds::SampleInfo & info,
+        const AdmissionControl::clock::time_point & taken,
+        boost::int64_t taken_wall_ns)
+      {
+        const DDS_Time_t & stamp = info.reception_timestamp;
+        if (stamp.sec <= 0)
+          return taken;
+
+        boost::int64_t age = taken_wall_ns -
+          (static_cast<boost::int64_t>(stamp.sec) * 1000000000 + stamp.nanosec);
+        if (age <= 0)
+          return taken;
+
+        return taken - std::chrono::duration_cast<AdmissionControl::clock::duration>(
+                         std::chrono::nanoseconds(age));
+      }
+
+      // Served on the executor. Requests from one client keep their
+      // order; requests from different clients run in parallel, so the
+      // service implementation must be thread-safe.
+      void Dispatcher<robot::RobotControl>::dispatch_available(
+        ThreadPoolExecutor & executor,
+        AdmissionControl & admission,
+        const boost::function<void()> & done)
+      {
+        // The jobs share the loan. The last one to finish returns it and
+        // sends the replies still batched.
+        boost::shared_ptr<Replier::LoanedSamplesType> requests(
+          new Replier::LoanedSamplesType(),
+          ReturnLoanThen([this, done]() {
+            replier_.flush_replies();
+            done();
+          }));
+
+        *requests = replier_.take_requests(DDS_LENGTH_UNLIMITED);
+        AdmissionControl::clock::time_point taken = AdmissionControl::clock::now();
+        boost::int64_t taken_wall_ns =
+          std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+
+        for (int i = 0; i < requests->length(); ++i)
+        {
+          SampleRef<RequestType> request_ref = (*requests)[i];
+          if (!request_ref.info().valid_data)
+            continue;
+
+          if (!admission.enqueue())
+          {
+            shed(request_ref);
+            continue;
+          }
+
+          executor.post(
+            writer_guid_hash(request_ref.data().header.requestId),
+            boost::bind(&Dispatcher::serve_loaned,
+                        this,
+                        requests,
+                        i,
+                        boost::ref(admission),
+                        received_at(request_ref.info(), taken, taken_wall_ns)));
+        }
+      }
+
+      void Dispatcher<robot::RobotControl>::serve_loaned(
+        boost::shared_ptr<Replier::LoanedSamplesType> requests,
+        int index,
+        AdmissionControl & admission,
+        AdmissionControl::clock::time_point received)
+      {
+        if (admission.dequeue(received))
+          serve((*requests)[index]);
+        else
+          shed((*requests)[index]);
+      }
+
+      // Turns the request down without calling the service.
+      void Dispatcher<robot::RobotControl>::shed(SampleRef<RequestType> request_ref)
+      {
+        const RequestType & request = request_ref.data();
         helper::unique_data<ReplyType> reply;
 
-        if (replier_.receive_request(request_sample, timeout))
+        DDS_RPC_TRACE(REQUEST, DISPATCH_SHED, request.header.requestId);
+        OperationStatsRecorder::clock::time_point start =
+          OperationStatsRecorder::clock::now();
+
+        reply->header.remoteEx = dds::rpc::REMOTE_EX_OUT_OF_RESOURCES;
+        reply->data._d = 0; // default
+        reply_to(request_ref, *reply);
+
+        stats_.record(request.data._d, start, OperationStatsRecorder::OUTCOME_REJECTED);
+      }
+
+      // Oneway requests get no reply, whatever became of them.
+      void Dispatcher<robot::RobotControl>::reply_to(
+        SampleRef<RequestType> request_ref,
+        ReplyType & reply)
+      {
+        if (request_ref.data().header.oneway)
+          return;
+
+        replier_.send_reply(
+          reply,
+          to_rpc_sample_identity(sample_identity(request_ref.info())));
+      }
+
+      void Dispatcher<robot::RobotControl>::serve(SampleRef<RequestType> request_ref)
+      {
+        if (!request_ref.info().valid_data)
+          return;
+
+        const RequestType & request = request_ref.data();
+        helper::unique_data<ReplyType> reply;
+
+        DDS_RPC_TRACE(REQUEST, DISPATCH_START, request.header.requestId);
+        OperationStatsRecorder::clock::time_point start =
+          OperationStatsRecorder::clock::now();
+
+        // A retry of a request served already gets the same reply. The
+        // operation doesn't run again. A retry keeps the deadline of the
+        // first try, so this comes before the deadline check: the reply
+        // is ready, whatever became of the deadline.
+        bool retry =
+          duplicates_ && duplicates_->find(request.header.requestId, *reply);
+
+        // The caller has given up. Say so instead of doing the work.
+        if (!retry && deadline_passed(request.header.deadline))
         {
-          if (is_command(request_sample))
-            reply = do_command(request_sample, robotimpl_);
-          else if (is_getSpeed(request_sample))
-            reply = do_getSpeed(request_sample, robotimpl_);
-          else if (is_setSpeed(request_sample))
-            reply = do_setSpeed(request_sample, robotimpl_);
-          else if (is_getStatus(request_sample))
-            reply = do_getStatus(request_sample, robotimpl_);
+          reply->header.remoteEx = dds::rpc::REMOTE_EX_DEADLINE_EXCEEDED;
+          reply->data._d = 0; // default
+          reply_to(request_ref, *reply);
+
+          stats_.record(request.data._d, start, OperationStatsRecorder::OUTCOME_TIMEOUT);
+          DDS_RPC_TRACE(REQUEST, DISPATCH_END, request.header.requestId);
+          return;
+        }
+
+        if (!retry)
+        {
+          if (RobotControlHandler handler = robot_control_operations.find(request.data._d))
+          {
+            try {
+              reply = handler(request, robotimpl_);
+            }
+            catch (...) {
+              // Nothing above a worker thread could catch it. The
+              // caller hears of it instead.
+              DDS_RPC_TRACE_EVENT(ERROR, DISPATCH_ERROR);
+              reply->header.remoteEx = dds::rpc::REMOTE_EX_UNKNOWN_EXCEPTION;
+              reply->data._d = 0; // default
+            }
+          }
           else
           {
             reply->header.remoteEx = dds::rpc::REMOTE_EX_UNKNOWN_OPERATION;
             reply->data._d = 0; // default
           }
 
-          replier_.send_reply(*reply, to_rpc_sample_identity(request_sample.identity()));
+          // Kept before its payload goes to shared memory: a retry maps
+          // a segment of its own.
+          if (duplicates_)
+            duplicates_->store(request.header.requestId, *reply);
         }
-        else
-          printf("timeout or invalid sampleinfo. Ignoring...\n");
+
+        if (shared_payload_threshold_ > 0 &&
+            reply->data._d == robot::RobotControl_getStatus_Hash &&
+            reply->data._u.getStatus._d == dds::rpc::REMOTE_EX_OK &&
+            request.header.payloadHost == host_)
+        {
+          try {
+            share_string(reply->data._u.getStatus._u.result.status.msg,
+                         reply->header.payload,
+                         shared_payload_threshold_);
+          }
+          catch (std::exception &) {
+            // The payload goes in the sample after all.
+            DDS_RPC_TRACE_EVENT(ERROR, SHARE_ERROR);
+          }
+        }
+
+        reply_to(request_ref, *reply);
+
+        stats_.record(request.data._d, start, outcome_of(*reply));
+        DDS_RPC_TRACE(REQUEST, DISPATCH_END, request.header.requestId);
       }
 
       void Dispatcher<robot::RobotControl>::run_impl(const dds::Duration & timeout)
@@ -239,10 +526,41 @@ namespace dds {
         dispatch(timeout);
       }
 
+      DDS::Condition * Dispatcher<robot::RobotControl>::get_request_condition() const
+      {
+        return replier_.get_impl()->request_condition();
+      }
+
+      std::vector<OperationStats> Dispatcher<robot::RobotControl>::stats() const
+      {
+        return stats_.snapshot();
+      }
+
       /***************************************************************************/
       /* ClientImpl */
       /***************************************************************************/
 
+      template <class Cache>
+      static boost::shared_ptr<Cache> make_read_cache(const dds::Duration & max_staleness)
+      {
+        if (max_staleness.sec == 0 && max_staleness.nanosec == 0)
+          return boost::shared_ptr<Cache>();
+
+        return boost::make_shared<Cache>(
+          std::chrono::duration_cast<typename Cache::clock::duration>(
+            std::chrono::seconds(max_staleness.sec) +
+            std::chrono::nanoseconds(max_staleness.nanosec)));
+      }
+
+      // What every request carries besides its data: when the caller
+      // gives up, and which shared payloads it can map.
+      static void stamp_header(dds::rpc::RequestHeader & header,
+                               const dds::Duration & timeout)
+      {
+        header.deadline = deadline_after(timeout);
+        header.payloadHost = shared_payload_host();
+      }
+
       static dds::rpc::RequesterParams 
         to_requester_params(const ClientParams & client_params)
       {        
@@ -251,15 +569,29 @@ namespace dds {
           .service_name(client_params.service_name());
       }
 
+      static Executor & continuation_executor_for(const ClientParams & client_params)
+      {
+        Executor * executor = client_params.continuation_executor();
+        return executor ? *executor : InlineExecutor::instance();
+      }
+
       ClientImpl<robot::RobotControl>::ClientImpl() 
         : params_(dds::rpc::ClientParams().service_name("RobotControl")),
-          requester_(to_requester_params(params_))
+          continuations_(continuation_executor_for(params_)),
+          requester_(to_requester_params(params_)),
+          stats_(boost::make_shared<OperationStatsRecorder>(robot_control_operation_names)),
+          reads_(boost::make_shared<ReadFlights>()),
+          cache_(make_read_cache<ReadCache>(params_.read_cache_staleness()))
       {  }
 
       ClientImpl<robot::RobotControl>::ClientImpl(
         const dds::rpc::ClientParams & client_params)
         : params_(client_params),
-          requester_(to_requester_params(params_))
+          continuations_(continuation_executor_for(params_)),
+          requester_(to_requester_params(params_)),
+          stats_(boost::make_shared<OperationStatsRecorder>(robot_control_operation_names)),
+          reads_(boost::make_shared<ReadFlights>()),
+          cache_(make_read_cache<ReadCache>(params_.read_cache_staleness()))
       { }
 
       void ClientImpl<robot::RobotControl>::bind(const std::string & instance_name)
@@ -363,6 +695,185 @@ namespace dds {
         return params_;
       }
 
+      std::vector<OperationStats> ClientImpl<robot::RobotControl>::stats() const
+      {
+        return stats_->snapshot();
+      }
+
+      // A shared payload can be mapped only once, so a reply handed to
+      // several callers carries its payload inline.
+      static void inline_shared_payload(robot::RobotControl_Reply & reply)
+      {
+        if (reply.header.payload.length() == 0 ||
+            reply.data._d != robot::RobotControl_getStatus_Hash)
+          return;
+
+        unshare_string(reply.data._u.getStatus._u.result.status.msg,
+                       reply.header.payload);
+        reply.header.payload.length(0);
+      }
+
+      // Any operation but a read may have changed the service. Reads
+      // cached or in flight from before it no longer answer the reads
+      // made after it.
+      template <class Flights, class Cache>
+      static void invalidate_reads(Flights & reads, Cache * cache)
+      {
+        reads.invalidate();
+        if (cache)
+          cache->invalidate();
+      }
+
+      // Caches the successful reply to a read sent at generation.
+      template <class Cache>
+      static void update_read_cache(
+        Cache * cache,
+        boost::int32_t operation,
+        Sample<robot::RobotControl_Reply> & reply_sample,
+        boost::uint64_t generation)
+      {
+        if (!cache)
+          return;
+
+        if (outcome_of(reply_sample.data()) == OperationStatsRecorder::OUTCOME_OK)
+        {
+          inline_shared_payload(reply_sample.data());
+          cache->store(operation, reply_sample, generation);
+        }
+      }
+
+      void ClientImpl<robot::RobotControl>::call(
+        RobotControl::RequestType & request,
+        Sample<RobotControl::ReplyType> & reply_sample)
+      {
+        boost::int32_t operation = request.data._d;
+        OperationStatsRecorder::clock::time_point start =
+          OperationStatsRecorder::clock::now();
+
+        if (cache_ && is_read_only(operation) && cache_->find(operation, reply_sample))
+        {
+          stats_->record(operation, start, OperationStatsRecorder::OUTCOME_OK);
+          return;
+        }
+
+        dds::Duration timeout = params_.call_timeout();
+        boost::uint64_t generation = cache_ ? cache_->generation() : 0;
+
+        stamp_header(request.header, timeout);
+        requester_.send_request(request);
+        bool received = requester_.receive_reply(reply_sample,
+                                                 request.header.requestId,
+                                                 timeout);
+
+        if (!received)
+        {
+          // The service may have made the change all the same.
+          if (!is_read_only(operation))
+            invalidate_reads(*reads_, cache_.get());
+
+          stats_->record(operation, start, OperationStatsRecorder::OUTCOME_TIMEOUT);
+          throw std::runtime_error("No reply within the call timeout.");
+        }
+
+        if (is_read_only(operation))
+          update_read_cache(cache_.get(), operation, reply_sample, generation);
+        else
+          invalidate_reads(*reads_, cache_.get());
+        stats_->record(operation, start, outcome_of(reply_sample.data()));
+        check_remote_ex(reply_sample.data());
+      }
+
+      void ClientImpl<robot::RobotControl>::call_oneway(
+        RobotControl::RequestType & request)
+      {
+        OperationStatsRecorder::clock::time_point start =
+          OperationStatsRecorder::clock::now();
+
+        stamp_header(request.header, params_.call_timeout());
+        requester_.send_request_oneway(request);
+
+        // No reply will come to do it.
+        invalidate_reads(*reads_, cache_.get());
+
+        stats_->record(request.data._d, start, OperationStatsRecorder::OUTCOME_OK);
+      }
+
+      dds::rpc::future<Sample<robot::RobotControl_Reply>>
+        ClientImpl<robot::RobotControl>::send_read_async(
+          RobotControl::RequestType & request)
+      {
+        boost::int32_t operation = request.data._d;
+        dds::rpc::future<Sample<RobotControl::ReplyType>> reply;
+        Sample<RobotControl::ReplyType> cached;
+
+        if (cache_ && cache_->find(operation, cached))
+          return details::make_ready_future(cached);
+
+        // Coalesced or cached, the reply goes to more than one caller.
+        boost::shared_ptr<ReadFlights> reads;
+        if (params_.coalesce_reads())
+          reads = reads_;
+
+        if (!reads && !cache_)
+          return requester_.send_request_async(request);
+
+        ReadFlights::Flight flight;
+        if (reads && reads->join(operation, reply, flight))
+          return reply;
+
+        boost::shared_ptr<ReadCache> cache = cache_;
+        boost::uint64_t generation = cache ? cache->generation() : 0;
+        try {
+          reply = requester_.send_request_async(request);
+        }
+        catch (...) {
+          if (reads)
+            reads->abandon(flight, details::current_exception());
+          throw;
+        }
+
+        return
+          dds::rpc::then(std::move(reply), continuations_, [reads, flight, cache, operation, generation](
+                       dds::rpc::future<Sample<robot::RobotControl_Reply>> && reply_fut) {
+            Sample<robot::RobotControl_Reply> reply_sample;
+            try {
+              reply_sample = reply_fut.get();
+              inline_shared_payload(reply_sample.data());
+            }
+            catch (...) {
+              if (reads)
+                reads->abandon(flight, details::current_exception());
+              throw;
+            }
+
+            update_read_cache(cache.get(), operation, reply_sample, generation);
+            if (reads)
+              reads->land(flight, reply_sample);
+            return reply_sample;
+          });
+      }
+
+      // The reply of an async call, recorded in stats.
+      static Sample<robot::RobotControl_Reply> recorded_reply(
+        dds::rpc::future<Sample<robot::RobotControl_Reply>> & reply_fut,
+        OperationStatsRecorder & stats,
+        boost::int32_t operation,
+        OperationStatsRecorder::clock::time_point start)
+      {
+        Sample<robot::RobotControl_Reply> reply_sample;
+        try {
+          reply_sample = reply_fut.get();
+        }
+        catch (...) {
+          stats.record(operation, start, OperationStatsRecorder::OUTCOME_ERROR);
+          throw;
+        }
+
+        stats.record(operation, start, outcome_of(reply_sample.data()));
+        check_remote_ex(reply_sample.data());
+        return reply_sample;
+      }
+
       void ClientImpl<robot::RobotControl>::close() 
       { }
 
@@ -374,12 +885,10 @@ namespace dds {
         request->data._d = robot::RobotControl_command_Hash;
         request->data._u.command.com = command;
 
-        requester_.send_request(*request);
-        requester_.receive_reply(reply_sample, 
-                                 request->header.requestId,
-                                 dds::Duration::from_seconds(20));
-        printf("reply received successfully from command %d\n",
-          reply_sample.data().header.relatedRequestId.sequence_number.low);
+        if (params_.oneway_void_operations())
+          call_oneway(*request);
+        else
+          call(*request, reply_sample);
       }
 
       float ClientImpl<robot::RobotControl>::setSpeed(float speed)
@@ -390,16 +899,10 @@ namespace dds {
         request->data._d = robot::RobotControl_setSpeed_Hash;
         request->data._u.setSpeed.speed = speed;
 
-        requester_.send_request(*request);
-        requester_.receive_reply(reply_sample, 
-                                 request->header.requestId,
-                                 dds::Duration::from_seconds(20));
+        call(*request, reply_sample);
 
         if (reply_sample.data().data._d == robot::RobotControl_setSpeed_Hash)
         {
-          printf("reply received successfully from setSpeed %d\n",
-            reply_sample.data().header.relatedRequestId.sequence_number.low);
-
           switch (reply_sample.data().data._u.setSpeed._d)
           {
           case dds::rpc::REMOTE_EX_OK:
@@ -433,16 +936,10 @@ namespace dds {
         request->data._d = robot::RobotControl_getSpeed_Hash;
         request->data._u.getSpeed.dummy = 0;
 
-        requester_.send_request(*request);
-        requester_.receive_reply(reply_sample, 
-                                 request->header.requestId,
-                                 dds::Duration::from_seconds(20));
+        call(*request, reply_sample);
 
         if (reply_sample.data().data._d == robot::RobotControl_getSpeed_Hash)
         {
-          printf("reply received successfully from getSpeed %d\n",
-            reply_sample.data().header.relatedRequestId.sequence_number.low);
-
           switch (reply_sample.data().data._u.getSpeed._d)
           {
           case dds::rpc::REMOTE_EX_OK:
@@ -471,21 +968,16 @@ namespace dds {
         request->data._d = robot::RobotControl_getStatus_Hash;
         request->data._u.getStatus.dummy = 0;
 
-        requester_.send_request(*request);
-        requester_.receive_reply(reply_sample, 
-                                 request->header.requestId,
-                                 dds::Duration::from_seconds(20));
+        call(*request, reply_sample);
 
         if (reply_sample.data().data._d == robot::RobotControl_getStatus_Hash)
         {
-          printf("reply received successfully from getStatus %d\n",
-            reply_sample.data().header.relatedRequestId.sequence_number.low);
-
           switch (reply_sample.data().data._u.getSpeed._d)
           {
             case dds::rpc::REMOTE_EX_OK:
             {
               robot::Status_copy(&status, &reply_sample.data().data._u.getStatus._u.result.status);
+              unshare_string(status.msg, reply_sample.data().header.payload);
               break;
             }
             default:
@@ -509,13 +1001,31 @@ namespace dds {
         Sample<robot::RobotControl_Reply> reply_sample;
 
         request->data._d = robot::RobotControl_command_Hash;
-        request->data._u.getSpeed.dummy = 0;
+        request->data._u.command.com = command;
+
+        if (params_.oneway_void_operations())
+        {
+          call_oneway(*request);
+
+          dds::rpc::details::promise<void> written;
+          written.set_value();
+          return written.get_future();
+        }
+
+        boost::shared_ptr<OperationStatsRecorder> stats = stats_;
+        boost::shared_ptr<ReadFlights> reads = reads_;
+        boost::shared_ptr<ReadCache> cache = cache_;
+        OperationStatsRecorder::clock::time_point start =
+          OperationStatsRecorder::clock::now();
+        stamp_header(request->header, params_.call_timeout());
 
         return
-          requester_
-            .send_request_async(*request)
-            .then([](dds::rpc::future <Sample<robot::RobotControl_Reply>> && reply) {
-              reply.get();
+          dds::rpc::then(
+            requester_.send_request_async(*request),
+            continuations_,
+            [stats, reads, cache, start](dds::rpc::future <Sample<robot::RobotControl_Reply>> && reply) {
+              invalidate_reads(*reads, cache.get());
+              recorded_reply(reply, *stats, robot::RobotControl_command_Hash, start);
             });
       }
 
@@ -528,11 +1038,21 @@ namespace dds {
         request->data._d = robot::RobotControl_setSpeed_Hash;
         request->data._u.setSpeed.speed = speed;
 
+        boost::shared_ptr<OperationStatsRecorder> stats = stats_;
+        boost::shared_ptr<ReadFlights> reads = reads_;
+        boost::shared_ptr<ReadCache> cache = cache_;
+        OperationStatsRecorder::clock::time_point start =
+          OperationStatsRecorder::clock::now();
+        stamp_header(request->header, params_.call_timeout());
+
         return
-          requester_
-            .send_request_async(*request)
-            .then([](dds::rpc::future <Sample<robot::RobotControl_Reply>> && reply_fut) {
-                    Sample<robot::RobotControl_Reply> reply_sample = reply_fut.get();
+          dds::rpc::then(
+            requester_.send_request_async(*request),
+            continuations_,
+            [stats, reads, cache, start](dds::rpc::future <Sample<robot::RobotControl_Reply>> && reply_fut) {
+                    invalidate_reads(*reads, cache.get());
+                    Sample<robot::RobotControl_Reply> reply_sample =
+                      recorded_reply(reply_fut, *stats, robot::RobotControl_setSpeed_Hash, start);
                     if (reply_sample.data().data._u.setSpeed._d == robot::TooFast_Ex_Hash)
                     {
                       throw robot::TooFast();
@@ -551,14 +1071,20 @@ namespace dds {
           request->data._d = robot::RobotControl_getSpeed_Hash;
           request->data._u.getSpeed.dummy = 0;
 
+          boost::shared_ptr<OperationStatsRecorder> stats = stats_;
+          OperationStatsRecorder::clock::time_point start =
+            OperationStatsRecorder::clock::now();
+          stamp_header(request->header, params_.call_timeout());
+
           return 
-          requester_.send_request_async(*request)
-                    .then([](dds::rpc::future <Sample<robot::RobotControl_Reply>> && reply) {
-                        return reply.get().data().data._u.getSpeed._u.result.return_;
+          dds::rpc::then(send_read_async(*request), continuations_,
+                    [stats, start](dds::rpc::future <Sample<robot::RobotControl_Reply>> && reply) {
+                        return recorded_reply(reply, *stats, robot::RobotControl_getSpeed_Hash, start)
+                                 .data().data._u.getSpeed._u.result.return_;
                     });
       }
 
-      dds::rpc::future<robot::RobotControl_getStatus_Out> 
+      dds::rpc::future<robot::RobotControl_getStatus_AsyncOut> 
         ClientImpl<robot::RobotControl>::getStatus_async()
       {
         helper::unique_data<robot::RobotControl_Request> request;
@@ -567,10 +1093,22 @@ namespace dds {
         request->data._d = robot::RobotControl_getStatus_Hash;
         request->data._u.getSpeed.dummy = 0;
 
+        boost::shared_ptr<OperationStatsRecorder> stats = stats_;
+        OperationStatsRecorder::clock::time_point start =
+          OperationStatsRecorder::clock::now();
+        stamp_header(request->header, params_.call_timeout());
+
         return
-          requester_.send_request_async(*request)
-            .then([](dds::rpc::future <Sample<robot::RobotControl_Reply>> && reply_fut) {
-              return reply_fut.get().data().data._u.getStatus._u.result;
+          dds::rpc::then(send_read_async(*request), continuations_,
+            [stats, start](dds::rpc::future <Sample<robot::RobotControl_Reply>> && reply_fut) {
+              Sample<robot::RobotControl_Reply> reply_sample =
+                recorded_reply(reply_fut, *stats, robot::RobotControl_getStatus_Hash, start);
+              // A copy of its own, which outlives the sample.
+              robot::RobotControl_getStatus_AsyncOut out;
+              robot::Status_copy(&out.status,
+                                 &reply_sample.data().data._u.getStatus._u.result.status);
+              unshare_string(out.status.msg, reply_sample.data().header.payload);
+              return out;
             });
       }
 
@@ -11,6 +11,36 @@ namespace robot {
   class RobotControlSupport;
   class RobotControlAsync;
 
+  // What getStatus_async delivers: the out parameters of getStatus, as
+  // in RobotControl_getStatus_Out. Unlike that, it owns their strings,
+  // as a Status filled in by getStatus does.
+  struct RobotControl_getStatus_AsyncOut
+  {
+    Status status;
+
+    RobotControl_getStatus_AsyncOut()
+    {
+      Status_initialize(&status);
+    }
+
+    RobotControl_getStatus_AsyncOut(const RobotControl_getStatus_AsyncOut & other)
+    {
+      Status_initialize(&status);
+      Status_copy(&status, &other.status);
+    }
+
+    RobotControl_getStatus_AsyncOut & operator = (const RobotControl_getStatus_AsyncOut & other)
+    {
+      Status_copy(&status, &other.status);
+      return *this;
+    }
+
+    ~RobotControl_getStatus_AsyncOut()
+    {
+      Status_finalize(&status);
+    }
+  };
+
   class RobotControl
   {
   public:
@@ -40,7 +70,7 @@ namespace robot {
     virtual dds::rpc::future<void> command_async(const robot::Command & command) = 0;
     virtual dds::rpc::future<float> setSpeed_async(float speed) = 0;
     virtual dds::rpc::future<float> getSpeed_async() = 0;
-    virtual dds::rpc::future<robot::RobotControl_getStatus_Out> getStatus_async() = 0;
+    virtual dds::rpc::future<robot::RobotControl_getStatus_AsyncOut> getStatus_async() = 0;
 
     virtual ~RobotControlAsync() { }
   };
@@ -73,7 +103,7 @@ namespace robot {
       dds::rpc::future<void> command_async(const robot::Command & command);
       dds::rpc::future<float> setSpeed_async(float speed);
       dds::rpc::future<float> getSpeed_async();
-      dds::rpc::future<robot::RobotControl_getStatus_Out> getStatus_async();
+      dds::rpc::future<robot::RobotControl_getStatus_AsyncOut> getStatus_async();
 
     };
 
@@ -1,5 +1,10 @@
 #include "unique_data.h"
 #include "normative/request_reply.h"
+#include "duplicate_replies.h"
+#include "operation_table.h"
+#include "reply_cache.h"
+#include "shared_payload.h"
+#include "single_flight.h"
 
 namespace dds {
   namespace rpc {
@@ -16,10 +21,27 @@ namespace dds {
         typedef dds::rpc::Replier<RequestType, ReplyType> Replier;
 
       private:
+        typedef DuplicateReplyCache<dds::SampleIdentity, ReplyType> Duplicates;
+
         robot::RobotControl * robotimpl_;
         Replier replier_;
+        // Non-zero if large replies to clients that name host_ as their
+        // payloadHost go through shared memory.
+        int shared_payload_threshold_;
+        boost::uint64_t host_;
+        OperationStatsRecorder stats_;
+        // Null unless ServiceParams::duplicate_reply_cache_size is set.
+        boost::shared_ptr<Duplicates> duplicates_;
 
         void dispatch(const dds::Duration &);
+        void serve(SampleRef<RequestType> request_ref);
+        void serve_loaned(
+          boost::shared_ptr<Replier::LoanedSamplesType> requests,
+          int index,
+          AdmissionControl & admission,
+          AdmissionControl::clock::time_point received);
+        void shed(SampleRef<RequestType> request_ref);
+        void reply_to(SampleRef<RequestType> request_ref, ReplyType & reply);
 
       public:
 
@@ -29,6 +51,12 @@ namespace dds {
 
         virtual void close() override;
         virtual void run_impl(const dds::Duration &) override;
+        virtual DDS::Condition * get_request_condition() const override;
+        virtual void dispatch_available(
+          ThreadPoolExecutor & executor,
+          AdmissionControl & admission,
+          const boost::function<void()> & done) override;
+        virtual std::vector<OperationStats> stats() const override;
 
       };
 
@@ -75,6 +103,7 @@ namespace dds {
         DDS::DataWriter * get_request_datawriter() const;
         DDS::DataReader * get_reply_datareader() const;
         dds::rpc::ClientParams get_client_params() const override;
+        std::vector<OperationStats> stats() const override;
 
         /* methods from RobotControl */
         void command(const robot::Command & command) override;
@@ -86,7 +115,7 @@ namespace dds {
         dds::rpc::future<void> command_async(const robot::Command & command) override;
         dds::rpc::future<float> setSpeed_async(float speed) override;
         dds::rpc::future<float> getSpeed_async() override;
-        dds::rpc::future<robot::RobotControl_getStatus_Out> getStatus_async() override;
+        dds::rpc::future<robot::RobotControl_getStatus_AsyncOut> getStatus_async() override;
 
       private:
         typedef dds::rpc::Requester<
@@ -94,8 +123,37 @@ namespace dds {
           RobotControl::ReplyType>
           Requester;
 
+        typedef SingleFlight<boost::int32_t, Sample<RobotControl::ReplyType>>
+          ReadFlights;
+        typedef ReplyCache<boost::int32_t, Sample<RobotControl::ReplyType>>
+          ReadCache;
+
         dds::rpc::ClientParams params_;
+        // Runs the continuations of async calls.
+        Executor & continuations_;
         Requester requester_;
+        // Shared with the continuations of pending async calls.
+        boost::shared_ptr<OperationStatsRecorder> stats_;
+        // Async reads waiting for their reply, by operation. Writes make
+        // a new generation of flights.
+        boost::shared_ptr<ReadFlights> reads_;
+        // Null unless ClientParams::read_cache_staleness is set.
+        boost::shared_ptr<ReadCache> cache_;
+
+        // Sends request, waits for its reply and records the call.
+        // Throws std::runtime_error if no reply comes within the call
+        // timeout or the reply carries a standard remote exception.
+        void call(RobotControl::RequestType & request,
+                  Sample<RobotControl::ReplyType> & reply_sample);
+
+        // Sends request oneway and records the call.
+        void call_oneway(RobotControl::RequestType & request);
+
+        // Sends a read-only request, unless its reply is cached or an
+        // identical one already waits for its reply. Then that reply is
+        // shared.
+        dds::rpc::future<Sample<RobotControl::ReplyType>>
+          send_read_async(RobotControl::RequestType & request);
       };
 
     } // namespace details
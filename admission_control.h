@@ -0,0 +1,131 @@
+#ifndef OMG_DDS_RPC_ADMISSION_CONTROL_H
+#define OMG_DDS_RPC_ADMISSION_CONTROL_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+
+#include "boost/cstdint.hpp"
+
+namespace dds {
+  namespace rpc {
+    namespace details {
+
+      // Decides which requests the Server serves when it can't keep up.
+      // Shed requests get a REMOTE_EX_OUT_OF_RESOURCES reply right away,
+      // which costs far less than serving them late.
+      //
+      // A request is queued from the moment the Replier's DataReader
+      // receives it until a worker starts serving it, so the time it
+      // spent in the reader counts as well. At most max_queued requests
+      // wait between the Server taking them and a worker picking them
+      // up. The Server sheds the rest as soon as it takes them. How many
+      // wait in the reader before that is up to its resource limits.
+      //
+      // Queued requests are also shed by how long they waited, as in
+      // CoDel. A queue whose shortest wait over the last interval stayed
+      // under target is absorbing a burst: only requests that waited
+      // longer than interval are shed. Once even the shortest wait
+      // exceeds target, the queue is standing and the Server is
+      // overloaded. Requests that waited longer than target are then
+      // shed, until an interval goes by whose shortest wait is under
+      // target again.
+      //
+      // Adaptive LIFO isn't an option: the executor serves the requests
+      // of each client in order.
+      class AdmissionControl
+      {
+      public:
+        typedef std::chrono::steady_clock clock;
+
+      private:
+        const size_t max_queued_;           // 0: unbounded
+        const boost::int64_t target_ns_;    // 0: no shedding by wait
+        const boost::int64_t interval_ns_;
+
+        std::atomic<size_t> queued_;
+        std::atomic<boost::int64_t> interval_end_ns_;
+        std::atomic<boost::int64_t> min_wait_ns_;
+        std::atomic<bool> overloaded_;
+
+        AdmissionControl(const AdmissionControl &);
+        AdmissionControl & operator = (const AdmissionControl &);
+
+        static boost::int64_t ns_since_epoch(clock::time_point t)
+        {
+          return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            t.time_since_epoch()).count();
+        }
+
+      public:
+
+        AdmissionControl(size_t max_queued,
+                         boost::int64_t target_ns,
+                         boost::int64_t interval_ns)
+          : max_queued_(max_queued),
+            target_ns_(target_ns),
+            interval_ns_(interval_ns),
+            queued_(0),
+            interval_end_ns_(0),
+            min_wait_ns_(0),
+            overloaded_(false)
+        { }
+
+        // For every request taken. False if it must be shed right away.
+        bool enqueue()
+        {
+          size_t queued = queued_.fetch_add(1, std::memory_order_relaxed);
+          if (max_queued_ && queued >= max_queued_)
+          {
+            queued_.fetch_sub(1, std::memory_order_relaxed);
+            return false;
+          }
+          return true;
+        }
+
+        // For every request enqueued, when a worker picks it up. received
+        // is when the request arrived. False if it waited too long and
+        // must be shed.
+        bool dequeue(clock::time_point received)
+        {
+          queued_.fetch_sub(1, std::memory_order_relaxed);
+
+          if (!target_ns_)
+            return true;
+
+          boost::int64_t now = ns_since_epoch(clock::now());
+          boost::int64_t wait = now - ns_since_epoch(received);
+
+          // The first request after the end of an interval judges it.
+          boost::int64_t end = interval_end_ns_.load(std::memory_order_relaxed);
+          if (now >= end &&
+              interval_end_ns_.compare_exchange_strong(end, now + interval_ns_))
+          {
+            boost::int64_t min_wait = min_wait_ns_.exchange(wait);
+            overloaded_.store(end != 0 && min_wait > target_ns_,
+                              std::memory_order_relaxed);
+          }
+          else
+          {
+            boost::int64_t min_wait = min_wait_ns_.load(std::memory_order_relaxed);
+            while (wait < min_wait &&
+                   !min_wait_ns_.compare_exchange_weak(min_wait, wait))
+            { }
+          }
+
+          return wait <= (overloaded_.load(std::memory_order_relaxed)
+                            ? target_ns_
+                            : interval_ns_);
+        }
+
+        size_t queued() const
+        {
+          return queued_.load(std::memory_order_relaxed);
+        }
+      };
+
+    } // namespace details
+  } // namespace rpc
+} // namespace dds
+
+#endif // OMG_DDS_RPC_ADMISSION_CONTROL_H
@@ -1,12 +1,98 @@
+#include <chrono>
+#include <cstring>
+
 #include "common.h"
 #include "rpc_types.h"
 #include "ndds/ndds_requestreply_cpp.h"
+#include "boost/cstdint.hpp"
+
+static_assert(sizeof(dds::SampleIdentity) == sizeof(DDS_SampleIdentity_t),
+              "Sizes of two SampleIdentity don't match!");
+
+namespace {
+
+  // Both identity types are a 16-byte GUID followed by a (high, low)
+  // sequence number. Compare and hash them as three 64-bit words.
+  struct IdentityWords
+  {
+    boost::uint64_t guid[2];
+    boost::uint64_t sn;
+  };
+
+  template <class Identity>
+  IdentityWords to_words(const Identity & identity)
+  {
+    IdentityWords words;
+    memcpy(words.guid, &identity.writer_guid, sizeof(words.guid));
+    words.sn =
+      (static_cast<boost::uint64_t>(static_cast<boost::uint32_t>(identity.sequence_number.high)) << 32) |
+       static_cast<boost::uint32_t>(identity.sequence_number.low);
+    return words;
+  }
+
+  template <class Identity>
+  bool identity_less(const Identity & lhs, const Identity & rhs)
+  {
+    int guid = memcmp(&lhs.writer_guid, &rhs.writer_guid, sizeof(lhs.writer_guid));
+    if (guid != 0)
+      return guid < 0;
+
+    return to_words(lhs).sn < to_words(rhs).sn;
+  }
+
+  template <class Identity>
+  bool identity_equal(const Identity & lhs, const Identity & rhs)
+  {
+    IdentityWords l = to_words(lhs), r = to_words(rhs);
+    return l.sn == r.sn && l.guid[0] == r.guid[0] && l.guid[1] == r.guid[1];
+  }
+
+  boost::uint64_t mix(boost::uint64_t h)
+  {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return h;
+  }
+
+  template <class Identity>
+  std::size_t guid_hash(const Identity & identity)
+  {
+    IdentityWords words = to_words(identity);
+    boost::uint64_t h = mix(words.guid[0]) + 0x9e3779b97f4a7c15ULL;
+    h = mix(h ^ words.guid[1]);
+    return static_cast<std::size_t>(h);
+  }
+
+  template <class Identity>
+  std::size_t identity_hash(const Identity & identity)
+  {
+    IdentityWords words = to_words(identity);
+    boost::uint64_t h = mix(words.sn);
+    h = mix(h ^ words.guid[0]) + 0x9e3779b97f4a7c15ULL;
+    h = mix(h ^ words.guid[1]);
+    return static_cast<std::size_t>(h);
+  }
+
+} // anonymous namespace
 
 bool operator < (
   const DDS_SampleIdentity_t & lhs,
   const DDS_SampleIdentity_t & rhs)
 {
-  return lhs.sequence_number < rhs.sequence_number;
+  return identity_less(lhs, rhs);
+}
+
+bool operator == (
+  const DDS_SampleIdentity_t & lhs,
+  const DDS_SampleIdentity_t & rhs)
+{
+  return identity_equal(lhs, rhs);
+}
+
+std::size_t hash_value(const DDS_SampleIdentity_t & identity)
+{
+  return identity_hash(identity);
 }
 
 namespace dds {
@@ -15,13 +101,52 @@ namespace dds {
     const dds::SampleIdentity & lhs,
     const dds::SampleIdentity & rhs)
   {
-    return lhs.sequence_number.low < rhs.sequence_number.low;
+    return identity_less(lhs, rhs);
+  }
+
+  bool operator == (
+    const dds::SampleIdentity & lhs,
+    const dds::SampleIdentity & rhs)
+  {
+    return identity_equal(lhs, rhs);
+  }
+
+  std::size_t hash_value(const dds::SampleIdentity & identity)
+  {
+    return identity_hash(identity);
   }
 
   namespace rpc {
 
     namespace details {
 
+      std::size_t writer_guid_hash(const dds::SampleIdentity & identity)
+      {
+        return guid_hash(identity);
+      }
+
+      static unsigned long long wall_clock_ns()
+      {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::system_clock::now().time_since_epoch()).count();
+      }
+
+      unsigned long long deadline_after(const DDS_Duration_t & timeout)
+      {
+        if (timeout.sec == DDS_DURATION_INFINITE.sec &&
+            timeout.nanosec == DDS_DURATION_INFINITE.nanosec)
+          return 0;
+
+        return wall_clock_ns() +
+               static_cast<unsigned long long>(timeout.sec) * 1000000000ULL +
+               timeout.nanosec;
+      }
+
+      bool deadline_passed(unsigned long long deadline)
+      {
+        return deadline != 0 && wall_clock_ns() > deadline;
+      }
+
       DefaultDomainParticipant::DefaultDomainParticipant()
         : domainid(0),
           participant(0)
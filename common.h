@@ -1,13 +1,26 @@
 #ifndef OMG_DDS_RPC_COMMON_H
 #define OMG_DDS_RPC_COMMON_H
 
+#include <cstddef>
+#include <functional>
+
 class DDSDomainParticipant;
 struct DDS_SampleIdentity_t;
+struct DDS_Duration_t;
+
+// Sample identities order and compare by writer GUID first, then by
+// the full 64-bit sequence number.
 
 bool operator < (
   const DDS_SampleIdentity_t & lhs,
   const DDS_SampleIdentity_t & rhs);
 
+bool operator == (
+  const DDS_SampleIdentity_t & lhs,
+  const DDS_SampleIdentity_t & rhs);
+
+std::size_t hash_value(const DDS_SampleIdentity_t & identity);
+
 namespace dds {
 
   class SampleIdentity;
@@ -16,10 +29,28 @@ namespace dds {
     const dds::SampleIdentity & lhs,
     const dds::SampleIdentity & rhs);
 
+  bool operator == (
+    const dds::SampleIdentity & lhs,
+    const dds::SampleIdentity & rhs);
+
+  // Found by boost::hash through ADL.
+  std::size_t hash_value(const dds::SampleIdentity & identity);
+
   namespace rpc {
 
     namespace details {
 
+      // Hash of the writer GUID alone. Requests sent by one Requester
+      // share it, whatever their sequence number.
+      std::size_t writer_guid_hash(const dds::SampleIdentity & identity);
+
+      // Deadlines in RequestHeader are wall-clock time, so they can be
+      // compared on another host, as far as the clocks agree. A caller
+      // that waits for timeout gives up at deadline_after(timeout). An
+      // infinite timeout gives 0: no deadline.
+      unsigned long long deadline_after(const DDS_Duration_t & timeout);
+      bool deadline_passed(unsigned long long deadline);
+
       class DefaultDomainParticipant
       {
           int domainid;
@@ -36,4 +67,26 @@ namespace dds {
   } // namespace rpc
 } // namespace dds
 
+namespace std {
+
+  template <>
+  struct hash<DDS_SampleIdentity_t>
+  {
+    std::size_t operator () (const DDS_SampleIdentity_t & identity) const
+    {
+      return ::hash_value(identity);
+    }
+  };
+
+  template <>
+  struct hash<dds::SampleIdentity>
+  {
+    std::size_t operator () (const dds::SampleIdentity & identity) const
+    {
+      return dds::hash_value(identity);
+    }
+  };
+
+} // namespace std
+
 #endif // OMG_DDS_RPC_COMMON_H
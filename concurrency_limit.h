@@ -0,0 +1,332 @@
+#ifndef OMG_DDS_RPC_CONCURRENCY_LIMIT_H
+#define OMG_DDS_RPC_CONCURRENCY_LIMIT_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <deque>
+#include <unordered_map>
+#include <vector>
+
+#include "trace.h"
+
+#include "boost/cstdint.hpp"
+#include "boost/function.hpp"
+#include "boost/thread/lock_guard.hpp"
+#include "boost/thread/mutex.hpp"
+
+namespace dds {
+  namespace rpc {
+    namespace details {
+
+      // Caps how many send_request_async calls a Requester has waiting
+      // for a reply. Requests over the cap wait here, on the client,
+      // instead of blocking in the reliable writer once its send window
+      // fills up, or piling up in front of a service that can't keep up.
+      //
+      // The cap follows the round trip time, as in TCP Vegas. The
+      // shortest round trip seen is what a request costs when nothing
+      // is queued anywhere, so limit * (1 - min_rtt / rtt) estimates how
+      // many requests are queued on the way. The cap grows by one per
+      // reply while that estimate stays under ALPHA, and shrinks by one
+      // per reply above BETA. It only grows while the caller actually
+      // uses it. Shed requests, requests that ran out of time at the
+      // service and requests whose deadline passed without a reply are
+      // losses: each cuts the cap by a quarter. A request without a
+      // deadline is lost once it has waited LOST_RTT_MULTIPLE times the
+      // shortest round trip, and at least LOST_FLOOR_MS, so lost
+      // replies can't hold on to the slots for good.
+      //
+      // The shortest round trip is learned again every RTT_RESET_SAMPLES
+      // replies, so a service that got slower for good doesn't keep the
+      // cap low forever.
+      class ConcurrencyLimiter
+      {
+      public:
+        typedef std::chrono::steady_clock clock;
+        typedef boost::function<void ()> Waiter;
+
+        enum Outcome { OUTCOME_OK, OUTCOME_LOST };
+
+      private:
+        enum { INITIAL_LIMIT = 20,
+               ALPHA = 3,
+               BETA = 6,
+               RTT_RESET_SAMPLES = 1000,
+               SWEEP_PERIOD_MS = 10,
+               LOST_RTT_MULTIPLE = 16,
+               LOST_FLOOR_MS = 1000 };
+
+        struct Slot
+        {
+          clock::time_point sent;
+          boost::uint64_t deadline;   // as in RequestHeader; 0: none
+        };
+
+        struct Queued
+        {
+          Waiter waiter;
+          bool takes_slot;
+        };
+
+        const double max_limit_;
+
+        boost::mutex mutex_;
+        double limit_;
+        int in_flight_;
+        boost::int64_t min_rtt_ns_;
+        unsigned samples_;
+        clock::time_point next_sweep_;
+        // Requests sent and not answered yet, by the key the Requester
+        // matches their replies with.
+        std::unordered_map<boost::uint64_t, Slot> slots_;
+        std::deque<Queued> waiting_;
+
+        ConcurrencyLimiter(const ConcurrencyLimiter &);
+        ConcurrencyLimiter & operator = (const ConcurrencyLimiter &);
+
+        bool has_slot() const
+        {
+          return in_flight_ < static_cast<int>(limit_);
+        }
+
+        void sample(boost::int64_t rtt_ns)
+        {
+          if (++samples_ >= RTT_RESET_SAMPLES)
+          {
+            samples_ = 0;
+            min_rtt_ns_ = rtt_ns;
+          }
+          else if (min_rtt_ns_ == 0 || rtt_ns < min_rtt_ns_)
+            min_rtt_ns_ = rtt_ns;
+
+          double queued =
+            limit_ * (1.0 - static_cast<double>(min_rtt_ns_) /
+                              std::max<boost::int64_t>(rtt_ns, 1));
+
+          // The reply's own slot still counts as in use here.
+          if (queued < static_cast<double>(ALPHA) && 2 * (in_flight_ + 1) >= limit_)
+            limit_ = std::min(max_limit_, limit_ + 1);
+          else if (queued > static_cast<double>(BETA))
+            limit_ = std::max(1.0, limit_ - 1);
+        }
+
+        void lose()
+        {
+          limit_ = std::max(1.0, limit_ * 0.75);
+        }
+
+        // Hands free slots to the waiters, first come first served.
+        // Run the waiters returned without holding mutex_.
+        std::vector<Queued> ready_waiters()
+        {
+          std::vector<Queued> ready;
+          while (!waiting_.empty() && has_slot())
+          {
+            if (waiting_.front().takes_slot)
+              ++in_flight_;
+            ready.push_back(waiting_.front());
+            waiting_.pop_front();
+          }
+          return ready;
+        }
+
+        // Every waiter runs, even if one before it throws. One that
+        // throws gives back the slot it was handed.
+        void run(const std::vector<Queued> & ready)
+        {
+          for (size_t i = 0; i < ready.size(); ++i)
+          {
+            try {
+              ready[i].waiter();
+            }
+            catch (...) {
+              DDS_RPC_TRACE_EVENT(ERROR, JOB_ERROR);
+              if (ready[i].takes_slot)
+                cancel();
+            }
+          }
+        }
+
+        // Frees the slots of requests whose deadline passed without a
+        // reply, or that waited too long for one without a deadline.
+        // Their reply, should it come after all, is not measured.
+        std::vector<Queued> sweep(clock::time_point now)
+        {
+          if (now < next_sweep_ || slots_.empty())
+            return std::vector<Queued>();
+
+          next_sweep_ = now + std::chrono::milliseconds(SWEEP_PERIOD_MS);
+
+          boost::uint64_t wall_now =
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+              std::chrono::system_clock::now().time_since_epoch()).count();
+          clock::time_point sent_before =
+            now - std::max<clock::duration>(
+                    std::chrono::nanoseconds(LOST_RTT_MULTIPLE * min_rtt_ns_),
+                    std::chrono::milliseconds(LOST_FLOOR_MS));
+
+          bool lost = false;
+          for (auto it = slots_.begin(); it != slots_.end(); )
+          {
+            bool expired = it->second.deadline
+                             ? it->second.deadline < wall_now
+                             : it->second.sent < sent_before;
+            if (expired)
+            {
+              it = slots_.erase(it);
+              --in_flight_;
+              lost = true;
+            }
+            else
+              ++it;
+          }
+
+          // One loss per sweep: requests that timed out together were
+          // sent into the same congestion.
+          if (lost)
+            lose();
+
+          return ready_waiters();
+        }
+
+        void wait(const Waiter & waiter, bool takes_slot)
+        {
+          std::vector<Queued> ready;
+          {
+            boost::lock_guard<boost::mutex> guard(mutex_);
+            Queued queued = { waiter, takes_slot };
+            waiting_.push_back(queued);
+            ready = sweep(clock::now());
+            if (ready.empty())
+              ready = ready_waiters();
+          }
+          run(ready);
+        }
+
+      public:
+
+        explicit ConcurrencyLimiter(int max_limit)
+          : max_limit_(std::max(1, max_limit)),
+            limit_(std::min<double>(INITIAL_LIMIT, max_limit_)),
+            in_flight_(0),
+            min_rtt_ns_(0),
+            samples_(0)
+        { }
+
+        // Takes a slot if one is free and nobody waits for it.
+        bool try_acquire()
+        {
+          boost::lock_guard<boost::mutex> guard(mutex_);
+          if (!waiting_.empty() || !has_slot())
+            return false;
+
+          ++in_flight_;
+          return true;
+        }
+
+        // Calls waiter as soon as a slot is free, holding that slot.
+        // That may be right here, or on the thread that frees the slot.
+        // A waiter that throws gives the slot back by doing so: it must
+        // not cancel() it as well.
+        void enqueue(const Waiter & waiter)
+        {
+          wait(waiter, true);
+        }
+
+        // Calls waiter once a slot is free, without taking it.
+        void when_available(const Waiter & waiter)
+        {
+          wait(waiter, false);
+        }
+
+        // A request holding a slot was sent at sent. Its reply, or its
+        // deadline, frees the slot. Without a deadline the slot is freed
+        // once the reply is long overdue.
+        void track(boost::uint64_t key,
+                   clock::time_point sent,
+                   boost::uint64_t deadline)
+        {
+          Slot slot = { sent, deadline };
+
+          boost::lock_guard<boost::mutex> guard(mutex_);
+          slots_[key] = slot;
+        }
+
+        // Gives back a slot that was never tracked, e.g. when the write
+        // failed.
+        void cancel()
+        {
+          std::vector<Queued> ready;
+          {
+            boost::lock_guard<boost::mutex> guard(mutex_);
+            --in_flight_;
+            ready = ready_waiters();
+          }
+          run(ready);
+        }
+
+        // The reply to the request tracked as key arrived. Unknown keys
+        // are ignored: the request was never limited or has expired.
+        void release(boost::uint64_t key, Outcome outcome)
+        {
+          clock::time_point now = clock::now();
+          std::vector<Queued> ready;
+          {
+            boost::lock_guard<boost::mutex> guard(mutex_);
+            auto it = slots_.find(key);
+            if (it == slots_.end())
+              return;
+
+            boost::int64_t rtt_ns =
+              std::chrono::duration_cast<std::chrono::nanoseconds>(
+                now - it->second.sent).count();
+            slots_.erase(it);
+            --in_flight_;
+
+            if (outcome == OUTCOME_OK)
+              sample(rtt_ns);
+            else
+              lose();
+
+            ready = ready_waiters();
+          }
+          run(ready);
+        }
+
+        // For threads that wait for replies anyway, so expired slots are
+        // freed even when no reply comes.
+        void expire()
+        {
+          std::vector<Queued> ready;
+          {
+            boost::lock_guard<boost::mutex> guard(mutex_);
+            ready = sweep(clock::now());
+          }
+          run(ready);
+        }
+
+        int limit()
+        {
+          boost::lock_guard<boost::mutex> guard(mutex_);
+          return static_cast<int>(limit_);
+        }
+
+        int in_flight()
+        {
+          boost::lock_guard<boost::mutex> guard(mutex_);
+          return in_flight_;
+        }
+
+        size_t waiting()
+        {
+          boost::lock_guard<boost::mutex> guard(mutex_);
+          return waiting_.size();
+        }
+      };
+
+    } // namespace details
+  } // namespace rpc
+} // namespace dds
+
+#endif // OMG_DDS_RPC_CONCURRENCY_LIMIT_H
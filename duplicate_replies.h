@@ -0,0 +1,119 @@
+#ifndef OMG_DDS_RPC_DUPLICATE_REPLIES_H
+#define OMG_DDS_RPC_DUPLICATE_REPLIES_H
+
+#include <chrono>
+#include <cstddef>
+#include <deque>
+
+#include "unique_data.h"
+
+#include "boost/shared_ptr.hpp"
+#include "boost/thread/lock_guard.hpp"
+#include "boost/thread/mutex.hpp"
+#include "boost/unordered_map.hpp"
+
+namespace dds {
+  namespace rpc {
+    namespace details {
+
+      // The replies a service sent lately, by the requestId they answer.
+      // A client that retries after a timeout resends its request under
+      // the same requestId. The retry then gets the reply the service
+      // already made, and the operation doesn't run a second time.
+      //
+      // Holds at most capacity replies, each for at most lifetime. The
+      // oldest go first.
+      template <class Key, class T>
+      class DuplicateReplyCache
+      {
+      public:
+        typedef std::chrono::steady_clock clock;
+
+      private:
+        typedef boost::shared_ptr<helper::unique_data<T>> Reply;
+
+        struct Stored
+        {
+          Key key;
+          clock::time_point stored;
+        };
+
+        const size_t capacity_;
+        const clock::duration lifetime_;
+
+        boost::mutex mutex_;
+        boost::unordered_map<Key, Reply> replies_;
+        // Oldest first.
+        std::deque<Stored> order_;
+
+        DuplicateReplyCache(const DuplicateReplyCache &);
+        DuplicateReplyCache & operator = (const DuplicateReplyCache &);
+
+        void evict(clock::time_point now)
+        {
+          while (!order_.empty() &&
+                 (order_.size() > capacity_ ||
+                  now - order_.front().stored > lifetime_))
+          {
+            replies_.erase(order_.front().key);
+            order_.pop_front();
+          }
+        }
+
+      public:
+
+        DuplicateReplyCache(size_t capacity, clock::duration lifetime)
+          : capacity_(capacity),
+            lifetime_(lifetime)
+        { }
+
+        // Copies the reply already sent for key into reply, if any.
+        bool find(const Key & key, T & reply)
+        {
+          Reply stored;
+          {
+            boost::lock_guard<boost::mutex> guard(mutex_);
+            evict(clock::now());
+
+            typename boost::unordered_map<Key, Reply>::iterator it = replies_.find(key);
+            if (it == replies_.end())
+              return false;
+
+            stored = it->second;
+          }
+
+          // Stored replies are never changed, only dropped.
+          return T::TypeSupport::copy_data(&reply, stored->get()) == DDS_RETCODE_OK;
+        }
+
+        // The reply to key, before it goes out. A key seen before keeps
+        // its first reply.
+        void store(const Key & key, const T & reply)
+        {
+          Reply copy(new helper::unique_data<T>());
+          if (T::TypeSupport::copy_data(copy->get(), &reply) != DDS_RETCODE_OK)
+            return;
+
+          clock::time_point now = clock::now();
+
+          boost::lock_guard<boost::mutex> guard(mutex_);
+          if (!replies_.insert(std::make_pair(key, copy)).second)
+            return;
+
+          Stored stored = { key, now };
+          order_.push_back(stored);
+          evict(now);
+        }
+
+        size_t size()
+        {
+          boost::lock_guard<boost::mutex> guard(mutex_);
+          return replies_.size();
+        }
+      };
+
+    } // namespace details
+  } // namespace rpc
+} // namespace dds
+
+#endif // OMG_DDS_RPC_DUPLICATE_REPLIES_H
@@ -0,0 +1,286 @@
+#ifndef OMG_DDS_RPC_EXECUTOR_H
+#define OMG_DDS_RPC_EXECUTOR_H
+
+#include <atomic>
+#include <deque>
+#include <exception>
+
+#include "trace.h"
+#include "vendor_dependent.h"
+#include "work_stealing_executor.h"
+
+#include "boost/cstdint.hpp"
+#include "boost/bind.hpp"
+#include "boost/function.hpp"
+#include "boost/shared_ptr.hpp"
+#include "boost/thread/lock_guard.hpp"
+#include "boost/thread/mutex.hpp"
+
+namespace dds {
+  namespace rpc {
+
+    // Non-normative: decides where continuations and other short jobs
+    // run. Requesters complete their futures on one (see
+    // RequesterParams::completion_executor), clients run the
+    // continuations of their async operations on one (see
+    // ClientParams::continuation_executor), and then() chains
+    // continuations on one instead of launching a thread for each.
+    class Executor
+    {
+    public:
+      typedef boost::function<void ()> Job;
+
+      virtual ~Executor()
+      { }
+
+      virtual void post(const Job & job) = 0;
+
+      // True if post() runs the job before it returns, on the caller's
+      // thread.
+      virtual bool runs_inline() const
+      {
+        return false;
+      }
+    };
+
+    // Runs every job right away, on the thread that posts it. For a
+    // continuation that is the thread that completes the future, e.g.
+    // the Requester's reply pump. Fine for short continuations; one that
+    // blocks holds up every reply behind it.
+    class InlineExecutor : public Executor
+    {
+    public:
+
+      static InlineExecutor & instance()
+      {
+        static InlineExecutor executor;
+        return executor;
+      }
+
+      virtual void post(const Job & job) override
+      {
+        job();
+      }
+
+      virtual bool runs_inline() const override
+      {
+        return true;
+      }
+    };
+
+    // A fixed set of threads. Jobs posted without a key may run in any
+    // order and in parallel. Jobs posted with the same key run one at a
+    // time, in order. The destructor runs everything already posted.
+    class ThreadPoolExecutor : public Executor
+    {
+      details::WorkStealingExecutor pool_;
+      std::atomic<boost::uint64_t> next_key_;
+
+      ThreadPoolExecutor(const ThreadPoolExecutor &);
+      ThreadPoolExecutor & operator = (const ThreadPoolExecutor &);
+
+    public:
+
+      explicit ThreadPoolExecutor(int thread_count)
+        : pool_(thread_count),
+          next_key_(0)
+      { }
+
+      // Every job a key of its own, so they spread over the workers.
+      virtual void post(const Job & job) override
+      {
+        pool_.post(next_key_++, job);
+      }
+
+      void post(boost::uint64_t key, const Job & job)
+      {
+        pool_.post(key, job);
+      }
+    };
+
+    // Runs the jobs posted to it one at a time, in order, on another
+    // executor. Continuations that share state can go through a strand
+    // instead of taking a lock. A strand must outlive its jobs.
+    class StrandExecutor : public Executor
+    {
+      enum { BATCH = 16 };
+
+      Executor & target_;
+      boost::mutex mutex_;
+      std::deque<Job> jobs_;
+      // Set while a drain() is posted to or running on target_.
+      bool draining_;
+
+      StrandExecutor(const StrandExecutor &);
+      StrandExecutor & operator = (const StrandExecutor &);
+
+      // After BATCH jobs the strand goes back to target_, so it can't
+      // keep a thread of a shared pool to itself.
+      void drain()
+      {
+        Job job;
+        for (int i = 0; i < BATCH; ++i)
+        {
+          {
+            boost::lock_guard<boost::mutex> guard(mutex_);
+            if (jobs_.empty())
+            {
+              draining_ = false;
+              return;
+            }
+
+            job.swap(jobs_.front());
+            jobs_.pop_front();
+          }
+
+          try {
+            job();
+          }
+          catch (...)
+          {
+            DDS_RPC_TRACE_EVENT(ERROR, JOB_ERROR);
+          }
+        }
+
+        target_.post(boost::bind(&StrandExecutor::drain, this));
+      }
+
+    public:
+
+      explicit StrandExecutor(Executor & target)
+        : target_(target),
+          draining_(false)
+      { }
+
+      virtual void post(const Job & job) override
+      {
+        {
+          boost::lock_guard<boost::mutex> guard(mutex_);
+          jobs_.push_back(job);
+          if (draining_)
+            return;
+
+          draining_ = true;
+        }
+
+        target_.post(boost::bind(&StrandExecutor::drain, this));
+      }
+    };
+
+    namespace details {
+
+      // Completes reply_promise on executor, or right here without one.
+      template <class T>
+      void set_value_on(Executor * executor, promise<T> & reply_promise, T value)
+      {
+        if (!executor || executor->runs_inline())
+        {
+          reply_promise.set_value(value);
+          return;
+        }
+
+        // Jobs are copied, promises only move.
+        boost::shared_ptr<promise<T>> moved(new promise<T>());
+        moved->swap(reply_promise);
+        boost::shared_ptr<T> shared(new T(value));
+
+        executor->post([moved, shared]() { moved->set_value(*shared); });
+      }
+
+      // Breaks reply_promise with error on executor, or right here
+      // without one.
+      template <class T>
+      void set_exception_on(Executor * executor,
+                            promise<T> & reply_promise,
+                            const exception_ptr & error)
+      {
+        if (!executor || executor->runs_inline())
+        {
+          reply_promise.set_exception(error);
+          return;
+        }
+
+        boost::shared_ptr<promise<T>> moved(new promise<T>());
+        moved->swap(reply_promise);
+
+        executor->post([moved, error]() { moved->set_exception(error); });
+      }
+
+    } // namespace details
+
+#if defined(USE_BOOST_FUTURE) || defined(USE_LIGHT_FUTURE)
+
+    namespace details {
+
+#ifdef USE_BOOST_FUTURE
+
+      // fut.then(func), with func running where fut is completed.
+      template <class T, class F>
+      auto then_sync(future<T> && fut, F && func)
+        -> decltype(fut.then(boost::launch::sync, std::forward<F>(func)))
+      {
+        return fut.then(boost::launch::sync, std::forward<F>(func));
+      }
+
+#else
+
+      // Light futures always run continuations where they are completed.
+      template <class T, class F>
+      auto then_sync(future<T> && fut, F && func)
+        -> decltype(fut.then(std::forward<F>(func)))
+      {
+        return fut.then(std::forward<F>(func));
+      }
+
+#endif
+
+    } // namespace details
+
+    // Non-normative: fut.then(func), with func running on executor.
+    // With the default launch policy boost may launch a thread for
+    // every continuation. Here the future is handed to executor from
+    // the thread that completes it, and func runs wherever executor
+    // puts the job: no thread is launched unless executor does.
+    template <class T, class F>
+    auto then(future<T> && fut, Executor & executor, F && func)
+      -> decltype(details::then_sync(std::move(fut), std::forward<F>(func)))
+    {
+      if (executor.runs_inline())
+        return details::then_sync(std::move(fut), std::forward<F>(func));
+
+      // Ready on executor, holding fut once that is ready.
+      boost::shared_ptr<details::promise<future<T>>> hop(new details::promise<future<T>>());
+      future<future<T>> hopped = hop->get_future();
+      Executor * target = &executor;
+
+      details::then_sync(std::move(fut), [hop, target](future<T> ready) {
+        boost::shared_ptr<future<T>> shared(new future<T>(std::move(ready)));
+        target->post([hop, shared]() { hop->set_value(std::move(*shared)); });
+      });
+
+      typename std::decay<F>::type f(std::forward<F>(func));
+      return details::then_sync(std::move(hopped), [f](future<future<T>> outer) mutable {
+        return f(outer.get());
+      });
+    }
+
+#endif // USE_BOOST_FUTURE || USE_LIGHT_FUTURE
+
+#ifdef USE_PPLTASKS
+
+    // PPL runs continuations on the Concurrency Runtime's scheduler,
+    // which doesn't launch a thread per continuation. The executor is
+    // not used.
+    template <class T, class F>
+    auto then(future<T> && fut, Executor &, F && func)
+      -> decltype(fut.then(std::forward<F>(func)))
+    {
+      return fut.then(std::forward<F>(func));
+    }
+
+#endif // USE_PPLTASKS
+
+  } // namespace rpc
+} // namespace dds
+
+#endif // OMG_DDS_RPC_EXECUTOR_H
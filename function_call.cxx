@@ -1,9 +1,11 @@
+#include <algorithm>
 #include <string>
 #include <vector>
 #include <stdexcept>
 
 #include "normative/function_call.h"
 #include "common.h"
+#include "trace.h"
 #include "boost/make_shared.hpp"
 
 namespace dds {
@@ -11,16 +13,60 @@ namespace rpc {
 
 namespace details {
 
+static boost::int64_t duration_ns(const dds::Duration & d)
+{
+  return static_cast<boost::int64_t>(d.sec) * 1000000000 + d.nanosec;
+}
+
+static AdmissionControl * admission_control_for(const ServerParams & sp)
+{
+  dds::Duration target = sp.queue_delay_target();
+  bool infinite = target.sec == DDS_DURATION_INFINITE.sec &&
+                  target.nanosec == DDS_DURATION_INFINITE.nanosec;
+
+  return new AdmissionControl(sp.max_queued_requests(),
+                              infinite ? 0 : duration_ns(target),
+                              duration_ns(sp.queue_delay_interval()));
+}
+
 ServerImpl::ServerImpl()
-  : participant_(dds::rpc::details::DefaultDomainParticipant::singleton().get())
+  : participant_(dds::rpc::details::DefaultDomainParticipant::singleton().get()),
+    worker_threads_(ServerParams().worker_threads()),
+    executor_(0),
+    admission_(admission_control_for(ServerParams())),
+    in_flight_(0),
+    closing_(false)
 {
   if (!participant_)
     throw std::runtime_error("Unable to create participant");
+
+  waitset_.attach_condition(&work_done_);
 }
 
 ServerImpl::ServerImpl(const ServerParams & sp)
-    : participant_(sp.default_service_params().domain_participant())
-{}
+    : participant_(sp.default_service_params().domain_participant()),
+      worker_threads_(sp.worker_threads()),
+      executor_(sp.executor()),
+      admission_(admission_control_for(sp)),
+      in_flight_(0),
+      closing_(false)
+{
+  waitset_.attach_condition(&work_done_);
+}
+
+ServerImpl::~ServerImpl()
+{
+  close();
+
+  // Runs whatever is still queued and joins the workers. A shared
+  // executor has nothing of ours left: run() drains before it returns.
+  own_executor_.reset();
+
+  for (size_t i = 0; i < watched_.size(); ++i)
+    waitset_.detach_condition(watched_[i].condition);
+
+  waitset_.detach_condition(&work_done_);
+}
    
 void ServerImpl::register_service(boost::shared_ptr<RPCEntityImpl> dispatcher)
 {
@@ -28,18 +74,148 @@ void ServerImpl::register_service(boost::shared_ptr<RPCEntityImpl> dispatcher)
 }
 
 void ServerImpl::close()
-{}
+{
+  boost::lock_guard<boost::mutex> guard(mutex_);
+  closing_ = true;
+  work_done_.set_trigger_value(DDS_BOOLEAN_TRUE);
+}
+
+void ServerImpl::watch_new_dispatchers()
+{
+  if (!executor_)
+  {
+    own_executor_.reset(new ThreadPoolExecutor(worker_threads_));
+    executor_ = own_executor_.get();
+  }
+
+  for (size_t i = watched_.size(); i < dispatchers.size(); ++i)
+  {
+    WatchedService service;
+    service.dispatcher = static_cast<ServiceEndpointImpl *>(dispatchers[i].get());
+    service.condition = service.dispatcher->get_request_condition();
+    service.loans = 0;
+
+    waitset_.attach_condition(service.condition);
+
+    // Workers look at watched_ from service_done.
+    boost::lock_guard<boost::mutex> guard(mutex_);
+    watched_.push_back(service);
+  }
+}
+
+void ServerImpl::service_done(size_t index)
+{
+  {
+    boost::lock_guard<boost::mutex> guard(mutex_);
+    --in_flight_;
+
+    // Only the run thread touches the WaitSet.
+    if (watched_[index].loans-- == MAX_LOANS_PER_SERVICE)
+    {
+      finished_.push_back(index);
+      work_done_.set_trigger_value(DDS_BOOLEAN_TRUE);
+    }
+  }
+  idle_.notify_all();
+}
+
+void ServerImpl::rearm_finished()
+{
+  std::vector<size_t> finished;
+  {
+    boost::lock_guard<boost::mutex> guard(mutex_);
+    finished.swap(finished_);
+    work_done_.set_trigger_value(closing_ ? DDS_BOOLEAN_TRUE : DDS_BOOLEAN_FALSE);
+  }
 
+  for (size_t i = 0; i < finished.size(); ++i)
+    waitset_.attach_condition(watched_[finished[i]].condition);
+}
+
+// Waits once on every service's request reader and takes the requests
+// of each ready service. The executor serves them in order per client
+// and in parallel across clients. Returns false on timeout.
+bool ServerImpl::wait_and_dispatch(const dds::Duration & max_wait)
+{
+  DDS::ConditionSeq active;
+  DDS::ReturnCode_t retcode = waitset_.wait(active, max_wait);
+
+  if (retcode == DDS_RETCODE_TIMEOUT)
+    return false;
+
+  if (retcode != DDS_RETCODE_OK)
+    throw std::runtime_error("WaitSet wait failed");
+
+  for (int i = 0; i < active.length(); ++i)
+  {
+    if (active[i] == &work_done_)
+    {
+      rearm_finished();
+      continue;
+    }
+
+    for (size_t w = 0; w < watched_.size(); ++w)
+    {
+      if (watched_[w].condition == active[i])
+      {
+        bool at_limit;
+        {
+          boost::lock_guard<boost::mutex> guard(mutex_);
+          ++in_flight_;
+          at_limit = ++watched_[w].loans == MAX_LOANS_PER_SERVICE;
+        }
+
+        if (at_limit)
+          waitset_.detach_condition(watched_[w].condition);
+
+        try {
+          watched_[w].dispatcher->dispatch_available(
+            *executor_,
+            *admission_,
+            boost::bind(&ServerImpl::service_done, this, w));
+        }
+        catch (std::exception & ex)
+        {
+          // done() has run or will run when the taken requests are served.
+          DDS_RPC_TRACE_EVENT(ERROR, DISPATCH_ERROR);
+          printf("Exception while dispatching: %s\n", ex.what());
+        }
+        break;
+      }
+    }
+  }
+
+  return true;
+}
+
+void ServerImpl::drain()
+{
+  {
+    boost::unique_lock<boost::mutex> lock(mutex_);
+    while (in_flight_ > 0)
+      idle_.wait(lock);
+  }
+  rearm_finished();
+}
+
+// Serves all the services until close().
 void ServerImpl::run()
 {
-  for (int i = 0; i < dispatchers.size(); i++)
-    static_cast<ServiceEndpointImpl *>(dispatchers[i].get())->run_impl(dds::Duration::from_seconds(20));
+  watch_new_dispatchers();
+
+  while (!closing_)
+    wait_and_dispatch(DDS_DURATION_INFINITE);
+
+  drain();
 }
 
+// Waits up to timeout for requests on any service, serves them on the
+// worker threads and returns once they are done.
 void ServerImpl::run(const dds::Duration & timeout)
 {
-  for (int i = 0; i < dispatchers.size(); i++)
-    static_cast<ServiceEndpointImpl *>(dispatchers[i].get())->run_impl(timeout);
+  watch_new_dispatchers();
+  wait_and_dispatch(timeout);
+  drain();
 }
 
 ServiceEndpointImpl::~ServiceEndpointImpl()
@@ -106,6 +282,61 @@ ServiceParams ServerParams::default_service_params() const
   return impl_->default_service_params();
 }
 
+ServerParams & ServerParams::worker_threads(int count)
+{
+  impl_->worker_threads(count);
+  return *this;
+}
+
+int ServerParams::worker_threads() const
+{
+  return impl_->worker_threads();
+}
+
+ServerParams & ServerParams::max_queued_requests(int count)
+{
+  impl_->max_queued_requests(count);
+  return *this;
+}
+
+ServerParams & ServerParams::queue_delay_target(const dds::Duration & target)
+{
+  impl_->queue_delay_target(target);
+  return *this;
+}
+
+ServerParams & ServerParams::queue_delay_interval(const dds::Duration & interval)
+{
+  impl_->queue_delay_interval(interval);
+  return *this;
+}
+
+int ServerParams::max_queued_requests() const
+{
+  return impl_->max_queued_requests();
+}
+
+dds::Duration ServerParams::queue_delay_target() const
+{
+  return impl_->queue_delay_target();
+}
+
+dds::Duration ServerParams::queue_delay_interval() const
+{
+  return impl_->queue_delay_interval();
+}
+
+ServerParams & ServerParams::executor(ThreadPoolExecutor & executor)
+{
+  impl_->executor(&executor);
+  return *this;
+}
+
+ThreadPoolExecutor * ServerParams::executor() const
+{
+  return impl_->executor();
+}
+
 ServiceParams::ServiceParams()
 : impl_(boost::make_shared<details::ServiceParamsImpl>())
 {}
@@ -208,6 +439,61 @@ dds_entity_traits::DomainParticipant ServiceParams::domain_participant() const
   return impl_->domain_participant();
 }
 
+ServiceParams & ServiceParams::shared_payload_threshold(int bytes)
+{
+  impl_->shared_payload_threshold(bytes);
+  return *this;
+}
+
+int ServiceParams::shared_payload_threshold() const
+{
+  return impl_->shared_payload_threshold();
+}
+
+ServiceParams & ServiceParams::duplicate_reply_cache_size(int replies)
+{
+  impl_->duplicate_reply_cache_size(replies);
+  return *this;
+}
+
+ServiceParams & ServiceParams::duplicate_reply_lifetime(const dds::Duration & lifetime)
+{
+  impl_->duplicate_reply_lifetime(lifetime);
+  return *this;
+}
+
+int ServiceParams::duplicate_reply_cache_size() const
+{
+  return impl_->duplicate_reply_cache_size();
+}
+
+dds::Duration ServiceParams::duplicate_reply_lifetime() const
+{
+  return impl_->duplicate_reply_lifetime();
+}
+
+ServiceParams & ServiceParams::reply_batch_size(int replies)
+{
+  impl_->reply_batch_size(replies);
+  return *this;
+}
+
+ServiceParams & ServiceParams::reply_flush_delay(const dds::Duration & delay)
+{
+  impl_->reply_flush_delay(delay);
+  return *this;
+}
+
+int ServiceParams::reply_batch_size() const
+{
+  return impl_->reply_batch_size();
+}
+
+dds::Duration ServiceParams::reply_flush_delay() const
+{
+  return impl_->reply_flush_delay();
+}
+
 ClientParams::ClientParams()
 : impl_(boost::make_shared<details::ClientParamsImpl>())
 { }
@@ -239,6 +525,61 @@ dds_entity_traits::DomainParticipant ClientParams::domain_participant() const
   return impl_->domain_participant();
 }
 
+ClientParams & ClientParams::call_timeout(const dds::Duration & timeout)
+{
+  impl_->call_timeout(timeout);
+  return *this;
+}
+
+dds::Duration ClientParams::call_timeout() const
+{
+  return impl_->call_timeout();
+}
+
+ClientParams & ClientParams::oneway_void_operations(bool enable)
+{
+  impl_->oneway_void_operations(enable);
+  return *this;
+}
+
+bool ClientParams::oneway_void_operations() const
+{
+  return impl_->oneway_void_operations();
+}
+
+ClientParams & ClientParams::coalesce_reads(bool enable)
+{
+  impl_->coalesce_reads(enable);
+  return *this;
+}
+
+bool ClientParams::coalesce_reads() const
+{
+  return impl_->coalesce_reads();
+}
+
+ClientParams & ClientParams::read_cache_staleness(const dds::Duration & max_staleness)
+{
+  impl_->read_cache_staleness(max_staleness);
+  return *this;
+}
+
+dds::Duration ClientParams::read_cache_staleness() const
+{
+  return impl_->read_cache_staleness();
+}
+
+ClientParams & ClientParams::continuation_executor(Executor & executor)
+{
+  impl_->continuation_executor(&executor);
+  return *this;
+}
+
+Executor * ClientParams::continuation_executor() const
+{
+  return impl_->continuation_executor();
+}
+
 ClientParams & ClientParams::operator = (const ClientParams & that)
 {
   impl_ = boost::make_shared<details::ClientParamsImpl>(*that.impl_.get());
@@ -253,6 +594,16 @@ ClientEndpoint::ClientEndpoint(const ClientEndpoint & ce)
     : ServiceProxy(ce)
 {}
 
+std::vector<OperationStats> ServiceEndpoint::stats() const
+{
+  return static_cast<details::ServiceEndpointImpl *>(impl_.get())->stats();
+}
+
+std::vector<OperationStats> ClientEndpoint::stats() const
+{
+  return static_cast<details::ClientEndpointImpl *>(impl_.get())->stats();
+}
+
 
 } // namespace rpc
 } // namespace dds
@@ -264,9 +615,75 @@ namespace rpc {
   namespace details {
 
     ClientParamsImpl::ClientParamsImpl()
+      : call_timeout_(dds::Duration::from_seconds(20)),
+        oneway_void_operations_(false),
+        coalesce_reads_(true),
+        read_cache_staleness_(dds::Duration::from_seconds(0)),
+        continuation_executor_(0)
     {}
 
+    void ClientParamsImpl::call_timeout(const dds::Duration & timeout)
+    {
+      if (timeout.sec < 0 || (timeout.sec == 0 && timeout.nanosec == 0))
+        throw std::invalid_argument("call_timeout must be positive");
+
+      call_timeout_ = timeout;
+    }
+
+    dds::Duration ClientParamsImpl::call_timeout() const
+    {
+      return call_timeout_;
+    }
+
+    void ClientParamsImpl::oneway_void_operations(bool enable)
+    {
+      oneway_void_operations_ = enable;
+    }
+
+    bool ClientParamsImpl::oneway_void_operations() const
+    {
+      return oneway_void_operations_;
+    }
+
+    void ClientParamsImpl::coalesce_reads(bool enable)
+    {
+      coalesce_reads_ = enable;
+    }
+
+    bool ClientParamsImpl::coalesce_reads() const
+    {
+      return coalesce_reads_;
+    }
+
+    void ClientParamsImpl::read_cache_staleness(const dds::Duration & max_staleness)
+    {
+      if (max_staleness.sec < 0)
+        throw std::invalid_argument("read_cache_staleness can't be negative");
+
+      read_cache_staleness_ = max_staleness;
+    }
+
+    dds::Duration ClientParamsImpl::read_cache_staleness() const
+    {
+      return read_cache_staleness_;
+    }
+
+    void ClientParamsImpl::continuation_executor(Executor * executor)
+    {
+      continuation_executor_ = executor;
+    }
+
+    Executor * ClientParamsImpl::continuation_executor() const
+    {
+      return continuation_executor_;
+    }
+
     ServerParamsImpl::ServerParamsImpl()
+      : worker_threads_(std::max(1u, boost::thread::hardware_concurrency())),
+        max_queued_requests_(4096),
+        queue_delay_target_(dds::Duration::from_millis(5)),
+        queue_delay_interval_(dds::Duration::from_millis(100)),
+        executor_(0)
     {}
 
     void ServerParamsImpl::default_service_params(const ServiceParams & service_params)
@@ -274,17 +691,86 @@ namespace rpc {
       service_params_ = service_params;
     }
 
+    void ServerParamsImpl::worker_threads(int count)
+    {
+      if (count < 1)
+        throw std::invalid_argument("worker_threads must be at least 1");
+
+      worker_threads_ = count;
+    }
+
     ServiceParams ServerParamsImpl::default_service_params() const
     {
       return service_params_;
     }
 
+    int ServerParamsImpl::worker_threads() const
+    {
+      return worker_threads_;
+    }
+
+    void ServerParamsImpl::max_queued_requests(int count)
+    {
+      if (count < 0)
+        throw std::invalid_argument("max_queued_requests can't be negative");
+
+      max_queued_requests_ = count;
+    }
+
+    void ServerParamsImpl::queue_delay_target(const dds::Duration & target)
+    {
+      if (target.sec < 0 || (target.sec == 0 && target.nanosec == 0))
+        throw std::invalid_argument("queue_delay_target must be positive");
+
+      queue_delay_target_ = target;
+    }
+
+    void ServerParamsImpl::queue_delay_interval(const dds::Duration & interval)
+    {
+      if (interval.sec < 0 || (interval.sec == 0 && interval.nanosec == 0) ||
+          (interval.sec == DDS_DURATION_INFINITE.sec &&
+           interval.nanosec == DDS_DURATION_INFINITE.nanosec))
+        throw std::invalid_argument("queue_delay_interval must be positive and finite");
+
+      queue_delay_interval_ = interval;
+    }
+
+    int ServerParamsImpl::max_queued_requests() const
+    {
+      return max_queued_requests_;
+    }
+
+    dds::Duration ServerParamsImpl::queue_delay_target() const
+    {
+      return queue_delay_target_;
+    }
+
+    dds::Duration ServerParamsImpl::queue_delay_interval() const
+    {
+      return queue_delay_interval_;
+    }
+
+    void ServerParamsImpl::executor(ThreadPoolExecutor * executor)
+    {
+      executor_ = executor;
+    }
+
+    ThreadPoolExecutor * ServerParamsImpl::executor() const
+    {
+      return executor_;
+    }
+
     ServiceParamsImpl::ServiceParamsImpl()
       : participant_(0),
         publisher_(0),
         subscriber_(0),
         dwqos_def(false),
-        drqos_def(false)
+        drqos_def(false),
+        shared_payload_threshold_(0),
+        duplicate_reply_cache_size_(0),
+        duplicate_reply_lifetime_(dds::Duration::from_seconds(30)),
+        reply_batch_size_(1),
+        reply_flush_delay_(dds::Duration::from_micros(500))
     {}
 
     void ServiceParamsImpl::service_name(const std::string &service_name)
@@ -334,6 +820,46 @@ namespace rpc {
       participant_ = part;
     }
 
+    void ServiceParamsImpl::shared_payload_threshold(int bytes)
+    {
+      if (bytes < 0)
+        throw std::invalid_argument("shared_payload_threshold can't be negative");
+
+      shared_payload_threshold_ = bytes;
+    }
+
+    void ServiceParamsImpl::duplicate_reply_cache_size(int replies)
+    {
+      if (replies < 0)
+        throw std::invalid_argument("duplicate_reply_cache_size can't be negative");
+
+      duplicate_reply_cache_size_ = replies;
+    }
+
+    void ServiceParamsImpl::duplicate_reply_lifetime(const dds::Duration & lifetime)
+    {
+      if (lifetime.sec < 0 || (lifetime.sec == 0 && lifetime.nanosec == 0))
+        throw std::invalid_argument("duplicate_reply_lifetime must be positive");
+
+      duplicate_reply_lifetime_ = lifetime;
+    }
+
+    void ServiceParamsImpl::reply_batch_size(int replies)
+    {
+      if (replies < 1)
+        throw std::invalid_argument("reply_batch_size must be at least 1");
+
+      reply_batch_size_ = replies;
+    }
+
+    void ServiceParamsImpl::reply_flush_delay(const dds::Duration & delay)
+    {
+      if (delay.sec < 0 || (delay.sec == 0 && delay.nanosec == 0))
+        throw std::invalid_argument("reply_flush_delay must be positive");
+
+      reply_flush_delay_ = delay;
+    }
+
     const std::string & ServiceParamsImpl::service_name() const
     {
       return service_name_;
@@ -385,6 +911,31 @@ namespace rpc {
       return participant_;
     }
 
+    int ServiceParamsImpl::shared_payload_threshold() const
+    {
+      return shared_payload_threshold_;
+    }
+
+    int ServiceParamsImpl::duplicate_reply_cache_size() const
+    {
+      return duplicate_reply_cache_size_;
+    }
+
+    dds::Duration ServiceParamsImpl::duplicate_reply_lifetime() const
+    {
+      return duplicate_reply_lifetime_;
+    }
+
+    int ServiceParamsImpl::reply_batch_size() const
+    {
+      return reply_batch_size_;
+    }
+
+    dds::Duration ServiceParamsImpl::reply_flush_delay() const
+    {
+      return reply_flush_delay_;
+    }
+
 
     /*
     ClientImpl::ClientImpl()
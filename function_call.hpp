@@ -1,4 +1,10 @@
 #include "normative/request_reply.h"
+#include "admission_control.h"
+#include "executor.h"
+
+#include "boost/scoped_ptr.hpp"
+
+#include <atomic>
 
 namespace dds {
   namespace rpc {
@@ -12,9 +18,43 @@ class ServiceEndpointImpl : public RPCEntityImpl
 public:
 
   virtual void run_impl(const dds::Duration &) = 0;
+
+  // The Server waits on this condition and calls dispatch_available()
+  // when requests arrive. Owned by the service's Replier.
+  virtual DDS::Condition * get_request_condition() const = 0;
+
+  // Takes the requests already received, without blocking, and posts
+  // one job per request to executor, keyed by the requester's GUID.
+  // Requests admission turns down are shed. Calls done() once all of
+  // them have been served or shed.
+  virtual void dispatch_available(
+    ThreadPoolExecutor & executor,
+    AdmissionControl & admission,
+    const boost::function<void()> & done) = 0;
+
+  virtual std::vector<OperationStats> stats() const = 0;
+
   virtual ~ServiceEndpointImpl();
 };
 
+// shared_ptr deleter that returns a loan of requests shared by several
+// jobs, then reports that the last of them is done.
+struct ReturnLoanThen
+{
+  boost::function<void()> done;
+
+  explicit ReturnLoanThen(const boost::function<void()> & on_done)
+    : done(on_done)
+  { }
+
+  template <class Loan>
+  void operator () (Loan * loan)
+  {
+    delete loan;
+    done();
+  }
+};
+
 class ServerImpl : public RPCEntityImpl
 {
 public:
@@ -22,11 +62,54 @@ public:
   std::vector<boost::shared_ptr<RPCEntityImpl>> dispatchers;
   DDSDomainParticipant * participant_;
 
+private:
+  // Loans of requests a service may have out at once. Each take is one
+  // loan, returned once all its requests are served, so a slow request
+  // holds up only the requests of its own take.
+  enum { MAX_LOANS_PER_SERVICE = 8 };
+
+  // A dispatcher whose request condition is watched by waitset_. Its
+  // condition stays attached while the service has fewer than
+  // MAX_LOANS_PER_SERVICE loans out. At the limit it is detached until
+  // one of them comes back, so the DataReader keeps the requests
+  // instead of the executor.
+  struct WatchedService
+  {
+    ServiceEndpointImpl * dispatcher;
+    DDS::Condition * condition;
+    int loans;   // guarded by mutex_
+  };
+
+  int worker_threads_;
+  // Either own_executor_ or the one in ServerParams.
+  boost::scoped_ptr<ThreadPoolExecutor> own_executor_;
+  ThreadPoolExecutor * executor_;
+  boost::scoped_ptr<AdmissionControl> admission_;
+
+  DDS::WaitSet waitset_;
+  DDS::GuardCondition work_done_;
+  std::vector<WatchedService> watched_;
+
+  boost::mutex mutex_;
+  boost::condition_variable idle_;
+  // Services whose condition is to be attached again.
+  std::vector<size_t> finished_;
+  size_t in_flight_;
+  std::atomic<bool> closing_;
+
+  void watch_new_dispatchers();
+  void service_done(size_t index);
+  void rearm_finished();
+  bool wait_and_dispatch(const dds::Duration & max_wait);
+  void drain();
+
 public:
   ServerImpl();
 
   ServerImpl(const ServerParams & server_params);
 
+  ~ServerImpl();
+
   void register_service(boost::shared_ptr<RPCEntityImpl> dispatcher);
   void run();
   void run(const dds::Duration &);
@@ -46,6 +129,11 @@ private:
   std::string instance_name_;
   std::string request_topic_name_;
   std::string reply_topic_name_;
+  int shared_payload_threshold_;
+  int duplicate_reply_cache_size_;
+  dds::Duration duplicate_reply_lifetime_;
+  int reply_batch_size_;
+  dds::Duration reply_flush_delay_;
 
 public:
   ServiceParamsImpl();
@@ -59,6 +147,11 @@ public:
   void publisher(DDSPublisher *publisher);
   void subscriber(DDSSubscriber *subscriber);
   void domain_participant(DDSDomainParticipant *part);
+  void shared_payload_threshold(int bytes);
+  void duplicate_reply_cache_size(int replies);
+  void duplicate_reply_lifetime(const dds::Duration & lifetime);
+  void reply_batch_size(int replies);
+  void reply_flush_delay(const dds::Duration & delay);
 
   const std::string & service_name() const;
   const std::string & instance_name() const;
@@ -69,25 +162,61 @@ public:
   DDSPublisher * publisher() const;
   DDSSubscriber * subscriber() const;
   DDSDomainParticipant * domain_participant() const;
+  int shared_payload_threshold() const;
+  int duplicate_reply_cache_size() const;
+  dds::Duration duplicate_reply_lifetime() const;
+  int reply_batch_size() const;
+  dds::Duration reply_flush_delay() const;
 };
 
 class ClientParamsImpl : public ServiceParamsImpl
 {
+  dds::Duration call_timeout_;
+  bool oneway_void_operations_;
+  bool coalesce_reads_;
+  dds::Duration read_cache_staleness_;
+  Executor * continuation_executor_;
 
 public:
   ClientParamsImpl();
+
+  void call_timeout(const dds::Duration & timeout);
+  dds::Duration call_timeout() const;
+  void oneway_void_operations(bool enable);
+  bool oneway_void_operations() const;
+  void coalesce_reads(bool enable);
+  bool coalesce_reads() const;
+  void read_cache_staleness(const dds::Duration & max_staleness);
+  dds::Duration read_cache_staleness() const;
+  void continuation_executor(Executor * executor);
+  Executor * continuation_executor() const;
 };
 
 class ServerParamsImpl
 {
   dds::rpc::ServiceParams service_params_;
+  int worker_threads_;
+  int max_queued_requests_;
+  dds::Duration queue_delay_target_;
+  dds::Duration queue_delay_interval_;
+  ThreadPoolExecutor * executor_;
 
 public:
   ServerParamsImpl();
 
   void default_service_params(const ServiceParams & service_params);
+  void worker_threads(int count);
+  void max_queued_requests(int count);
+  void queue_delay_target(const dds::Duration & target);
+  void queue_delay_interval(const dds::Duration & interval);
+  void executor(ThreadPoolExecutor * executor);
 
   ServiceParams default_service_params() const;
+  int worker_threads() const;
+  int max_queued_requests() const;
+  dds::Duration queue_delay_target() const;
+  dds::Duration queue_delay_interval() const;
+  ThreadPoolExecutor * executor() const;
 };
 
 
@@ -126,6 +255,8 @@ public:
 
   virtual dds::rpc::ClientParams get_client_params() const = 0;
 
+  virtual std::vector<OperationStats> stats() const = 0;
+
 };
 
 } // namespace details 
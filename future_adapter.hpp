@@ -7,6 +7,11 @@
 #define BOOST_RESULT_OF_USE_DECLTYPE
 
 #include "boost/thread/future.hpp"
+
+#ifdef _MSC_VER
+
+// Coroutines as in Visual C++ /await.
+
 #include <experimental\resumable>
 
 namespace boost {
@@ -96,8 +101,146 @@ namespace std {
   } // namespace experimental
 } // namespace std
 
+#endif // _MSC_VER
+
+#if defined(USE_AWAIT) && !defined(_MSC_VER)
+
+// Standard C++20 coroutines, e.g. g++ -std=c++20.
+
+#ifndef __cpp_impl_coroutine
+#error "USE_AWAIT needs C++20 coroutines: build with -std=c++20"
 #endif
 
+#include <coroutine>
+
+namespace dds {
+  namespace rpc {
+    namespace details {
+
+      // Suspends a coroutine until the future is ready and resumes it
+      // on the thread that makes it ready: the reply pump for a future
+      // from send_request_async. A launch::sync continuation runs right
+      // where the value is set, so no thread is launched, and nothing
+      // keeps the future then() returns.
+      //
+      // Still, every co_await that suspends allocates the shared state
+      // of that future and of the continuation. boost::future reports
+      // readiness only through then(): the shared state's
+      // notify_when_ready, which wait_for_any uses, is an internal
+      // interface that only wakes a condition variable. Where that cost
+      // matters, build with USE_LIGHT_FUTURE, whose awaiter is the
+      // continuation itself and allocates nothing.
+      template <class T>
+      class future_awaiter
+      {
+        boost::future<T> future_;
+
+      public:
+
+        explicit future_awaiter(boost::future<T> && future)
+          : future_(std::move(future))
+        { }
+
+        bool await_ready() const
+        {
+          return future_.is_ready();
+        }
+
+        void await_suspend(std::coroutine_handle<> coroutine)
+        {
+          // If the future got ready meanwhile, then() resumes the
+          // coroutine before it returns. The coroutine may have ended by
+          // then, and this awaiter with it.
+          future_awaiter * self = this;
+          boost::future<T> pending(std::move(future_));
+          pending.then(boost::launch::sync,
+                       [self, coroutine](boost::future<T> ready) {
+                         self->future_ = std::move(ready);
+                         coroutine.resume();
+                       });
+        }
+
+        T await_resume()
+        {
+          return future_.get();
+        }
+      };
+
+    } // namespace details
+  } // namespace rpc
+} // namespace dds
+
+namespace boost {
+
+  // Found through ADL, dds::rpc::future being boost::future. Awaiting
+  // a future consumes it, like get().
+  template <typename T>
+  dds::rpc::details::future_awaiter<T> operator co_await(future<T> && t)
+  {
+    return dds::rpc::details::future_awaiter<T>(std::move(t));
+  }
+
+  template <typename T>
+  dds::rpc::details::future_awaiter<T> operator co_await(future<T> & t)
+  {
+    return dds::rpc::details::future_awaiter<T>(std::move(t));
+  }
+
+} // namespace boost
+
+namespace std {
+
+  template <class T, class... Args>
+  struct coroutine_traits<boost::future<T>, Args...>
+  {
+    struct promise_type
+    {
+      boost::promise<T> promise;
+
+      boost::future<T> get_return_object() { return promise.get_future(); }
+      std::suspend_never initial_suspend() noexcept { return {}; }
+      std::suspend_never final_suspend() noexcept { return {}; }
+
+      // boost::promise takes a std::exception_ptr for the exception
+      // itself. boost::current_exception captures what was thrown.
+      void unhandled_exception() {
+        promise.set_exception(boost::current_exception());
+      }
+      void return_value(const T & t) {
+        promise.set_value(t);
+      }
+      void return_value(T && t) {
+        promise.set_value(std::move(t));
+      }
+    };
+  };
+
+  template <class... Args>
+  struct coroutine_traits<boost::future<void>, Args...>
+  {
+    struct promise_type
+    {
+      boost::promise<void> promise;
+
+      boost::future<void> get_return_object() { return promise.get_future(); }
+      std::suspend_never initial_suspend() noexcept { return {}; }
+      std::suspend_never final_suspend() noexcept { return {}; }
+
+      void unhandled_exception() {
+        promise.set_exception(boost::current_exception());
+      }
+      void return_void() {
+        promise.set_value();
+      }
+    };
+  };
+
+} // namespace std
+
+#endif // USE_AWAIT && !_MSC_VER
+
+#endif // USE_BOOST_FUTURE
+
 #ifdef USE_PPLTASKS
 
 #include <ppltasks.h>
@@ -112,6 +255,34 @@ namespace std {
 
 #endif // USE_PPLTASKS
 
+#ifdef USE_LIGHT_FUTURE
+
+#include <atomic>
+#include <exception>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+#include "boost/optional.hpp"
+#include "boost/thread/condition_variable.hpp"
+#include "boost/thread/lock_guard.hpp"
+#include "boost/thread/locks.hpp"
+#include "boost/thread/mutex.hpp"
+
+#include "slab.h"
+
+#ifdef USE_AWAIT
+
+#ifndef __cpp_impl_coroutine
+#error "USE_AWAIT needs C++20 coroutines: build with -std=c++20"
+#endif
+
+#include <coroutine>
+
+#endif // USE_AWAIT
+
+#endif // USE_LIGHT_FUTURE
+
 namespace dds {
     namespace rpc {
 
@@ -125,9 +296,9 @@ namespace dds {
           template <class T>
           boost::future<std::decay_t<T>> make_ready_future(T&& t)
           {
-            typename std::experimental::coroutine_traits<future<std::decay_t<T>>>::promise_type promise;
-            future<std::decay_t<T>> fut = promise.get_return_object();
-            promise.return_value(std::forward<T>(t));
+            boost::promise<std::decay_t<T>> promise;
+            future<std::decay_t<T>> fut = promise.get_future();
+            promise.set_value(std::forward<T>(t));
             return fut;
           }
 
@@ -421,6 +592,36 @@ namespace rpc {
 
         using boost::promise;
 
+        // What promise::set_exception takes. boost::promise would store
+        // a std::exception_ptr as the exception itself.
+        typedef boost::exception_ptr exception_ptr;
+
+        inline exception_ptr current_exception()
+        {
+          return boost::current_exception();
+        }
+
+        template <class E>
+        exception_ptr to_exception_ptr(const E & e)
+        {
+          return boost::copy_exception(e);
+        }
+
+#else
+
+        typedef std::exception_ptr exception_ptr;
+
+        inline exception_ptr current_exception()
+        {
+          return std::current_exception();
+        }
+
+        template <class E>
+        exception_ptr to_exception_ptr(const E & e)
+        {
+          return std::make_exception_ptr(e);
+        }
+
 #endif
 
 #ifdef USE_PPLTASKS
@@ -527,3 +728,854 @@ namespace rpc {
     } // namespace details
   } // namespace rpc
 } // namespace dds
+
+#ifdef USE_LIGHT_FUTURE
+
+namespace dds {
+  namespace rpc {
+
+    template <class T>
+    class future;
+
+    namespace details {
+
+      template <class T>
+      class promise;
+
+      struct light_access;
+
+      struct light_ready_tag { };
+
+      // What a state holds for T. A future<void> still needs a value to
+      // be ready with.
+      template <class T>
+      struct light_value
+      {
+        typedef T type;
+
+        static T out(type && value)
+        {
+          return std::move(value);
+        }
+      };
+
+      template <>
+      struct light_value<void>
+      {
+        struct type { };
+
+        static void out(type &&)
+        { }
+      };
+
+      // Runs once, when the state it waits on is ready.
+      class light_continuation
+      {
+      public:
+        virtual void run() = 0;
+
+      protected:
+        ~light_continuation()
+        { }
+      };
+
+      // The state a light future shares with whatever completes it: a
+      // promise or a continuation. Unlike boost's it has no mutex and no
+      // condition variable, and it lives in a slab block.
+      //
+      // It is single-shot, with a single consumer. One producer sets the
+      // result once. One consumer either takes the result or arms one
+      // continuation. Each holds a reference, and the last to let go
+      // frees the state.
+      //
+      // status_ is all the synchronization there is. The producer stores
+      // the result, then swaps in READY. The consumer stores its
+      // continuation, then swaps PENDING for ARMED. Whichever comes
+      // second runs the continuation. Only a consumer that blocks pays
+      // for a mutex, on its own stack (see wait()).
+      template <class T>
+      class light_state : public slab_allocated
+      {
+      public:
+        typedef typename light_value<T>::type stored_type;
+
+      private:
+        enum { PENDING, ARMED, READY };
+
+        std::atomic<int> refs_;
+        std::atomic<int> status_;
+        light_continuation * continuation_;
+        boost::optional<stored_type> value_;
+        std::exception_ptr exception_;
+
+        light_state(const light_state &);
+        light_state & operator = (const light_state &);
+
+        void complete()
+        {
+          if (status_.exchange(READY, std::memory_order_acq_rel) == ARMED)
+            continuation_->run();
+        }
+
+      public:
+
+        // Referenced by its producer and its consumer.
+        light_state()
+          : refs_(2),
+            status_(PENDING),
+            continuation_(0)
+        { }
+
+        virtual ~light_state()
+        { }
+
+        void add_ref()
+        {
+          refs_.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        void release()
+        {
+          if (refs_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            delete this;
+        }
+
+        void set_value(stored_type && value)
+        {
+          value_ = std::move(value);
+          complete();
+        }
+
+        void set_exception(std::exception_ptr exception)
+        {
+          exception_ = exception;
+          complete();
+        }
+
+        bool is_ready() const
+        {
+          return status_.load(std::memory_order_acquire) == READY;
+        }
+
+        // False if the state is ready already. continuation then never
+        // runs: the caller goes on with the result itself.
+        bool arm(light_continuation & continuation)
+        {
+          continuation_ = &continuation;
+          int pending = PENDING;
+          return status_.compare_exchange_strong(pending, ARMED,
+                                                 std::memory_order_acq_rel,
+                                                 std::memory_order_acquire);
+        }
+
+        void wait();
+
+        // Once ready: moves the value into value, or returns the
+        // exception.
+        std::exception_ptr take(boost::optional<stored_type> & value)
+        {
+          if (exception_)
+            return exception_;
+
+          value = std::move(value_);
+          return std::exception_ptr();
+        }
+
+        // Once ready: completes target with the same result.
+        void forward_to(light_state & target)
+        {
+          if (exception_)
+            target.set_exception(exception_);
+          else
+            target.set_value(std::move(*value_));
+        }
+      };
+
+      // A consumer blocked in wait().
+      class light_waiter : public light_continuation
+      {
+        boost::mutex mutex_;
+        boost::condition_variable ready_cond_;
+        bool ready_;
+
+      public:
+
+        light_waiter()
+          : ready_(false)
+        { }
+
+        // Notifies under the lock: the waiter may return, and go out of
+        // scope, as soon as the lock is released.
+        void run() override
+        {
+          boost::lock_guard<boost::mutex> guard(mutex_);
+          ready_ = true;
+          ready_cond_.notify_one();
+        }
+
+        void wait()
+        {
+          boost::unique_lock<boost::mutex> lock(mutex_);
+          while (!ready_)
+            ready_cond_.wait(lock);
+        }
+      };
+
+      template <class T>
+      void light_state<T>::wait()
+      {
+        if (is_ready())
+          return;
+
+        light_waiter waiter;
+        if (arm(waiter))
+          waiter.wait();
+      }
+
+      // What get() throws when the promise went away unsatisfied.
+      inline std::exception_ptr light_broken_promise()
+      {
+        return std::make_exception_ptr(std::runtime_error("broken promise"));
+      }
+
+      // A continuation that returns future<U> makes then() return
+      // future<U>, not future<future<U>>, as with PPL.
+      template <class R>
+      struct light_unwrap
+      {
+        typedef R value_type;
+      };
+
+      template <class U>
+      struct light_unwrap<future<U>>
+      {
+        typedef U value_type;
+      };
+
+      template <class T, class F>
+      struct light_then
+      {
+        typedef typename std::decay<
+          decltype(std::declval<F &>()(std::declval<future<T>>()))>::type result_type;
+
+        typedef future<typename light_unwrap<result_type>::value_type> future_type;
+      };
+
+    } // namespace details
+
+    // Non-normative: the future of the light backend. Single-shot, with
+    // a single consumer: call get(), or then(), once. A continuation
+    // runs on the thread that completes the future, or right away if it
+    // is ready already; use dds::rpc::then (see executor.h) to run it
+    // elsewhere.
+    template <class T>
+    class future
+    {
+      typedef typename details::light_value<T>::type stored_type;
+
+      details::light_state<T> * state_;
+      // Set by make_ready_future, which needs no state at all.
+      boost::optional<stored_type> ready_;
+
+      friend struct details::light_access;
+
+    public:
+
+      future()
+        : state_(0)
+      { }
+
+      // Adopts a reference to state.
+      explicit future(details::light_state<T> * state)
+        : state_(state)
+      { }
+
+      future(details::light_ready_tag, stored_type value)
+        : state_(0),
+          ready_(std::move(value))
+      { }
+
+      future(future && other)
+        : state_(other.state_),
+          ready_(std::move(other.ready_))
+      {
+        other.state_ = 0;
+        other.ready_ = boost::none;
+      }
+
+      future & operator = (future && other)
+      {
+        future moved(std::move(other));
+        swap(moved);
+        return *this;
+      }
+
+      future(const future &) = delete;
+      future & operator = (const future &) = delete;
+
+      ~future()
+      {
+        if (state_)
+          state_->release();
+      }
+
+      void swap(future & other)
+      {
+        using std::swap;
+        swap(state_, other.state_);
+        swap(ready_, other.ready_);
+      }
+
+      bool valid() const
+      {
+        return state_ || ready_;
+      }
+
+      bool is_ready() const
+      {
+        return ready_ || (state_ && state_->is_ready());
+      }
+
+      void wait() const
+      {
+        if (state_)
+          state_->wait();
+      }
+
+      T get();
+
+      template <class F>
+      typename details::light_then<T, F>::future_type then(F && func);
+    };
+
+    namespace details {
+
+      struct light_access
+      {
+        template <class T>
+        static light_state<T> * state(const future<T> & fut)
+        {
+          return fut.state_;
+        }
+
+        // The caller takes over the future's reference.
+        template <class T>
+        static light_state<T> * release(future<T> & fut)
+        {
+          light_state<T> * state = fut.state_;
+          fut.state_ = 0;
+          return state;
+        }
+
+        template <class T>
+        static boost::optional<typename light_value<T>::type> & ready(future<T> & fut)
+        {
+          return fut.ready_;
+        }
+      };
+
+      template <class T>
+      future<T> light_exceptional(std::exception_ptr exception)
+      {
+        light_state<T> * state = new light_state<T>();
+        state->set_exception(exception);
+        state->release();
+        return future<T>(state);
+      }
+
+      // Completes target with the result of the future a continuation
+      // returned, once that is ready.
+      template <class U>
+      class light_forward final : public slab_allocated, public light_continuation
+      {
+        light_state<U> * target_;
+        light_state<U> * source_;
+
+        light_forward(light_state<U> * target, light_state<U> * source)
+          : target_(target),
+            source_(source)
+        { }
+
+      public:
+
+        static void start(light_state<U> & target, future<U> && source)
+        {
+          boost::optional<typename light_value<U>::type> & ready =
+            light_access::ready(source);
+          if (ready)
+          {
+            target.set_value(std::move(*ready));
+            return;
+          }
+
+          light_state<U> * state = light_access::release(source);
+          if (!state)
+          {
+            target.set_exception(
+              std::make_exception_ptr(std::logic_error("future has no state")));
+            return;
+          }
+
+          target.add_ref();
+          light_forward * forward = new light_forward(&target, state);
+          if (!state->arm(*forward))
+            forward->run();
+        }
+
+        void run() override
+        {
+          source_->forward_to(*target_);
+          source_->release();
+          target_->release();
+          delete this;
+        }
+      };
+
+      // Calls a continuation and delivers what it returns, or throws:
+      // now() as a future, into() by completing a state.
+      template <class R>
+      struct light_invoke
+      {
+        template <class F, class A>
+        static future<R> now(F & func, A && arg)
+        {
+          try {
+            return future<R>(light_ready_tag(), func(std::forward<A>(arg)));
+          }
+          catch (...) {
+            return light_exceptional<R>(std::current_exception());
+          }
+        }
+
+        template <class F, class A>
+        static void into(light_state<R> & state, F & func, A && arg)
+        {
+          boost::optional<R> result;
+          try {
+            result = func(std::forward<A>(arg));
+          }
+          catch (...) {
+            state.set_exception(std::current_exception());
+            return;
+          }
+          state.set_value(std::move(*result));
+        }
+      };
+
+      template <>
+      struct light_invoke<void>
+      {
+        template <class F, class A>
+        static future<void> now(F & func, A && arg)
+        {
+          try {
+            func(std::forward<A>(arg));
+            return future<void>(light_ready_tag(), light_value<void>::type());
+          }
+          catch (...) {
+            return light_exceptional<void>(std::current_exception());
+          }
+        }
+
+        template <class F, class A>
+        static void into(light_state<void> & state, F & func, A && arg)
+        {
+          try {
+            func(std::forward<A>(arg));
+          }
+          catch (...) {
+            state.set_exception(std::current_exception());
+            return;
+          }
+          state.set_value(light_value<void>::type());
+        }
+      };
+
+      template <class U>
+      struct light_invoke<future<U>>
+      {
+        template <class F, class A>
+        static future<U> now(F & func, A && arg)
+        {
+          try {
+            return func(std::forward<A>(arg));
+          }
+          catch (...) {
+            return light_exceptional<U>(std::current_exception());
+          }
+        }
+
+        template <class F, class A>
+        static void into(light_state<U> & state, F & func, A && arg)
+        {
+          future<U> inner;
+          try {
+            inner = func(std::forward<A>(arg));
+          }
+          catch (...) {
+            state.set_exception(std::current_exception());
+            return;
+          }
+          light_forward<U>::start(state, std::move(inner));
+        }
+      };
+
+      // The state of the future then() returns, and the continuation of
+      // the one it was called on: one allocation per then().
+      template <class T, class F, class R>
+      class light_then_state
+        : public light_state<typename light_unwrap<R>::value_type>,
+          public light_continuation
+      {
+        light_state<T> * antecedent_;
+        F func_;
+
+      public:
+
+        template <class G>
+        explicit light_then_state(G && func)
+          : antecedent_(0),
+            func_(std::forward<G>(func))
+        { }
+
+        // Takes over the reference to antecedent.
+        void start(light_state<T> * antecedent)
+        {
+          antecedent_ = antecedent;
+          if (!antecedent->arm(*this))
+            run();
+        }
+
+        void run() override
+        {
+          light_invoke<R>::into(*this, func_, future<T>(antecedent_));
+          // The producer's reference.
+          this->release();
+        }
+      };
+
+      // The producer's side of a light_state. The state is made on first
+      // use, so promises that are only swapped around cost nothing.
+      // Dropped before it is satisfied, a promise breaks its future: get()
+      // throws std::runtime_error.
+      template <class T>
+      class light_promise
+      {
+        light_state<T> * state_;
+        bool retrieved_;
+        bool satisfied_;
+
+        light_promise(const light_promise &);
+        light_promise & operator = (const light_promise &);
+
+        light_state<T> & state()
+        {
+          if (!state_)
+            state_ = new light_state<T>();
+          return *state_;
+        }
+
+        void satisfy()
+        {
+          if (satisfied_)
+            throw std::logic_error("promise already satisfied");
+          satisfied_ = true;
+        }
+
+      protected:
+
+        void set_stored(typename light_value<T>::type && value)
+        {
+          satisfy();
+          state().set_value(std::move(value));
+        }
+
+      public:
+
+        light_promise()
+          : state_(0),
+            retrieved_(false),
+            satisfied_(false)
+        { }
+
+        light_promise(light_promise && other)
+          : state_(other.state_),
+            retrieved_(other.retrieved_),
+            satisfied_(other.satisfied_)
+        {
+          other.state_ = 0;
+          other.retrieved_ = false;
+          other.satisfied_ = false;
+        }
+
+        light_promise & operator = (light_promise && other)
+        {
+          light_promise moved(std::move(other));
+          swap(moved);
+          return *this;
+        }
+
+        ~light_promise()
+        {
+          if (!state_)
+            return;
+
+          if (!satisfied_)
+            state_->set_exception(light_broken_promise());
+
+          if (!retrieved_)
+            state_->release();
+          state_->release();
+        }
+
+        void swap(light_promise & other)
+        {
+          std::swap(state_, other.state_);
+          std::swap(retrieved_, other.retrieved_);
+          std::swap(satisfied_, other.satisfied_);
+        }
+
+        future<T> get_future()
+        {
+          if (retrieved_)
+            throw std::logic_error("future already retrieved");
+
+          retrieved_ = true;
+          return future<T>(&state());
+        }
+
+        void set_exception(std::exception_ptr exception)
+        {
+          satisfy();
+          state().set_exception(exception);
+        }
+      };
+
+      template <class T>
+      class promise : public light_promise<T>
+      {
+      public:
+
+        promise()
+        { }
+
+        promise(promise && other)
+          : light_promise<T>(std::move(other))
+        { }
+
+        promise & operator = (promise && other)
+        {
+          light_promise<T>::operator = (std::move(other));
+          return *this;
+        }
+
+        void set_value(const T & value)
+        {
+          this->set_stored(T(value));
+        }
+
+        void set_value(T && value)
+        {
+          this->set_stored(std::move(value));
+        }
+      };
+
+      template <>
+      class promise<void> : public light_promise<void>
+      {
+      public:
+
+        promise()
+        { }
+
+        promise(promise && other)
+          : light_promise<void>(std::move(other))
+        { }
+
+        promise & operator = (promise && other)
+        {
+          light_promise<void>::operator = (std::move(other));
+          return *this;
+        }
+
+        void set_value()
+        {
+          set_stored(light_value<void>::type());
+        }
+      };
+
+      // The value travels in the future: no state, no allocation.
+      template <class T>
+      future<std::decay_t<T>> make_ready_future(T&& t)
+      {
+        return future<std::decay_t<T>>(light_ready_tag(), std::forward<T>(t));
+      }
+
+    } // namespace details
+
+    template <class T>
+    T future<T>::get()
+    {
+      boost::optional<stored_type> value;
+
+      if (state_)
+      {
+        state_->wait();
+        details::light_state<T> * state = state_;
+        state_ = 0;
+
+        std::exception_ptr exception = state->take(value);
+        state->release();
+        if (exception)
+          std::rethrow_exception(exception);
+      }
+      else if (ready_)
+      {
+        value = std::move(ready_);
+        ready_ = boost::none;
+      }
+      else
+        throw std::logic_error("future has no state");
+
+      return details::light_value<T>::out(std::move(*value));
+    }
+
+    template <class T>
+    template <class F>
+    typename details::light_then<T, F>::future_type future<T>::then(F && func)
+    {
+      typedef typename details::light_then<T, F>::result_type R;
+      typedef typename std::decay<F>::type Func;
+
+      if (!valid())
+        throw std::logic_error("future has no state");
+
+      // Made ready: func runs right here, and nothing is allocated
+      // unless it throws.
+      if (!state_)
+      {
+        Func ready_func(std::forward<F>(func));
+        return details::light_invoke<R>::now(ready_func, std::move(*this));
+      }
+
+      details::light_then_state<T, Func, R> * next =
+        new details::light_then_state<T, Func, R>(std::forward<F>(func));
+      typename details::light_then<T, F>::future_type result(next);
+
+      next->start(details::light_access::release(*this));
+      return result;
+    }
+
+#ifdef USE_AWAIT
+
+    namespace details {
+
+      // Suspends a coroutine until the future is ready and resumes it on
+      // the thread that makes it ready. The awaiter, kept in the
+      // coroutine frame, is the continuation: nothing is allocated.
+      template <class T>
+      class light_awaiter : public light_continuation
+      {
+        future<T> future_;
+        std::coroutine_handle<> coroutine_;
+
+      public:
+
+        explicit light_awaiter(future<T> && fut)
+          : future_(std::move(fut))
+        { }
+
+        bool await_ready() const
+        {
+          return !future_.valid() || future_.is_ready();
+        }
+
+        bool await_suspend(std::coroutine_handle<> coroutine)
+        {
+          coroutine_ = coroutine;
+          return light_access::state(future_)->arm(*this);
+        }
+
+        T await_resume()
+        {
+          return future_.get();
+        }
+
+        void run() override
+        {
+          coroutine_.resume();
+        }
+      };
+
+    } // namespace details
+
+    // Awaiting a future consumes it, like get().
+    template <class T>
+    details::light_awaiter<T> operator co_await(future<T> && fut)
+    {
+      return details::light_awaiter<T>(std::move(fut));
+    }
+
+    template <class T>
+    details::light_awaiter<T> operator co_await(future<T> & fut)
+    {
+      return details::light_awaiter<T>(std::move(fut));
+    }
+
+#endif // USE_AWAIT
+
+  } // namespace rpc
+} // namespace dds
+
+#ifdef USE_AWAIT
+
+namespace std {
+
+  template <class T, class... Args>
+  struct coroutine_traits<dds::rpc::future<T>, Args...>
+  {
+    struct promise_type
+    {
+      dds::rpc::details::promise<T> promise;
+
+      dds::rpc::future<T> get_return_object() { return promise.get_future(); }
+      std::suspend_never initial_suspend() noexcept { return {}; }
+      std::suspend_never final_suspend() noexcept { return {}; }
+
+      void unhandled_exception() {
+        promise.set_exception(std::current_exception());
+      }
+      void return_value(const T & t) {
+        promise.set_value(t);
+      }
+      void return_value(T && t) {
+        promise.set_value(std::move(t));
+      }
+    };
+  };
+
+  template <class... Args>
+  struct coroutine_traits<dds::rpc::future<void>, Args...>
+  {
+    struct promise_type
+    {
+      dds::rpc::details::promise<void> promise;
+
+      dds::rpc::future<void> get_return_object() { return promise.get_future(); }
+      std::suspend_never initial_suspend() noexcept { return {}; }
+      std::suspend_never final_suspend() noexcept { return {}; }
+
+      void unhandled_exception() {
+        promise.set_exception(std::current_exception());
+      }
+      void return_void() {
+        promise.set_value();
+      }
+    };
+  };
+
+} // namespace std
+
+#endif // USE_AWAIT
+
+#endif // USE_LIGHT_FUTURE
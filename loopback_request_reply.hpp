@@ -0,0 +1,1342 @@
+#ifndef OMG_DDS_RPC_LOOPBACK_REQUEST_REPLY_HPP
+#define OMG_DDS_RPC_LOOPBACK_REQUEST_REPLY_HPP
+
+// In-process backend for Requester and Replier, selected with
+// USE_LOOPBACK through details::vendor_dependent<>. Requests and replies
+// never leave the process: they go through lock-free queues keyed by
+// service name, with no serialization and no DDS entities. Requesters
+// and Repliers only meet if they live in the same process.
+//
+// A request is copied once, into a pooled sample, when it is sent. The
+// Replier hands that sample out by reference and returns it to the pool
+// once it has been served. A reply is copied once, into the Sample the
+// Requester hands out.
+//
+// Latency and loss can be injected for every hand-over through
+// LoopbackFaults. Both are off by default.
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "boost/bind.hpp"
+#include "boost/chrono.hpp"
+#include "boost/cstdint.hpp"
+#include "boost/enable_shared_from_this.hpp"
+#include "boost/function.hpp"
+#include "boost/lockfree/queue.hpp"
+#include "boost/make_shared.hpp"
+#include "boost/thread.hpp"
+#include "boost/unordered_map.hpp"
+#include "boost/weak_ptr.hpp"
+
+#include "concurrency_limit.h"
+#include "executor.h"
+#include "pending_request_table.h"
+#include "trace.h"
+#include "unique_data.h"
+
+namespace dds {
+namespace rpc {
+namespace details {
+
+typedef boost::chrono::steady_clock loopback_clock;
+
+inline loopback_clock::time_point loopback_deadline(const dds::Duration & timeout)
+{
+  return loopback_clock::now() +
+         boost::chrono::seconds(timeout.sec) +
+         boost::chrono::nanoseconds(timeout.nanosec);
+}
+
+// Process-wide faults applied to every loopback hand-over.
+class LoopbackFaults
+{
+  std::atomic<boost::int64_t> latency_ns_;
+  std::atomic<double> loss_;
+
+  LoopbackFaults()
+    : latency_ns_(0),
+      loss_(0.0)
+  { }
+
+  LoopbackFaults(const LoopbackFaults &);
+  LoopbackFaults & operator = (const LoopbackFaults &);
+
+  static boost::uint64_t next_random()
+  {
+    static std::atomic<boost::uint64_t> seed(0x9e3779b97f4a7c15ULL);
+    static thread_local boost::uint64_t state = seed.fetch_add(0x9e3779b97f4a7c15ULL);
+
+    // xorshift64*
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return state * 0x2545f4914f6cdd1dULL;
+  }
+
+public:
+
+  static LoopbackFaults & instance()
+  {
+    static LoopbackFaults * faults = new LoopbackFaults();
+    return *faults;
+  }
+
+  // One-way delay added to every request and every reply.
+  void latency(const dds::Duration & one_way)
+  {
+    latency_ns_ = static_cast<boost::int64_t>(one_way.sec) * 1000000000 +
+                  one_way.nanosec;
+  }
+
+  boost::chrono::nanoseconds latency() const
+  {
+    return boost::chrono::nanoseconds(latency_ns_.load());
+  }
+
+  // Probability, in [0, 1], that a request or a reply is silently lost.
+  void loss(double probability)
+  {
+    if (probability < 0.0 || probability > 1.0)
+      throw std::invalid_argument("loss probability must be within [0, 1]");
+
+    loss_ = probability;
+  }
+
+  double loss() const
+  {
+    return loss_;
+  }
+
+  bool drop() const
+  {
+    double probability = loss_;
+    return probability > 0.0 &&
+           (next_random() >> 11) * (1.0 / 9007199254740992.0) < probability;
+  }
+};
+
+// Runs delayed hand-overs on one thread, in deadline order. The thread
+// starts with the first delayed hand-over, so it costs nothing unless a
+// latency is injected.
+class LoopbackDelayLine
+{
+  typedef std::multimap<loopback_clock::time_point, boost::function<void()>> Queue;
+
+  boost::mutex mutex_;
+  boost::condition_variable cond_;
+  Queue due_;
+  bool started_;
+
+  LoopbackDelayLine()
+    : started_(false)
+  { }
+
+  LoopbackDelayLine(const LoopbackDelayLine &);
+  LoopbackDelayLine & operator = (const LoopbackDelayLine &);
+
+  void run()
+  {
+    boost::unique_lock<boost::mutex> lock(mutex_);
+    for (;;)
+    {
+      if (due_.empty())
+      {
+        cond_.wait(lock);
+        continue;
+      }
+
+      loopback_clock::time_point next = due_.begin()->first;
+      if (loopback_clock::now() < next)
+      {
+        cond_.wait_until(lock, next);
+        continue;
+      }
+
+      boost::function<void()> job;
+      job.swap(due_.begin()->second);
+      due_.erase(due_.begin());
+
+      lock.unlock();
+      try {
+        job();
+      }
+      catch (std::exception & ex) {
+        printf("LoopbackDelayLine: %s\n", ex.what());
+      }
+      lock.lock();
+    }
+  }
+
+public:
+
+  // Never destroyed. The thread runs until the process exits.
+  static LoopbackDelayLine & instance()
+  {
+    static LoopbackDelayLine * line = new LoopbackDelayLine();
+    return *line;
+  }
+
+  void post(boost::chrono::nanoseconds delay, const boost::function<void()> & job)
+  {
+    {
+      boost::lock_guard<boost::mutex> guard(mutex_);
+      if (!started_)
+      {
+        boost::thread(boost::bind(&LoopbackDelayLine::run, this)).detach();
+        started_ = true;
+      }
+      due_.insert(Queue::value_type(loopback_clock::now() + delay, job));
+    }
+    cond_.notify_one();
+  }
+};
+
+// Multi-producer, multi-consumer queue of trivially copyable values.
+// push and try_pop are lock-free. Consumers that have to block park on
+// a condition variable, which producers only touch when someone waits.
+template <class T>
+class LoopbackQueue
+{
+  enum { INITIAL_CAPACITY = 256 };
+
+  boost::lockfree::queue<T> queue_;
+  std::atomic<long> count_;
+  std::atomic<int> waiters_;
+  boost::mutex mutex_;
+  boost::condition_variable cond_;
+
+  LoopbackQueue(const LoopbackQueue &);
+  LoopbackQueue & operator = (const LoopbackQueue &);
+
+  template <class Ready>
+  bool wait_until(const loopback_clock::time_point & deadline, Ready ready)
+  {
+    if (ready())
+      return true;
+
+    boost::unique_lock<boost::mutex> lock(mutex_);
+    ++waiters_;
+    // Pairs with the fence in push(), so the wakeup isn't lost.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    bool done;
+    while (!(done = ready()))
+    {
+      if (cond_.wait_until(lock, deadline) == boost::cv_status::timeout)
+      {
+        done = ready();
+        break;
+      }
+    }
+
+    --waiters_;
+    return done;
+  }
+
+public:
+
+  LoopbackQueue()
+    : queue_(INITIAL_CAPACITY),
+      count_(0),
+      waiters_(0)
+  { }
+
+  void push(const T & value)
+  {
+    queue_.push(value);
+    ++count_;
+
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (waiters_.load() > 0)
+    {
+      {
+        boost::lock_guard<boost::mutex> guard(mutex_);
+      }
+      cond_.notify_all();
+    }
+  }
+
+  bool try_pop(T & value)
+  {
+    if (!queue_.pop(value))
+      return false;
+
+    --count_;
+    return true;
+  }
+
+  bool pop(T & value, const loopback_clock::time_point & deadline)
+  {
+    return wait_until(deadline, [&]() { return try_pop(value); });
+  }
+
+  // Waits until the queue is not empty, without taking anything.
+  bool wait(const loopback_clock::time_point & deadline)
+  {
+    return wait_until(deadline, [&]() { return count_.load() > 0; });
+  }
+};
+
+// A sample in flight. The data comes from helper::data_pool<T> and goes
+// back to it when the message is deleted.
+template <class T>
+struct LoopbackMessage
+{
+  T * data;
+  dds::SampleInfo info;
+
+  explicit LoopbackMessage(const T & sample)
+    : data(helper::data_pool<T>::instance().acquire())
+  {
+    if (!data)
+      throw std::runtime_error("Can't create data");
+
+    T::TypeSupport::copy_data(data, &sample);
+    memset(&info, 0, sizeof(info));
+    info.valid_data = DDS_BOOLEAN_TRUE;
+
+    // Received now, as far as the taker is concerned.
+    boost::int64_t now_ns = boost::chrono::duration_cast<boost::chrono::nanoseconds>(
+      boost::chrono::system_clock::now().time_since_epoch()).count();
+    info.reception_timestamp.sec = static_cast<DDS_Long>(now_ns / 1000000000);
+    info.reception_timestamp.nanosec = static_cast<DDS_UnsignedLong>(now_ns % 1000000000);
+  }
+
+  ~LoopbackMessage()
+  {
+    helper::data_pool<T>::instance().release(data);
+  }
+
+private:
+  LoopbackMessage(const LoopbackMessage &);
+  LoopbackMessage & operator = (const LoopbackMessage &);
+};
+
+// The loopback counterpart of LoanedSamples: messages taken from the
+// request queue, handed out by reference and deleted with the batch.
+template <class T>
+class LoopbackSamples
+{
+  std::vector<LoopbackMessage<T> *> messages_;
+
+  LoopbackSamples(const LoopbackSamples &);
+  LoopbackSamples & operator = (const LoopbackSamples &);
+
+public:
+
+  LoopbackSamples()
+  { }
+
+  LoopbackSamples(LoopbackSamples && other)
+    : messages_(std::move(other.messages_))
+  { }
+
+  LoopbackSamples & operator = (LoopbackSamples && other)
+  {
+    messages_.swap(other.messages_);
+    return *this;
+  }
+
+  ~LoopbackSamples()
+  {
+    for (size_t i = 0; i < messages_.size(); ++i)
+      delete messages_[i];
+  }
+
+  void push_back(LoopbackMessage<T> * message)
+  {
+    messages_.push_back(message);
+  }
+
+  int length() const
+  {
+    return static_cast<int>(messages_.size());
+  }
+
+  SampleRef<T> operator [] (int index) const
+  {
+    return SampleRef<T>(*messages_[index]->data, messages_[index]->info);
+  }
+
+  void swap(LoopbackSamples & other)
+  {
+    messages_.swap(other.messages_);
+  }
+};
+
+// Loopback Requesters get writer GUIDs unique within the process. The
+// last eight bytes carry the number replies are routed by.
+inline dds::GUID_t make_loopback_guid(boost::uint64_t & requester_id)
+{
+  static std::atomic<boost::uint64_t> next_id(1);
+  requester_id = next_id++;
+
+  dds::GUID_t guid;
+  unsigned char * bytes = reinterpret_cast<unsigned char *>(&guid);
+  memset(&guid, 0, sizeof(guid));
+  memcpy(bytes, "LOOPBACK", 8);
+  memcpy(bytes + sizeof(guid) - sizeof(requester_id), &requester_id, sizeof(requester_id));
+  return guid;
+}
+
+template <class GUID>
+boost::uint64_t loopback_requester_id(const GUID & guid)
+{
+  boost::uint64_t requester_id;
+  memcpy(&requester_id,
+         reinterpret_cast<const unsigned char *>(&guid) + sizeof(guid) - sizeof(requester_id),
+         sizeof(requester_id));
+  return requester_id;
+}
+
+// The reply side of one loopback Requester. Replies to
+// send_request_async complete their promise on the thread that sends
+// the reply. Other replies are parked until receive_reply takes them.
+// As in RequesterImpl, what nobody will ask for anymore is swept once a
+// second, on the LoopbackDelayLine thread, while anything is pending.
+template <class TRep>
+class LoopbackReplyChannel
+  : public boost::enable_shared_from_this<LoopbackReplyChannel<TRep>>
+{
+  struct PendingReply
+  {
+    bool async;
+    bool ready;
+    promise<Sample<TRep>> reply_promise;
+    Sample<TRep> reply;
+    // Of an async request, as in RequestHeader; 0: none.
+    boost::uint64_t deadline;
+    // When the reply was parked.
+    loopback_clock::time_point parked;
+
+    PendingReply()
+      : async(false),
+        ready(false),
+        deadline(0)
+    { }
+
+    // As RequesterImpl's: empties the entry without allocating.
+    void reset()
+    {
+      async = false;
+      ready = false;
+      deadline = 0;
+    }
+  };
+
+  enum { EXPIRE_PERIOD_MS = 1000,
+         PARKED_REPLY_SECONDS = 60 };
+
+  // Keyed by the sequence number of the request.
+  PendingRequestTable<PendingReply> pending_;
+  // Keys of the parked replies nobody took yet, in arrival order.
+  std::deque<boost::uint64_t> ready_;
+  boost::mutex ready_mutex_;
+  boost::condition_variable ready_cond_;
+  // Frees the slot of each request answered. Null when unlimited.
+  boost::shared_ptr<ConcurrencyLimiter> limiter_;
+  // Completes async replies. Null: the replier's thread does.
+  Executor * completion_executor_;
+  // Whether a sweep is posted on the LoopbackDelayLine.
+  std::atomic<bool> sweep_posted_;
+
+  // Waits until a parked reply is there. Stops at deadline.
+  bool wait_ready(boost::unique_lock<boost::mutex> & lock,
+                  const loopback_clock::time_point & deadline)
+  {
+    while (ready_.empty())
+    {
+      if (ready_cond_.wait_until(lock, deadline) == boost::cv_status::timeout)
+        return !ready_.empty();
+    }
+    return true;
+  }
+
+  // Posts a sweep unless one is posted already. The sweep holds no
+  // reference: a channel gone by then is not swept.
+  void post_sweep()
+  {
+    if (sweep_posted_.exchange(true))
+      return;
+
+    boost::weak_ptr<LoopbackReplyChannel> channel = this->shared_from_this();
+    LoopbackDelayLine::instance().post(
+      boost::chrono::milliseconds(EXPIRE_PERIOD_MS),
+      [channel]() {
+        if (boost::shared_ptr<LoopbackReplyChannel> alive = channel.lock())
+          alive->sweep();
+      });
+  }
+
+  void sweep()
+  {
+    // Cleared first, so what is expected from now on posts the next one.
+    sweep_posted_ = false;
+
+    if (limiter_)
+      limiter_->expire();
+    expire_pending();
+
+    if (pending_.size() > 0)
+      post_sweep();
+  }
+
+  // Drops what nobody will ask for anymore: async requests whose
+  // deadline passed without a reply, whose futures get an error, and
+  // replies parked for longer than PARKED_REPLY_SECONDS, such as one
+  // that came after its receive_reply gave up or was lost on the way.
+  void expire_pending()
+  {
+    typedef std::pair<boost::uint64_t,
+                      boost::shared_ptr<promise<Sample<TRep>>>> Expired;
+    std::vector<Expired> expired;
+    std::vector<boost::uint64_t> stale_keys;
+    loopback_clock::time_point stale =
+      loopback_clock::now() - boost::chrono::seconds(PARKED_REPLY_SECONDS);
+
+    pending_.erase_if([&](boost::uint64_t key, PendingReply & pending) {
+      if (!pending.async)
+      {
+        if (!pending.ready || pending.parked >= stale)
+          return false;
+
+        stale_keys.push_back(key);
+        return true;
+      }
+
+      if (!deadline_passed(pending.deadline))
+        return false;
+
+      expired.push_back(Expired(key, boost::make_shared<promise<Sample<TRep>>>()));
+      expired.back().second->swap(pending.reply_promise);
+      return true;
+    });
+
+    if (!stale_keys.empty())
+    {
+      std::sort(stale_keys.begin(), stale_keys.end());
+      boost::lock_guard<boost::mutex> guard(ready_mutex_);
+      ready_.erase(
+        std::remove_if(ready_.begin(),
+                       ready_.end(),
+                       [&](boost::uint64_t key) {
+                         return std::binary_search(stale_keys.begin(),
+                                                   stale_keys.end(),
+                                                   key);
+                       }),
+        ready_.end());
+    }
+
+    if (expired.empty())
+      return;
+
+    exception_ptr error = to_exception_ptr(
+      std::runtime_error("No reply before the request deadline."));
+
+    for (size_t i = 0; i < expired.size(); ++i)
+    {
+      set_exception_on(completion_executor_, *expired[i].second, error);
+      if (limiter_)
+        limiter_->release(expired[i].first, ConcurrencyLimiter::OUTCOME_LOST);
+    }
+  }
+
+public:
+
+  LoopbackReplyChannel(const boost::shared_ptr<ConcurrencyLimiter> & limiter,
+                       Executor * completion_executor)
+    : limiter_(limiter),
+      completion_executor_(completion_executor),
+      sweep_posted_(false)
+  { }
+
+  // Must be called before the request is handed over.
+  void expect(boost::uint64_t key,
+              boost::uint64_t deadline,
+              promise<Sample<TRep>> & reply_promise)
+  {
+    pending_.apply(key, [&](PendingReply & pending) {
+      pending.async = true;
+      pending.deadline = deadline;
+      pending.reply_promise.swap(reply_promise);
+      return false;
+    });
+    post_sweep();
+  }
+
+  void deliver(const Sample<TRep> & reply)
+  {
+    boost::uint64_t key =
+      sequence_key(reply.info().related_original_publication_virtual_sequence_number);
+    promise<Sample<TRep>> reply_promise;
+    bool async = false;
+
+    pending_.apply(key, [&](PendingReply & pending) {
+      if (!pending.async)
+      {
+        pending.reply = reply;
+        pending.ready = true;
+        pending.parked = loopback_clock::now();
+        // Under the shard lock, so take() can't take the reply before
+        // its key is listed.
+        boost::lock_guard<boost::mutex> guard(ready_mutex_);
+        ready_.push_back(key);
+        return false;
+      }
+
+      reply_promise.swap(pending.reply_promise);
+      async = true;
+      return true;
+    });
+
+    // Continuations may run right here. Never under the shard lock.
+    if (async)
+    {
+      DDS_RPC_TRACE(REQUEST, REPLY_RECEIVED, reply.data().header.relatedRequestId);
+      set_value_on(completion_executor_, reply_promise, reply);
+      if (limiter_)
+        limiter_->release(key, limiter_outcome(reply.data()));
+    }
+    else
+    {
+      pending_.notify(key);
+      ready_cond_.notify_all();
+      post_sweep();
+    }
+  }
+
+  bool take(Sample<TRep> & reply,
+            boost::uint64_t key,
+            const loopback_clock::time_point & deadline)
+  {
+    bool taken =
+      pending_.wait_take(key,
+                         deadline,
+                         [](PendingReply & pending) { return pending.ready; },
+                         [&](PendingReply & pending) { reply = pending.reply; });
+
+    if (taken)
+    {
+      {
+        boost::lock_guard<boost::mutex> guard(ready_mutex_);
+        std::deque<boost::uint64_t>::iterator it =
+          std::find(ready_.begin(), ready_.end(), key);
+        // take_any may have popped it already, and found it gone.
+        if (it != ready_.end())
+          ready_.erase(it);
+      }
+      DDS_RPC_TRACE(REQUEST, REPLY_RECEIVED, reply.data().header.relatedRequestId);
+    }
+
+    return taken;
+  }
+
+  bool take_any(Sample<TRep> & reply, const loopback_clock::time_point & deadline)
+  {
+    for (;;)
+    {
+      boost::uint64_t key;
+      {
+        boost::unique_lock<boost::mutex> lock(ready_mutex_);
+        if (!wait_ready(lock, deadline))
+          return false;
+
+        key = ready_.front();
+        ready_.pop_front();
+      }
+
+      bool taken = false;
+      pending_.apply(key, [&](PendingReply & pending) {
+        // Already taken by receive_reply for this request.
+        if (!pending.ready)
+          return true;
+
+        reply = pending.reply;
+        taken = true;
+        return true;
+      });
+
+      if (taken)
+      {
+        DDS_RPC_TRACE(REQUEST, REPLY_RECEIVED, reply.data().header.relatedRequestId);
+        return true;
+      }
+    }
+  }
+
+  bool wait(const loopback_clock::time_point & deadline)
+  {
+    boost::unique_lock<boost::mutex> lock(ready_mutex_);
+    return wait_ready(lock, deadline);
+  }
+};
+
+// Everything the Requesters and Repliers of one service name share.
+template <class TReq, class TRep>
+class LoopbackService
+  : public boost::enable_shared_from_this<LoopbackService<TReq, TRep>>
+{
+public:
+  typedef LoopbackMessage<TReq> Request;
+  typedef LoopbackReplyChannel<TRep> ReplyChannel;
+
+private:
+  typedef std::map<std::string, boost::weak_ptr<LoopbackService>> Registry;
+
+  LoopbackQueue<Request *> requests_;
+
+  // Triggered while requests may be waiting, for the Server's WaitSet.
+  DDS::GuardCondition request_condition_;
+  std::atomic<bool> signalled_;
+  boost::mutex condition_mutex_;
+
+  boost::shared_mutex channels_mutex_;
+  boost::unordered_map<boost::uint64_t, boost::weak_ptr<ReplyChannel>> channels_;
+
+  static boost::mutex & registry_mutex()
+  {
+    static boost::mutex * mutex = new boost::mutex();
+    return *mutex;
+  }
+
+  static Registry & registry()
+  {
+    static Registry * services = new Registry();
+    return *services;
+  }
+
+  void enqueue_request(Request * request)
+  {
+    requests_.push(request);
+
+    if (!signalled_)
+    {
+      boost::lock_guard<boost::mutex> guard(condition_mutex_);
+      if (!signalled_)
+      {
+        signalled_ = true;
+        request_condition_.set_trigger_value(DDS_BOOLEAN_TRUE);
+      }
+    }
+  }
+
+  void deliver_reply(const Sample<TRep> & reply)
+  {
+    boost::shared_ptr<ReplyChannel> channel;
+    {
+      boost::shared_lock<boost::shared_mutex> lock(channels_mutex_);
+      typename boost::unordered_map<boost::uint64_t, boost::weak_ptr<ReplyChannel>>::iterator it =
+        channels_.find(loopback_requester_id(
+          reply.info().related_original_publication_virtual_guid));
+
+      if (it != channels_.end())
+        channel = it->second.lock();
+    }
+
+    // Nobody is listening any more, as with a Requester that is gone.
+    if (channel)
+      channel->deliver(reply);
+  }
+
+public:
+
+  LoopbackService()
+    : signalled_(false)
+  { }
+
+  ~LoopbackService()
+  {
+    Request * request;
+    while (requests_.try_pop(request))
+      delete request;
+  }
+
+  static boost::shared_ptr<LoopbackService> find_or_create(const std::string & service_name)
+  {
+    boost::lock_guard<boost::mutex> guard(registry_mutex());
+
+    boost::shared_ptr<LoopbackService> service = registry()[service_name].lock();
+    if (!service)
+    {
+      service = boost::make_shared<LoopbackService>();
+      registry()[service_name] = service;
+    }
+    return service;
+  }
+
+  void add_channel(boost::uint64_t requester_id, boost::shared_ptr<ReplyChannel> channel)
+  {
+    boost::unique_lock<boost::shared_mutex> lock(channels_mutex_);
+    channels_[requester_id] = channel;
+  }
+
+  void remove_channel(boost::uint64_t requester_id)
+  {
+    boost::unique_lock<boost::shared_mutex> lock(channels_mutex_);
+    channels_.erase(requester_id);
+  }
+
+  // Takes ownership of request.
+  void send_request(Request * request)
+  {
+    LoopbackFaults & faults = LoopbackFaults::instance();
+    if (faults.drop())
+    {
+      delete request;
+      return;
+    }
+
+    boost::chrono::nanoseconds delay = faults.latency();
+    if (delay.count() > 0)
+      LoopbackDelayLine::instance().post(
+        delay,
+        boost::bind(&LoopbackService::enqueue_request, this->shared_from_this(), request));
+    else
+      enqueue_request(request);
+  }
+
+  void send_reply(const Sample<TRep> & reply)
+  {
+    LoopbackFaults & faults = LoopbackFaults::instance();
+    if (faults.drop())
+      return;
+
+    boost::chrono::nanoseconds delay = faults.latency();
+    if (delay.count() > 0)
+      LoopbackDelayLine::instance().post(
+        delay,
+        boost::bind(&LoopbackService::deliver_reply, this->shared_from_this(), reply));
+    else
+      deliver_reply(reply);
+  }
+
+  bool pop_request(Request *& request, const loopback_clock::time_point & deadline)
+  {
+    return requests_.pop(request, deadline);
+  }
+
+  // Appends up to max_count requests without blocking. The condition is
+  // reset first, so a request that arrives meanwhile triggers it again.
+  void take_requests(int max_count, LoopbackSamples<TReq> & samples)
+  {
+    {
+      boost::lock_guard<boost::mutex> guard(condition_mutex_);
+      signalled_ = false;
+      request_condition_.set_trigger_value(DDS_BOOLEAN_FALSE);
+    }
+
+    Request * request;
+    for (int i = 0; max_count == DDS_LENGTH_UNLIMITED || i < max_count; ++i)
+    {
+      if (!requests_.try_pop(request))
+        return;
+
+      samples.push_back(request);
+    }
+
+    // Stopped at max_count. Whatever is left must trigger it again.
+    boost::lock_guard<boost::mutex> guard(condition_mutex_);
+    signalled_ = true;
+    request_condition_.set_trigger_value(DDS_BOOLEAN_TRUE);
+  }
+
+  DDS::Condition * request_condition()
+  {
+    return &request_condition_;
+  }
+};
+
+template <class TReq, class TRep>
+class LoopbackRequesterImpl : public details::ServiceProxyImpl
+{
+  typedef LoopbackService<TReq, TRep> Service;
+  typedef LoopbackReplyChannel<TRep> ReplyChannel;
+
+  // A request over the concurrency limit, handed over once a slot
+  // frees up.
+  struct QueuedRequest
+  {
+    typename Service::Request * request;
+    promise<Sample<TRep>> reply_promise;
+
+    QueuedRequest()
+      : request(0)
+    { }
+
+    ~QueuedRequest()
+    {
+      delete request;
+    }
+  };
+
+  std::string service_name_;
+  std::string instance_name_;
+  boost::uint64_t requester_id_;
+  dds::GUID_t writer_guid_;
+  std::atomic<boost::uint64_t> sn;
+  bool suppress_invalid;
+  boost::shared_ptr<Service> service_;
+  boost::shared_ptr<ConcurrencyLimiter> limiter_;
+  boost::shared_ptr<ReplyChannel> replies_;
+
+  boost::uint64_t reserve_sequence_numbers(size_t count)
+  {
+    return sn.fetch_add(count) + 1;
+  }
+
+  void prepare_request(TReq & req, boost::uint64_t seqnum)
+  {
+    if (instance_name_.size() > 0)
+      strcpy(req.header.instanceName, instance_name_.c_str());
+
+    req.header.requestId.writer_guid = writer_guid_;
+    req.header.requestId.sequence_number.high = static_cast<DDS_Long>(seqnum >> 32);
+    req.header.requestId.sequence_number.low = static_cast<DDS_UnsignedLong>(seqnum);
+    req.header.oneway = DDS_BOOLEAN_FALSE;
+  }
+
+  // The requestId doubles as the identity of the request sample.
+  typename Service::Request * make_request(const TReq & req)
+  {
+    typename Service::Request * request = new typename Service::Request(req);
+
+    memcpy(&request->info.original_publication_virtual_guid,
+           &writer_guid_,
+           sizeof(writer_guid_));
+    request->info.original_publication_virtual_sequence_number.high =
+      req.header.requestId.sequence_number.high;
+    request->info.original_publication_virtual_sequence_number.low =
+      req.header.requestId.sequence_number.low;
+
+    return request;
+  }
+
+  void hand_over(const TReq & req)
+  {
+    DDS_RPC_TRACE(REQUEST, SEND_REQUEST, req.header.requestId);
+    service_->send_request(make_request(req));
+  }
+
+  // Hands over a request that holds a slot of the concurrency limit.
+  // Static, because queued requests may go out on the service's thread
+  // after the Requester is gone.
+  static void send_with_slot(Service & service,
+                             ReplyChannel & replies,
+                             ConcurrencyLimiter & limiter,
+                             typename Service::Request * request,
+                             promise<Sample<TRep>> & reply_promise)
+  {
+    const RequestHeader & header = request->data->header;
+    boost::uint64_t key = sequence_key(header.requestId.sequence_number);
+
+    limiter.track(key, ConcurrencyLimiter::clock::now(), header.deadline);
+    replies.expect(key, header.deadline, reply_promise);
+
+    DDS_RPC_TRACE(REQUEST, SEND_REQUEST, header.requestId);
+    service.send_request(request);
+  }
+
+  // Hands over the request now if the concurrency limit allows.
+  // Otherwise queues it for the thread that frees a slot.
+  void send_limited(const TReq & req, promise<Sample<TRep>> & reply_promise)
+  {
+    boost::uint64_t key = sequence_key(req.header.requestId.sequence_number);
+
+    if (!limiter_)
+    {
+      replies_->expect(key, req.header.deadline, reply_promise);
+      hand_over(req);
+      return;
+    }
+
+    if (limiter_->try_acquire())
+    {
+      send_with_slot(*service_, *replies_, *limiter_, make_request(req), reply_promise);
+      return;
+    }
+
+    boost::shared_ptr<QueuedRequest> queued = boost::make_shared<QueuedRequest>();
+    queued->request = make_request(req);
+    queued->reply_promise.swap(reply_promise);
+
+    boost::shared_ptr<Service> service = service_;
+    boost::shared_ptr<ReplyChannel> replies = replies_;
+    boost::shared_ptr<ConcurrencyLimiter> limiter = limiter_;
+
+    limiter_->enqueue([service, replies, limiter, queued]() {
+      typename Service::Request * request = queued->request;
+      queued->request = 0;
+      send_with_slot(*service, *replies, *limiter, request, queued->reply_promise);
+    });
+  }
+
+  static void unsupported(const char * operation)
+  {
+    throw std::logic_error(
+      std::string(operation) + ": the loopback backend has no DataReader to loan from");
+  }
+
+public:
+
+  LoopbackRequesterImpl(const dds::rpc::RequesterParams & params)
+    : service_name_(params.service_name()),
+      sn(0),
+      suppress_invalid(true),
+      service_(Service::find_or_create(params.service_name())),
+      limiter_(params.max_outstanding_requests()
+                 ? boost::make_shared<ConcurrencyLimiter>(params.max_outstanding_requests())
+                 : boost::shared_ptr<ConcurrencyLimiter>()),
+      replies_(boost::make_shared<ReplyChannel>(limiter_, params.completion_executor()))
+  {
+    writer_guid_ = make_loopback_guid(requester_id_);
+    service_->add_channel(requester_id_, replies_);
+  }
+
+  ~LoopbackRequesterImpl()
+  {
+    service_->remove_channel(requester_id_);
+  }
+
+  void bind(const std::string & instance_name) override
+  { }
+
+  void unbind() override
+  { }
+
+  bool is_bound() const override
+  {
+    return false;
+  }
+
+  std::string get_bound_instance_name() const override
+  {
+    return "Unknown";
+  }
+
+  std::vector<std::string> get_discovered_service_instances() const override
+  {
+    return std::vector<std::string>();
+  }
+
+  void wait_for_service() override
+  { }
+
+  void wait_for_service(const dds::Duration & maxWait) override
+  { }
+
+  void wait_for_service(std::string instanceName) override
+  { }
+
+  void wait_for_service(const dds::Duration & maxWait,
+                        std::string instanceName) override
+  { }
+
+  void wait_for_services(int count) override
+  { }
+
+  void wait_for_services(const dds::Duration & maxWait, int count) override
+  { }
+
+  void wait_for_services(const std::vector<std::string> & instanceNames) override
+  { }
+
+  void wait_for_services(const dds::Duration & maxWait,
+                         const std::vector<std::string> & instanceNames) override
+  { }
+
+  future<void> wait_for_service_async() override
+  {
+    return future<void>();
+  }
+
+  future<void> wait_for_service_async(std::string instanceName) override
+  {
+    return future<void>();
+  }
+
+  future<void> wait_for_services_async(int count) override
+  {
+    return future<void>();
+  }
+
+  future<void> wait_for_services_async(
+    const std::vector<std::string> & instanceNames) override
+  {
+    return future<void>();
+  }
+
+  void close() override
+  { }
+
+  void send_request(WriteSampleRef<TReq> & wsref)
+  {
+    send_request(wsref.data());
+  }
+
+  bool receive_nondata_samples(bool enable)
+  {
+    bool old = suppress_invalid;
+    suppress_invalid = enable;
+    return old;
+  }
+
+  void send_request(TReq & req)
+  {
+    prepare_request(req, reserve_sequence_numbers(1));
+    hand_over(req);
+  }
+
+  void resend_request(TReq & req)
+  {
+    hand_over(req);
+  }
+
+  void send_request_oneway(TReq & req)
+  {
+    prepare_request(req, reserve_sequence_numbers(1));
+    req.header.oneway = DDS_BOOLEAN_TRUE;
+    service_->send_request(make_request(req));
+  }
+
+  void send_requests(span<TReq> requests)
+  {
+    boost::uint64_t seqnum = reserve_sequence_numbers(requests.size());
+
+    for (size_t i = 0; i < requests.size(); ++i)
+    {
+      prepare_request(requests[i], seqnum + i);
+      hand_over(requests[i]);
+    }
+  }
+
+  bool receive_reply(Sample<TRep> & reply, const dds::Duration & timeout)
+  {
+    return replies_->take_any(reply, loopback_deadline(timeout));
+  }
+
+  bool receive_reply(
+    Sample<TRep> & reply,
+    const dds::SampleIdentity & relatedRequestId,
+    const dds::Duration & timeout)
+  {
+    return replies_->take(reply,
+                          sequence_key(relatedRequestId.sequence_number),
+                          loopback_deadline(timeout));
+  }
+
+  bool wait_for_replies(const dds::Duration & max_wait)
+  {
+    return replies_->wait(loopback_deadline(max_wait));
+  }
+
+  LoanedSamples<TRep> receive_replies(const dds::Duration & max_wait)
+  {
+    unsupported("receive_replies");
+    return LoanedSamples<TRep>();
+  }
+
+  LoanedSamples<TRep> receive_replies(int min_count,
+                                      int max_count,
+                                      const dds::Duration & max_wait)
+  {
+    unsupported("receive_replies");
+    return LoanedSamples<TRep>();
+  }
+
+  LoanedSamples<TRep> take_replies(int max_count)
+  {
+    unsupported("take_replies");
+    return LoanedSamples<TRep>();
+  }
+
+  LoanedSamples<TRep> take_replies(int max_count,
+                                   const dds::SampleIdentity & relatedRequestId)
+  {
+    unsupported("take_replies");
+    return LoanedSamples<TRep>();
+  }
+
+  dds::rpc::future<Sample<TRep>> send_request_async(const TReq & req)
+  {
+    promise<Sample<TRep>> p;
+    dds::rpc::future<Sample<TRep>> future = p.get_future();
+    TReq & request = const_cast<TReq &>(req);
+
+    prepare_request(request, reserve_sequence_numbers(1));
+    send_limited(request, p);
+
+    return future;
+  }
+
+  future<void> slot_available_async()
+  {
+    boost::shared_ptr<promise<void>> p = boost::make_shared<promise<void>>();
+    dds::rpc::future<void> available = p->get_future();
+
+    if (limiter_)
+      limiter_->when_available([p]() { p->set_value(); });
+    else
+      p->set_value();
+
+    return available;
+  }
+
+  std::vector<dds::rpc::future<Sample<TRep>>>
+    send_requests_async(span<TReq> requests)
+  {
+    std::vector<dds::rpc::future<Sample<TRep>>> futures;
+    futures.reserve(requests.size());
+
+    boost::uint64_t seqnum = reserve_sequence_numbers(requests.size());
+
+    for (size_t i = 0; i < requests.size(); ++i)
+    {
+      promise<Sample<TRep>> p;
+      futures.push_back(p.get_future());
+
+      prepare_request(requests[i], seqnum + i);
+      send_limited(requests[i], p);
+    }
+
+    return futures;
+  }
+
+  typename dds::dds_type_traits<TReq>::DataWriter get_request_datawriter() const
+  {
+    return 0;
+  }
+
+  typename dds::dds_type_traits<TRep>::DataReader get_reply_datareader() const
+  {
+    return 0;
+  }
+};
+
+template <class TReq, class TRep>
+class LoopbackReplierImpl : public RPCEntityImpl
+{
+  typedef LoopbackService<TReq, TRep> Service;
+
+  std::string service_name_;
+  bool suppress_invalid;
+  boost::shared_ptr<Service> service_;
+
+public:
+
+  LoopbackReplierImpl(const ReplierParams & params)
+    : service_name_(params.service_name()),
+      suppress_invalid(true),
+      service_(Service::find_or_create(params.service_name()))
+  { }
+
+  void send_reply(
+    TRep & reply,
+    const dds::SampleIdentity & identity)
+  {
+    reply.header.relatedRequestId = identity;
+
+    dds::SampleInfo info;
+    memset(&info, 0, sizeof(info));
+    info.valid_data = DDS_BOOLEAN_TRUE;
+    memcpy(&info.related_original_publication_virtual_guid,
+           &identity.writer_guid,
+           sizeof(identity.writer_guid));
+    info.related_original_publication_virtual_sequence_number.high =
+      identity.sequence_number.high;
+    info.related_original_publication_virtual_sequence_number.low =
+      identity.sequence_number.low;
+
+    service_->send_reply(Sample<TRep>(reply, info));
+  }
+
+  // Replies are handed over one at a time. There is nothing to flush.
+  void flush_replies()
+  { }
+
+  bool receive_request(Sample<TReq> & sample, const dds::Duration & timeout)
+  {
+    typename Service::Request * request;
+    if (!service_->pop_request(request, loopback_deadline(timeout)))
+      return false;
+
+    sample = Sample<TReq>(*request->data, request->info);
+    delete request;
+    return true;
+  }
+
+  LoopbackSamples<TReq> receive_requests(const dds::Duration & max_wait)
+  {
+    return receive_requests(1, DDS_LENGTH_UNLIMITED, max_wait);
+  }
+
+  // Waits for min_count requests at most until max_wait, then takes
+  // whatever else is already there, up to max_count.
+  LoopbackSamples<TReq> receive_requests(int min_count,
+                                         int max_count,
+                                         const dds::Duration & max_wait)
+  {
+    loopback_clock::time_point deadline = loopback_deadline(max_wait);
+    LoopbackSamples<TReq> samples;
+
+    typename Service::Request * request;
+    while (samples.length() < min_count &&
+           service_->pop_request(request, deadline))
+      samples.push_back(request);
+
+    if (samples.length() == 0)
+      return samples;
+
+    if (max_count == DDS_LENGTH_UNLIMITED)
+      service_->take_requests(max_count, samples);
+    else if (max_count > samples.length())
+      service_->take_requests(max_count - samples.length(), samples);
+
+    return samples;
+  }
+
+  LoopbackSamples<TReq> take_requests(int max_count)
+  {
+    LoopbackSamples<TReq> samples;
+    service_->take_requests(max_count, samples);
+    return samples;
+  }
+
+  bool receive_nondata_samples(bool enable)
+  {
+    bool old = suppress_invalid;
+    suppress_invalid = enable;
+    return old;
+  }
+
+  DDS::Condition * request_condition()
+  {
+    return service_->request_condition();
+  }
+
+  typename dds::dds_type_traits<TReq>::DataReader get_request_datareader() const
+  {
+    return 0;
+  }
+
+  typename dds::dds_type_traits<TRep>::DataWriter get_reply_datawriter() const
+  {
+    return 0;
+  }
+
+  void close()
+  { }
+};
+
+} // namespace details
+} // namespace rpc
+} // namespace dds
+
+#endif // OMG_DDS_RPC_LOOPBACK_REQUEST_REPLY_HPP
@@ -7,10 +7,12 @@
 #include "normative/request_reply.h" // standard
 
 #include "vendor_dependent.h"
+#include "operation_stats.h"
 
 namespace dds { namespace rpc { 
 
 class Server; 
+class ThreadPoolExecutor;
 enum ServiceStatus { CLOSED, PAUSED, RUNNING };
 
 template <class Iface>
@@ -54,6 +56,27 @@ public:
   ServiceParams & subscriber(dds_entity_traits::Subscriber subscriber);
   ServiceParams & domain_participant(dds_entity_traits::DomainParticipant part);
 
+  /* Non-normative: replies whose payload is at least this many bytes
+     long go through shared memory to clients that can map it, as they
+     say in RequestHeader.payloadHost. 0, the default, sends every
+     payload in the sample. See shared_payload.h. */
+  ServiceParams & shared_payload_threshold(int bytes);
+
+  /* Non-normative: the service keeps its last this many replies for
+     duplicate_reply_lifetime, 30 seconds by default. A request that
+     comes again under the same requestId gets the kept reply, and the
+     operation doesn't run again. 0, the default, keeps none. See
+     Requester::resend_request. */
+  ServiceParams & duplicate_reply_cache_size(int replies);
+  ServiceParams & duplicate_reply_lifetime(const dds::Duration & lifetime);
+
+  /* Non-normative: replies go out in batches of up to this many, held
+     back for at most reply_flush_delay. A batch also goes out once the
+     requests taken with it are served. 1, the default, sends every
+     reply on its own. See ReplierParams::reply_batch_size. */
+  ServiceParams & reply_batch_size(int replies);
+  ServiceParams & reply_flush_delay(const dds::Duration & delay);
+
   std::string service_name() const;
   std::string instance_name() const;
   std::string request_topic_name() const;
@@ -63,6 +86,11 @@ public:
   dds_entity_traits::Publisher publisher() const;
   dds_entity_traits::Subscriber subscriber() const;
   dds_entity_traits::DomainParticipant domain_participant() const;
+  int shared_payload_threshold() const;
+  int duplicate_reply_cache_size() const;
+  dds::Duration duplicate_reply_lifetime() const;
+  int reply_batch_size() const;
+  dds::Duration reply_flush_delay() const;
 
 protected:
   typedef details::vendor_dependent<ServiceParams>::type VendorDependent;
@@ -92,6 +120,36 @@ public:
   ClientParams & subscriber(dds_entity_traits::Subscriber subscriber);
   ClientParams & domain_participant(dds_entity_traits::DomainParticipant part);
 
+  /* Non-normative: how long a call waits for its reply. Requests carry
+     the resulting deadline, and services drop the ones that expire
+     before they are served. Defaults to 20 seconds. An infinite timeout
+     sets no deadline. */
+  ClientParams & call_timeout(const dds::Duration & timeout);
+
+  /* Non-normative: send calls to operations that return nothing and
+     raise nothing as oneway requests. The call returns once the request
+     is written. The service sends no reply, so the client never learns
+     if the request was lost, shed or failed. Defaults to false. */
+  ClientParams & oneway_void_operations(bool enable);
+
+  /* Non-normative: async calls to a read-only operation that find an
+     identical call waiting for its reply share that call's reply
+     instead of sending a request of their own. Defaults to true. */
+  ClientParams & coalesce_reads(bool enable);
+
+  /* Non-normative: how long the reply to a read-only operation may be
+     reused for later calls to it. Replies to every other operation made
+     through this client clear the cache. Changes made through other
+     clients show up once the cached reply expires. Defaults to 0: no
+     reply is reused. */
+  ClientParams & read_cache_staleness(const dds::Duration & max_staleness);
+
+  /* Non-normative: where the continuations of the client's async
+     operations run. See executor.h. The executor must outlive the
+     client. Defaults to none: they run inline, on the thread that
+     completes the reply. */
+  ClientParams & continuation_executor(Executor & executor);
+
   const std::string & service_name() const;
   const std::string & instance_name() const;
   const std::string & request_topic_name() const;
@@ -101,6 +159,11 @@ public:
   dds_entity_traits::Publisher publisher() const;
   dds_entity_traits::Subscriber subscriber() const;
   dds_entity_traits::DomainParticipant domain_participant() const;
+  dds::Duration call_timeout() const;
+  bool oneway_void_operations() const;
+  bool coalesce_reads() const;
+  dds::Duration read_cache_staleness() const;
+  Executor * continuation_executor() const;
 
 protected:
   typedef details::vendor_dependent<ClientParams>::type VendorDependent;
@@ -119,8 +182,35 @@ public:
 
   ServerParams & default_service_params(const ServiceParams & service_params);
 
+  /* Non-normative: number of threads that serve ready requests in
+     Server::run. Defaults to the number of hardware threads. */
+  ServerParams & worker_threads(int count);
+
+  /* Non-normative: admission control in Server::run. See
+     admission_control.h. At most max_queued_requests requests wait for
+     a worker; 0 lifts the limit. Queued requests are shed by how long
+     they waited, against queue_delay_target and queue_delay_interval.
+     An infinite target turns that off. Shed requests get a
+     REMOTE_EX_OUT_OF_RESOURCES reply. Defaults: 4096 requests, 5 ms
+     and 100 ms. */
+  ServerParams & max_queued_requests(int count);
+  ServerParams & queue_delay_target(const dds::Duration & target);
+  ServerParams & queue_delay_interval(const dds::Duration & interval);
+
+  /* Non-normative: the threads Server::run serves requests on. Servers
+     given the same executor share its threads; worker_threads is then
+     not used. The executor must outlive the server. Defaults to none:
+     the server starts worker_threads threads of its own. */
+  ServerParams & executor(ThreadPoolExecutor & executor);
+
   ServiceParams default_service_params() const;
 
+  int worker_threads() const;
+  int max_queued_requests() const;
+  dds::Duration queue_delay_target() const;
+  dds::Duration queue_delay_interval() const;
+  ThreadPoolExecutor * executor() const;
+
 protected:
   typedef details::vendor_dependent<ServerParams>::type VendorDependent;
   VendorDependent impl_;
@@ -154,6 +244,10 @@ public:
   ServiceStatus status() const;
   ServiceParams get_service_params() const;
 
+  /* Non-normative: calls served so far and their latencies, per
+     operation. See operation_stats.h. */
+  std::vector<OperationStats> stats() const;
+
   VendorDependent get_impl() const;
 };
 
@@ -179,6 +273,10 @@ public:
 
   dds::rpc::ClientParams get_client_params();
 
+  /* Non-normative: calls made so far and their latencies, per
+     operation. See operation_stats.h. */
+  std::vector<OperationStats> stats() const;
+
   VendorDependent get_impl() const;
 };
 
@@ -5,11 +5,14 @@
 
 #include "vendor_dependent.h"
 #include "normative/sample.h"   // standard
+#include "span.h"
 
 namespace dds {
 
 namespace rpc {
 
+class Executor;
+
 class RPCEntity 
 {
 public:
@@ -109,14 +112,41 @@ public:
 
     future<dds::Sample<TRep>> send_request_async(const TReq &);
 
+    /* Non-normative: Sends every request and flushes the request
+       DataWriter once at the end. With RequesterParams::request_batch_size
+       above 1 the requests share RTPS messages.
+    */
+    void send_requests(span<TReq> requests);
+
+    std::vector<future<dds::Sample<TRep>>> send_requests_async(span<TReq> requests);
+
+    /* Non-normative: Completes once send_request_async would send right
+       away instead of queueing the request behind the concurrency limit.
+       See RequesterParams::max_outstanding_requests.
+    */
+    future<void> slot_available_async();
+
+    /* Non-normative: send_request_oneway marks the request oneway. The
+       Requester doesn't keep track of it, and the service sends no
+       reply, not even a remote exception.
+
+       resend_request sends a request that went out before once more,
+       keeping its requestId, e.g. to retry after receive_reply timed
+       out. A service with ServiceParams::duplicate_reply_cache_size set
+       answers it with the reply it already made, if any, even once
+       RequestHeader.deadline has passed. Otherwise a passed deadline
+       gets REMOTE_EX_DEADLINE_EXCEEDED: give the retry a new one.
+    */
 #ifdef OMG_DDS_RPC_BASIC_PROFILE
     void send_request(TReq & request);
     void send_request_oneway(TReq &);
+    void resend_request(TReq &);
 #endif 
 
 #ifdef OMG_DDS_RPC_ENHANCED_PROFILE
     void send_request(const TReq & request);
     void send_request_oneway(const TReq &);
+    void resend_request(const TReq &);
 #endif
 
     bool receive_reply(
@@ -127,6 +157,12 @@ public:
       SampleRef<TRep> reply,
       const dds::Duration & timeout);
 
+    /* Non-normative: Waiting for the reply to relatedRequestId is a
+       one-time try. Once receive_reply returns, with the reply or
+       without, the Requester forgets the request: resend_request it to
+       wait again. A request nobody waits for is forgotten after a
+       minute.
+    */
     bool receive_reply(
       Sample<TRep>& reply,
       const dds::SampleIdentity & relatedRequestId,
@@ -258,6 +294,11 @@ class Replier : public RPCEntity
       const dds::SampleIdentity& related_request_id);
 #endif
 
+    /* Non-normative: Sends the replies batched so far without waiting
+       for the batch to fill up. See ReplierParams::reply_batch_size.
+    */
+    void flush_replies();
+
     bool receive_request(
         Sample<TReq> & request,
         const dds::Duration & max_wait);
@@ -377,6 +418,35 @@ public:
     RequesterParams & 	request_topic_name (const std::string &name);
     RequesterParams & 	reply_topic_name (const std::string &name);
 
+    /* Non-normative: Number of threads that take replies from the reply
+       DataReader and complete the futures returned by send_request_async.
+       Defaults to 1.
+    */
+    RequesterParams & 	reply_pump_threads (int count);
+
+    /* Non-normative: Upper bound of the adaptive limit on requests sent
+       with send_request_async that wait for a reply. The limit follows
+       the round trip time. Requests over it are queued by the Requester
+       and sent as replies free up room, or as requests whose reply
+       is overdue give theirs up. 0 lifts the limit. Defaults to 400,
+       the max_send_window_size of the request DataWriter.
+    */
+    RequesterParams & 	max_outstanding_requests (int count);
+
+    /* Non-normative: Where the futures returned by send_request_async
+       are completed, and so where continuations attached with the
+       default policy start. See executor.h. The executor must outlive
+       the Requester. Defaults to none: the reply pump completes them.
+    */
+    RequesterParams & 	completion_executor (Executor & executor);
+
+    /* Non-normative: The request DataWriter batches up to this many
+       requests, so send_requests and send_requests_async put several in
+       one RTPS message. Requests sent one at a time are flushed right
+       away. Defaults to 1: the DataWriter QoS is left as it is.
+    */
+    RequesterParams & 	request_batch_size (int requests);
+
     dds_entity_traits::DomainParticipant domain_participant() const;
     dds_entity_traits::Publisher publisher() const;
     dds_entity_traits::Subscriber subscriber() const;
@@ -387,6 +457,10 @@ public:
     std::string service_name() const;
     std::string request_topic_name() const;
     std::string reply_topic_name() const;
+    int reply_pump_threads() const;
+    int max_outstanding_requests() const;
+    Executor * completion_executor() const;
+    int request_batch_size() const;
 
 private:
     typedef details::vendor_dependent<RequesterParams>::type VendorDependent;
@@ -425,6 +499,16 @@ public:
     ReplierParams & publisher(dds_entity_traits::Publisher publisher);
     ReplierParams & subscriber(dds_entity_traits::Subscriber subscriber);
 
+    /* Non-normative: The reply DataWriter batches up to this many
+       replies. A batch goes out once it is full, when
+       Replier::flush_replies is called, or reply_flush_delay after its
+       first reply, whichever comes first. Defaults to 1: the DataWriter
+       QoS is left as it is and replies aren't held back. The delay
+       defaults to 500 microseconds.
+    */
+    ReplierParams & reply_batch_size(int replies);
+    ReplierParams & reply_flush_delay(const dds::Duration & delay);
+
     dds_entity_traits::DomainParticipant domain_participant() const;
     ListenerBase * simple_replier_listener() const;
     ListenerBase * replier_listener() const;
@@ -436,6 +520,8 @@ public:
     dds_entity_traits::DataReaderQos datareader_qos() const;
     dds_entity_traits::Publisher publisher() const;
     dds_entity_traits::Subscriber subscriber() const;
+    int reply_batch_size() const;
+    dds::Duration reply_flush_delay() const;
 
 private:
   typedef details::vendor_dependent<ReplierParams>::type VendorDependent;
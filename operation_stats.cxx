@@ -0,0 +1,258 @@
+#include <algorithm>
+
+#include "operation_stats.h"
+#include "operation_table.h"
+
+#include "boost/thread/thread.hpp"
+
+#ifdef RTI_LINUX
+#include <sched.h>
+#endif
+
+namespace dds {
+namespace rpc {
+
+  LatencyHistogram::LatencyHistogram()
+    : counts_(BUCKET_COUNT),
+      count_(0),
+      sum_ns_(0),
+      max_ns_(0)
+  { }
+
+  size_t LatencyHistogram::bucket_of(boost::uint64_t ns)
+  {
+    if (ns < SUB_BUCKETS)
+      return static_cast<size_t>(ns);
+
+    int msb = 63;
+    while (!(ns >> msb))
+      --msb;
+
+    int shift = msb - SUB_BUCKET_BITS;
+    if (shift > MAX_SHIFT)
+      return BUCKET_COUNT - 1;
+
+    return static_cast<size_t>((shift + 1) * SUB_BUCKETS +
+                               ((ns >> shift) - SUB_BUCKETS));
+  }
+
+  boost::uint64_t LatencyHistogram::bucket_limit_ns(size_t bucket)
+  {
+    if (bucket < SUB_BUCKETS)
+      return bucket;
+
+    int shift = static_cast<int>(bucket / SUB_BUCKETS) - 1;
+    boost::uint64_t low = static_cast<boost::uint64_t>(SUB_BUCKETS + bucket % SUB_BUCKETS) << shift;
+    return low + (static_cast<boost::uint64_t>(1) << shift) - 1;
+  }
+
+  void LatencyHistogram::add(size_t bucket, boost::uint64_t count)
+  {
+    counts_[bucket] += count;
+    count_ += count;
+  }
+
+  void LatencyHistogram::add_sum(boost::uint64_t sum_ns, boost::uint64_t max_ns)
+  {
+    sum_ns_ += sum_ns;
+    max_ns_ = std::max(max_ns_, max_ns);
+  }
+
+  void LatencyHistogram::merge(const LatencyHistogram & other)
+  {
+    for (size_t b = 0; b < BUCKET_COUNT; ++b)
+      counts_[b] += other.counts_[b];
+
+    count_ += other.count_;
+    add_sum(other.sum_ns_, other.max_ns_);
+  }
+
+  boost::uint64_t LatencyHistogram::count() const
+  {
+    return count_;
+  }
+
+  boost::uint64_t LatencyHistogram::count_in(size_t bucket) const
+  {
+    return counts_[bucket];
+  }
+
+  boost::uint64_t LatencyHistogram::max_ns() const
+  {
+    return max_ns_;
+  }
+
+  double LatencyHistogram::mean_ns() const
+  {
+    return count_ ? static_cast<double>(sum_ns_) / count_ : 0.0;
+  }
+
+  boost::uint64_t LatencyHistogram::percentile_ns(double percent) const
+  {
+    if (count_ == 0)
+      return 0;
+
+    boost::uint64_t rank =
+      static_cast<boost::uint64_t>(percent / 100.0 * count_ + 0.5);
+    rank = std::max<boost::uint64_t>(1, std::min(rank, count_));
+
+    boost::uint64_t seen = 0;
+    for (size_t b = 0; b < BUCKET_COUNT; ++b)
+    {
+      seen += counts_[b];
+      if (seen >= rank)
+        return std::min(bucket_limit_ns(b), max_ns_);
+    }
+    return max_ns_;
+  }
+
+  OperationStats::OperationStats()
+    : operation(0),
+      requests(0),
+      errors(0),
+      timeouts(0),
+      rejected(0)
+  { }
+
+  namespace details {
+
+    namespace {
+
+      // The core the caller runs on, where the platform says. Elsewhere
+      // each thread keeps the slot it was given first.
+      size_t this_core()
+      {
+#ifdef RTI_LINUX
+        int cpu = sched_getcpu();
+        if (cpu >= 0)
+          return static_cast<size_t>(cpu);
+#endif
+        static std::atomic<size_t> next_slot(0);
+        static thread_local size_t slot = next_slot.fetch_add(1);
+        return slot;
+      }
+
+    } // anonymous namespace
+
+    OperationStatsRecorder::Cell::Cell()
+      : requests(0),
+        errors(0),
+        timeouts(0),
+        rejected(0),
+        sum_ns(0),
+        max_ns(0)
+    {
+      for (size_t b = 0; b < LatencyHistogram::BUCKET_COUNT; ++b)
+        buckets[b].store(0, std::memory_order_relaxed);
+    }
+
+    OperationStatsRecorder::OperationStatsRecorder(const char * const * operations,
+                                                   size_t count)
+      : shard_count_(std::max(1u, boost::thread::hardware_concurrency()))
+    {
+      for (size_t i = 0; i < count; ++i)
+      {
+        operations_.push_back(operation_id(operations[i]));
+        names_.push_back(operations[i]);
+      }
+
+      cells_.reset(new Cell[shard_count_ * (count + 1)]);
+    }
+
+    size_t OperationStatsRecorder::index_of(boost::int32_t operation) const
+    {
+      // A handful of operations: a scan beats hashing.
+      size_t i = 0;
+      while (i < operations_.size() && operations_[i] != operation)
+        ++i;
+      return i;
+    }
+
+    OperationStatsRecorder::Cell &
+      OperationStatsRecorder::cell(boost::int32_t operation)
+    {
+      size_t shard = this_core() % shard_count_;
+      return cells_[shard * (operations_.size() + 1) + index_of(operation)];
+    }
+
+    void OperationStatsRecorder::record(boost::int32_t operation,
+                                        clock::time_point start,
+                                        Outcome outcome)
+    {
+      Cell & c = cell(operation);
+
+      c.requests.fetch_add(1, std::memory_order_relaxed);
+
+      if (outcome == OUTCOME_TIMEOUT)
+      {
+        c.timeouts.fetch_add(1, std::memory_order_relaxed);
+        return;
+      }
+
+      if (outcome == OUTCOME_REJECTED)
+      {
+        c.rejected.fetch_add(1, std::memory_order_relaxed);
+        return;
+      }
+
+      if (outcome == OUTCOME_ERROR)
+        c.errors.fetch_add(1, std::memory_order_relaxed);
+
+      boost::uint64_t ns =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - start).count();
+
+      c.buckets[LatencyHistogram::bucket_of(ns)].fetch_add(1, std::memory_order_relaxed);
+      c.sum_ns.fetch_add(ns, std::memory_order_relaxed);
+
+      // Threads sharing a core only race here when preempted mid-update.
+      boost::uint64_t max = c.max_ns.load(std::memory_order_relaxed);
+      while (ns > max &&
+             !c.max_ns.compare_exchange_weak(max, ns, std::memory_order_relaxed))
+      { }
+    }
+
+    std::vector<OperationStats> OperationStatsRecorder::snapshot() const
+    {
+      size_t row = operations_.size() + 1;
+      std::vector<OperationStats> stats(row);
+
+      for (size_t op = 0; op < row; ++op)
+      {
+        OperationStats & s = stats[op];
+        if (op < operations_.size())
+        {
+          s.operation = operations_[op];
+          s.name = names_[op];
+        }
+        else
+          s.name = "unknown";
+
+        for (size_t shard = 0; shard < shard_count_; ++shard)
+        {
+          const Cell & c = cells_[shard * row + op];
+
+          s.requests += c.requests.load(std::memory_order_relaxed);
+          s.errors += c.errors.load(std::memory_order_relaxed);
+          s.timeouts += c.timeouts.load(std::memory_order_relaxed);
+          s.rejected += c.rejected.load(std::memory_order_relaxed);
+
+          for (size_t b = 0; b < LatencyHistogram::BUCKET_COUNT; ++b)
+          {
+            boost::uint64_t n = c.buckets[b].load(std::memory_order_relaxed);
+            if (n)
+              s.latency.add(b, n);
+          }
+          s.latency.add_sum(c.sum_ns.load(std::memory_order_relaxed),
+                            c.max_ns.load(std::memory_order_relaxed));
+        }
+      }
+
+      if (stats.back().requests == 0)
+        stats.pop_back();
+
+      return stats;
+    }
+
+  } // namespace details
+} // namespace rpc
+} // namespace dds
@@ -0,0 +1,143 @@
+#ifndef OMG_DDS_RPC_OPERATION_STATS_H
+#define OMG_DDS_RPC_OPERATION_STATS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "boost/cstdint.hpp"
+#include "boost/scoped_array.hpp"
+
+/* Non-normative: per-operation call counts and latencies, kept by the
+   Dispatcher of a service and by the ClientImpl of a client. Read them
+   with ServiceEndpoint::stats() and ClientEndpoint::stats().
+
+   A service measures from the moment it starts serving a request until
+   the reply is written. A client measures from sending the request
+   until the reply arrives, or until a oneway request is written. Calls
+   answered from the client's read cache count as well. */
+
+namespace dds {
+  namespace rpc {
+
+    // Latencies in log-linear buckets, as in HdrHistogram: every power of
+    // two is split into SUB_BUCKETS equal buckets, so a value is known to
+    // within 1/SUB_BUCKETS of itself. Covers up to 2^(MAX_SHIFT + 5) ns,
+    // about 68 seconds. Longer latencies count in the last bucket.
+    class LatencyHistogram
+    {
+    public:
+      enum { SUB_BUCKET_BITS = 4,
+             SUB_BUCKETS = 1 << SUB_BUCKET_BITS,
+             MAX_SHIFT = 31,
+             BUCKET_COUNT = (MAX_SHIFT + 2) * SUB_BUCKETS };
+
+    private:
+      std::vector<boost::uint64_t> counts_;
+      boost::uint64_t count_;
+      boost::uint64_t sum_ns_;
+      boost::uint64_t max_ns_;
+
+    public:
+      LatencyHistogram();
+
+      static size_t bucket_of(boost::uint64_t ns);
+      // The largest latency that falls in bucket.
+      static boost::uint64_t bucket_limit_ns(size_t bucket);
+
+      void add(size_t bucket, boost::uint64_t count);
+      void add_sum(boost::uint64_t sum_ns, boost::uint64_t max_ns);
+      void merge(const LatencyHistogram & other);
+
+      boost::uint64_t count() const;
+      boost::uint64_t count_in(size_t bucket) const;
+      boost::uint64_t max_ns() const;
+      double mean_ns() const;
+
+      // Latency that percent of the calls did not exceed, e.g. 99.9.
+      // Rounded up to the limit of its bucket. 0 if there are no calls.
+      boost::uint64_t percentile_ns(double percent) const;
+    };
+
+    struct OperationStats
+    {
+      boost::int32_t operation;     // operation_id(name); 0 for unknown ids
+      std::string name;
+      boost::uint64_t requests;     // calls completed, timeouts included
+      boost::uint64_t errors;       // calls that ended in an exception
+      boost::uint64_t timeouts;     // calls that got no reply in time
+      boost::uint64_t rejected;     // calls shed by an overloaded service
+      LatencyHistogram latency;     // every call but timeouts and rejects
+
+      OperationStats();
+    };
+
+    namespace details {
+
+      // Records calls into per-core shards, so threads on different cores
+      // never write the same cache line. snapshot() adds the shards up; it
+      // may miss calls recorded while it runs, never corrupts them.
+      class OperationStatsRecorder
+      {
+      public:
+        enum Outcome { OUTCOME_OK, OUTCOME_ERROR, OUTCOME_TIMEOUT, OUTCOME_REJECTED };
+
+        typedef std::chrono::steady_clock clock;
+
+      private:
+        enum { CACHE_LINE = 64 };
+
+        struct Cell
+        {
+          std::atomic<boost::uint64_t> requests;
+          std::atomic<boost::uint64_t> errors;
+          std::atomic<boost::uint64_t> timeouts;
+          std::atomic<boost::uint64_t> rejected;
+          std::atomic<boost::uint64_t> sum_ns;
+          std::atomic<boost::uint64_t> max_ns;
+          std::atomic<boost::uint64_t> buckets[LatencyHistogram::BUCKET_COUNT];
+          char pad_[CACHE_LINE];
+
+          Cell();
+        };
+
+        std::vector<boost::int32_t> operations_;
+        std::vector<std::string> names_;
+        size_t shard_count_;
+        // shard_count_ rows of operations_.size() + 1 cells. The last
+        // cell of a row counts operations not in operations_.
+        boost::scoped_array<Cell> cells_;
+
+        OperationStatsRecorder(const OperationStatsRecorder &);
+        OperationStatsRecorder & operator = (const OperationStatsRecorder &);
+
+        size_t index_of(boost::int32_t operation) const;
+        Cell & cell(boost::int32_t operation);
+
+      public:
+
+        // One entry per operation of the interface, by name.
+        OperationStatsRecorder(const char * const * operations, size_t count);
+
+        template <size_t N>
+        explicit OperationStatsRecorder(const char * const (&operations)[N])
+          : OperationStatsRecorder(operations, N)
+        { }
+
+        // Records a call to operation that began at start.
+        void record(boost::int32_t operation,
+                    clock::time_point start,
+                    Outcome outcome);
+
+        // One entry per operation, in construction order, plus one with
+        // operation 0 if unknown operations were called.
+        std::vector<OperationStats> snapshot() const;
+      };
+
+    } // namespace details
+  } // namespace rpc
+} // namespace dds
+
+#endif // OMG_DDS_RPC_OPERATION_STATS_H
@@ -0,0 +1,108 @@
+#ifndef OMG_DDS_RPC_OPERATION_TABLE_H
+#define OMG_DDS_RPC_OPERATION_TABLE_H
+
+#include <cstddef>
+#include <stdexcept>
+#include <vector>
+
+#include "boost/cstdint.hpp"
+
+namespace dds {
+  namespace rpc {
+
+    namespace details {
+
+      constexpr boost::uint32_t fnv1a(const char * str, boost::uint32_t hash)
+      {
+        return *str
+          ? fnv1a(str + 1,
+                  (hash ^ static_cast<unsigned char>(*str)) * 16777619u)
+          : hash;
+      }
+
+    } // namespace details
+
+    // Discriminator of an operation in the Call and Return unions: the
+    // 32-bit FNV-1a hash of the operation name, folded to a positive
+    // value so it fits an IDL long. The constants in the IDL are checked
+    // against it with static_assert.
+    constexpr boost::int32_t operation_id(const char * operation_name)
+    {
+      return static_cast<boost::int32_t>(
+        details::fnv1a(operation_name, 2166136261u) & 0x7fffffffu);
+    }
+
+    namespace details {
+
+      // Maps operation ids to handlers with one open addressing lookup,
+      // whatever the number of operations. The table is at most half
+      // full, so a lookup touches a single slot in the common case.
+      template <class Handler>
+      class OperationTable
+      {
+      public:
+        struct Entry
+        {
+          boost::int32_t id;
+          Handler handler;
+        };
+
+      private:
+        std::vector<Entry> slots_;
+        size_t mask_;
+
+        static size_t slot_of(boost::int32_t id, size_t mask)
+        {
+          boost::uint64_t key = static_cast<boost::uint32_t>(id);
+          key ^= key >> 33;
+          key *= 0xff51afd7ed558ccdULL;
+          key ^= key >> 33;
+          return static_cast<size_t>(key) & mask;
+        }
+
+      public:
+
+        template <size_t N>
+        explicit OperationTable(const Entry (&entries)[N])
+        {
+          size_t size = 2;
+          while (size < 2 * N)
+            size *= 2;
+
+          Entry empty = { 0, 0 };
+          slots_.assign(size, empty);
+          mask_ = size - 1;
+
+          for (size_t i = 0; i < N; ++i)
+          {
+            if (entries[i].id == 0 || !entries[i].handler)
+              throw std::logic_error("OperationTable: invalid entry");
+
+            size_t s = slot_of(entries[i].id, mask_);
+            while (slots_[s].id != 0)
+            {
+              if (slots_[s].id == entries[i].id)
+                throw std::logic_error("OperationTable: duplicate operation id");
+              s = (s + 1) & mask_;
+            }
+            slots_[s] = entries[i];
+          }
+        }
+
+        // Handler of the operation, or a null handler if it is unknown.
+        Handler find(boost::int32_t id) const
+        {
+          for (size_t s = slot_of(id, mask_); slots_[s].id != 0; s = (s + 1) & mask_)
+          {
+            if (slots_[s].id == id)
+              return slots_[s].handler;
+          }
+          return 0;
+        }
+      };
+
+    } // namespace details
+  } // namespace rpc
+} // namespace dds
+
+#endif // OMG_DDS_RPC_OPERATION_TABLE_H
@@ -0,0 +1,343 @@
+#ifndef PENDING_REQUEST_TABLE_H
+#define PENDING_REQUEST_TABLE_H
+
+#include <cassert>
+#include <cstddef>
+#include <new>
+#include <vector>
+
+#include "boost/align/aligned_alloc.hpp"
+#include "boost/cstdint.hpp"
+#include "boost/thread/mutex.hpp"
+#include "boost/thread/condition_variable.hpp"
+#include "boost/chrono.hpp"
+
+namespace dds {
+  namespace rpc {
+    namespace details {
+
+      // Packs an RTPS sequence number (DDS_SequenceNumber_t or
+      // dds::SequenceNumber_t) into the 64-bit key of PendingRequestTable.
+      template <class SequenceNumber>
+      boost::uint64_t sequence_key(const SequenceNumber & sn)
+      {
+        return (static_cast<boost::uint64_t>(static_cast<boost::uint32_t>(sn.high)) << 32) |
+                static_cast<boost::uint32_t>(sn.low);
+      }
+
+      // Outstanding requests keyed by their 64-bit sequence number.
+      //
+      // The keys are spread over SHARD_COUNT shards. Each shard is an open
+      // addressing table with linear probing and backward-shift deletion,
+      // guarded by its own mutex. Inserting and completing a request only
+      // moves V in and out of a preallocated slot. The slot array grows
+      // geometrically, so there is no allocation per request.
+      //
+      // Sequence numbers start at 1, so key 0 marks an empty slot.
+      //
+      // V must be default constructible and move assignable. A freed
+      // slot is emptied with V's reset() if it has one, else by assigning
+      // V(). A V whose default constructor allocates provides reset().
+      template <class V>
+      class PendingRequestTable
+      {
+        enum { SHARD_BITS = 4,
+               SHARD_COUNT = 1 << SHARD_BITS,
+               INITIAL_SLOTS = 16,
+               CACHE_LINE = 64 };
+
+        struct Slot
+        {
+          boost::uint64_t key;
+          V value;
+
+          Slot()
+            : key(0),
+              value()
+          { }
+        };
+
+        // Shards share no cache line, so threads working on different
+        // shards don't slow each other down.
+        struct alignas(CACHE_LINE) Shard
+        {
+          boost::mutex mutex;
+          boost::condition_variable cond;
+          std::vector<Slot> slots;
+          size_t count;
+
+          Shard()
+            : slots(INITIAL_SLOTS),
+              count(0)
+          { }
+        };
+
+        // Allocated apart, on a cache line boundary. Before C++17 new
+        // doesn't align a table that holds the shards themselves.
+        Shard * shards_;
+
+        PendingRequestTable(const PendingRequestTable &);
+        PendingRequestTable & operator = (const PendingRequestTable &);
+
+        static boost::uint64_t mix(boost::uint64_t key)
+        {
+          key ^= key >> 33;
+          key *= 0xff51afd7ed558ccdULL;
+          key ^= key >> 33;
+          return key;
+        }
+
+        Shard & shard_of(boost::uint64_t key)
+        {
+          return shards_[mix(key) >> (64 - SHARD_BITS)];
+        }
+
+        static size_t home_of(boost::uint64_t key, size_t mask)
+        {
+          return static_cast<size_t>(mix(key)) & mask;
+        }
+
+        // Index of key, or of the empty slot where it would go.
+        static size_t probe(const std::vector<Slot> & slots, boost::uint64_t key)
+        {
+          size_t mask = slots.size() - 1;
+          size_t i = home_of(key, mask);
+
+          while (slots[i].key != 0 && slots[i].key != key)
+            i = (i + 1) & mask;
+
+          return i;
+        }
+
+        static void grow(Shard & shard)
+        {
+          std::vector<Slot> bigger(shard.slots.size() * 2);
+
+          for (size_t i = 0; i < shard.slots.size(); ++i)
+          {
+            if (shard.slots[i].key != 0)
+            {
+              Slot & slot = bigger[probe(bigger, shard.slots[i].key)];
+              slot.key = shard.slots[i].key;
+              slot.value = std::move(shard.slots[i].value);
+            }
+          }
+
+          shard.slots.swap(bigger);
+        }
+
+        static size_t find_or_insert(Shard & shard, boost::uint64_t key)
+        {
+          assert(key != 0);
+
+          size_t i = probe(shard.slots, key);
+          if (shard.slots[i].key == key)
+            return i;
+
+          if ((shard.count + 1) * 2 > shard.slots.size())
+          {
+            grow(shard);
+            i = probe(shard.slots, key);
+          }
+
+          shard.slots[i].key = key;
+          ++shard.count;
+          return i;
+        }
+
+        template <class T>
+        static auto empty(T & value, int) -> decltype(value.reset(), void())
+        {
+          value.reset();
+        }
+
+        template <class T>
+        static void empty(T & value, long)
+        {
+          value = T();
+        }
+
+        static void erase_at(Shard & shard, size_t hole)
+        {
+          std::vector<Slot> & slots = shard.slots;
+          size_t mask = slots.size() - 1;
+
+          for (size_t j = (hole + 1) & mask; slots[j].key != 0; j = (j + 1) & mask)
+          {
+            size_t home = home_of(slots[j].key, mask);
+
+            // Shift the entry back unless its home lies in (hole, j].
+            bool stays = (hole < j) ? (hole < home && home <= j)
+                                    : (hole < home || home <= j);
+            if (!stays)
+            {
+              slots[hole].key = slots[j].key;
+              slots[hole].value = std::move(slots[j].value);
+              hole = j;
+            }
+          }
+
+          slots[hole].key = 0;
+          empty(slots[hole].value, 0);
+          --shard.count;
+        }
+
+      public:
+
+        PendingRequestTable()
+          : shards_(static_cast<Shard *>(
+              boost::alignment::aligned_alloc(CACHE_LINE, sizeof(Shard) * SHARD_COUNT)))
+        {
+          if (!shards_)
+            throw std::bad_alloc();
+
+          int built = 0;
+          try {
+            for (; built < SHARD_COUNT; ++built)
+              new (&shards_[built]) Shard();
+          }
+          catch (...) {
+            while (built > 0)
+              shards_[--built].~Shard();
+            boost::alignment::aligned_free(shards_);
+            throw;
+          }
+        }
+
+        ~PendingRequestTable()
+        {
+          for (int i = 0; i < SHARD_COUNT; ++i)
+            shards_[i].~Shard();
+          boost::alignment::aligned_free(shards_);
+        }
+
+        // Calls f(V &) on the entry for key, default constructing the
+        // entry if it is absent. The entry is erased if f returns true.
+        template <class F>
+        void apply(boost::uint64_t key, F f)
+        {
+          Shard & shard = shard_of(key);
+          boost::lock_guard<boost::mutex> guard(shard.mutex);
+
+          size_t i = find_or_insert(shard, key);
+          if (f(shard.slots[i].value))
+            erase_at(shard, i);
+        }
+
+        // Blocks until ready(V &) holds for the entry of key or until
+        // deadline. On success calls f(V &), erases the entry and returns
+        // true. On timeout erases the entry too, so a caller that gives
+        // up leaves nothing behind. Writers wake the waiters up with
+        // notify(key).
+        template <class Ready, class F>
+        bool wait_take(boost::uint64_t key,
+                       const boost::chrono::steady_clock::time_point & deadline,
+                       Ready ready,
+                       F f)
+        {
+          Shard & shard = shard_of(key);
+          boost::unique_lock<boost::mutex> lock(shard.mutex);
+
+          for (;;)
+          {
+            // The slot may move while we sleep, so probe every time.
+            size_t i = find_or_insert(shard, key);
+            if (ready(shard.slots[i].value))
+            {
+              f(shard.slots[i].value);
+              erase_at(shard, i);
+              return true;
+            }
+
+            if (shard.cond.wait_until(lock, deadline) == boost::cv_status::timeout)
+            {
+              i = find_or_insert(shard, key);
+              bool taken = ready(shard.slots[i].value);
+              if (taken)
+                f(shard.slots[i].value);
+
+              erase_at(shard, i);
+              return taken;
+            }
+          }
+        }
+
+        // Calls f(key, V &) on every entry and erases the ones for which
+        // it returns true. An entry may be seen twice, so f must only act
+        // on the entries it erases.
+        template <class F>
+        void erase_if(F f)
+        {
+          for (int s = 0; s < SHARD_COUNT; ++s)
+          {
+            Shard & shard = shards_[s];
+            boost::lock_guard<boost::mutex> guard(shard.mutex);
+
+            // Erasing shifts a later entry into slot i, so look at it again.
+            for (size_t i = 0; i < shard.slots.size(); )
+            {
+              if (shard.slots[i].key != 0 &&
+                  f(shard.slots[i].key, shard.slots[i].value))
+                erase_at(shard, i);
+              else
+                ++i;
+            }
+          }
+        }
+
+        void notify(boost::uint64_t key)
+        {
+          shard_of(key).cond.notify_all();
+        }
+
+        void insert(boost::uint64_t key, const V & value)
+        {
+          Shard & shard = shard_of(key);
+          boost::lock_guard<boost::mutex> guard(shard.mutex);
+
+          shard.slots[find_or_insert(shard, key)].value = value;
+        }
+
+        bool find(boost::uint64_t key, V & value)
+        {
+          Shard & shard = shard_of(key);
+          boost::lock_guard<boost::mutex> guard(shard.mutex);
+
+          size_t i = probe(shard.slots, key);
+          if (shard.slots[i].key != key)
+            return false;
+
+          value = shard.slots[i].value;
+          return true;
+        }
+
+        bool erase(boost::uint64_t key)
+        {
+          Shard & shard = shard_of(key);
+          boost::lock_guard<boost::mutex> guard(shard.mutex);
+
+          size_t i = probe(shard.slots, key);
+          if (shard.slots[i].key != key)
+            return false;
+
+          erase_at(shard, i);
+          return true;
+        }
+
+        size_t size()
+        {
+          size_t total = 0;
+          for (int i = 0; i < SHARD_COUNT; ++i)
+          {
+            boost::lock_guard<boost::mutex> guard(shards_[i].mutex);
+            total += shards_[i].count;
+          }
+          return total;
+        }
+      };
+
+    } // namespace details
+  } // namespace rpc
+} // namespace dds
+
+#endif // PENDING_REQUEST_TABLE_H
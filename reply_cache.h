@@ -0,0 +1,104 @@
+#ifndef OMG_DDS_RPC_REPLY_CACHE_H
+#define OMG_DDS_RPC_REPLY_CACHE_H
+
+#include <chrono>
+
+#include "boost/cstdint.hpp"
+#include "boost/thread/lock_guard.hpp"
+#include "boost/thread/mutex.hpp"
+#include "boost/unordered_map.hpp"
+
+namespace dds {
+  namespace rpc {
+    namespace details {
+
+      // Replies to read-only calls, reused for up to max_staleness.
+      // Any reply to a call that may change the service's state
+      // invalidates them all.
+      //
+      // A read that was sent before the last invalidation may carry the
+      // state from before the change. Its reply isn't stored: callers
+      // pass the generation() they saw when they sent the read.
+      template <class Key, class T>
+      class ReplyCache
+      {
+      public:
+        typedef std::chrono::steady_clock clock;
+
+      private:
+        struct Entry
+        {
+          T value;
+          clock::time_point stored;
+        };
+
+        const clock::duration max_staleness_;
+
+        boost::mutex mutex_;
+        boost::unordered_map<Key, Entry> entries_;
+        boost::uint64_t generation_;
+
+        ReplyCache(const ReplyCache &);
+        ReplyCache & operator = (const ReplyCache &);
+
+      public:
+
+        explicit ReplyCache(clock::duration max_staleness)
+          : max_staleness_(max_staleness),
+            generation_(0)
+        { }
+
+        boost::uint64_t generation()
+        {
+          boost::lock_guard<boost::mutex> guard(mutex_);
+          return generation_;
+        }
+
+        // Copies the reply stored for key into value, unless there is
+        // none or it is too old.
+        bool find(const Key & key, T & value)
+        {
+          clock::time_point now = clock::now();
+
+          boost::lock_guard<boost::mutex> guard(mutex_);
+          typename boost::unordered_map<Key, Entry>::iterator it = entries_.find(key);
+          if (it == entries_.end())
+            return false;
+
+          if (now - it->second.stored > max_staleness_)
+          {
+            entries_.erase(it);
+            return false;
+          }
+
+          value = it->second.value;
+          return true;
+        }
+
+        // Stores the reply to a read sent at generation.
+        void store(const Key & key, const T & value, boost::uint64_t generation)
+        {
+          clock::time_point now = clock::now();
+
+          boost::lock_guard<boost::mutex> guard(mutex_);
+          if (generation != generation_)
+            return;
+
+          Entry & entry = entries_[key];
+          entry.value = value;
+          entry.stored = now;
+        }
+
+        void invalidate()
+        {
+          boost::lock_guard<boost::mutex> guard(mutex_);
+          entries_.clear();
+          ++generation_;
+        }
+      };
+
+    } // namespace details
+  } // namespace rpc
+} // namespace dds
+
+#endif // OMG_DDS_RPC_REPLY_CACHE_H
@@ -89,6 +89,18 @@ namespace dds { namespace rpc {
     return *this;
   }
 
+  RequesterParams & RequesterParams::reply_pump_threads(int count)
+  {
+    impl_->reply_pump_threads(count);
+    return *this;
+  }
+
+  RequesterParams & RequesterParams::max_outstanding_requests(int count)
+  {
+    impl_->max_outstanding_requests(count);
+    return *this;
+  }
+
   DDSDomainParticipant * RequesterParams::domain_participant() const
   {
     return impl_->domain_participant();
@@ -99,6 +111,38 @@ namespace dds { namespace rpc {
     return impl_->service_name();
   }
 
+  int RequesterParams::reply_pump_threads() const
+  {
+    return impl_->reply_pump_threads();
+  }
+
+  int RequesterParams::max_outstanding_requests() const
+  {
+    return impl_->max_outstanding_requests();
+  }
+
+  RequesterParams & RequesterParams::completion_executor(Executor & executor)
+  {
+    impl_->completion_executor(&executor);
+    return *this;
+  }
+
+  Executor * RequesterParams::completion_executor() const
+  {
+    return impl_->completion_executor();
+  }
+
+  RequesterParams & RequesterParams::request_batch_size(int requests)
+  {
+    impl_->request_batch_size(requests);
+    return *this;
+  }
+
+  int RequesterParams::request_batch_size() const
+  {
+    return impl_->request_batch_size();
+  }
+
   ReplierParams::ReplierParams()
     : impl_(boost::make_shared<details::ReplierParamsImpl>())
   { }
@@ -135,11 +179,37 @@ namespace dds { namespace rpc {
     return impl_->service_name();
   }
 
+  ReplierParams & ReplierParams::reply_batch_size(int replies)
+  {
+    impl_->reply_batch_size(replies);
+    return *this;
+  }
+
+  ReplierParams & ReplierParams::reply_flush_delay(const dds::Duration & delay)
+  {
+    impl_->reply_flush_delay(delay);
+    return *this;
+  }
+
+  int ReplierParams::reply_batch_size() const
+  {
+    return impl_->reply_batch_size();
+  }
+
+  dds::Duration ReplierParams::reply_flush_delay() const
+  {
+    return impl_->reply_flush_delay();
+  }
+
 
   namespace details {
 
     RequesterParamsImpl::RequesterParamsImpl()
-      : participant_(0)
+      : participant_(0),
+        reply_pump_threads_(1),
+        max_outstanding_requests_(400),
+        completion_executor_(0),
+        request_batch_size_(1)
     { }
 
     void	RequesterParamsImpl::domain_participant(DDSDomainParticipant *participant)
@@ -162,8 +232,59 @@ namespace dds { namespace rpc {
       return service_name_;
     }
 
+    void RequesterParamsImpl::reply_pump_threads(int count)
+    {
+      if (count < 1)
+        throw std::invalid_argument("reply_pump_threads must be at least 1");
+
+      reply_pump_threads_ = count;
+    }
+
+    int RequesterParamsImpl::reply_pump_threads() const
+    {
+      return reply_pump_threads_;
+    }
+
+    void RequesterParamsImpl::max_outstanding_requests(int count)
+    {
+      if (count < 0)
+        throw std::invalid_argument("max_outstanding_requests can't be negative");
+
+      max_outstanding_requests_ = count;
+    }
+
+    int RequesterParamsImpl::max_outstanding_requests() const
+    {
+      return max_outstanding_requests_;
+    }
+
+    void RequesterParamsImpl::completion_executor(Executor * executor)
+    {
+      completion_executor_ = executor;
+    }
+
+    Executor * RequesterParamsImpl::completion_executor() const
+    {
+      return completion_executor_;
+    }
+
+    void RequesterParamsImpl::request_batch_size(int requests)
+    {
+      if (requests < 1)
+        throw std::invalid_argument("request_batch_size must be at least 1");
+
+      request_batch_size_ = requests;
+    }
+
+    int RequesterParamsImpl::request_batch_size() const
+    {
+      return request_batch_size_;
+    }
+
     ReplierParamsImpl::ReplierParamsImpl()
-      : participant_(0)
+      : participant_(0),
+        reply_batch_size_(1),
+        reply_flush_delay_(dds::Duration::from_micros(500))
     { }
 
     void	ReplierParamsImpl::domain_participant(DDSDomainParticipant *participant)
@@ -186,6 +307,32 @@ namespace dds { namespace rpc {
       return service_name_;
     }
 
+    void ReplierParamsImpl::reply_batch_size(int replies)
+    {
+      if (replies < 1)
+        throw std::invalid_argument("reply_batch_size must be at least 1");
+
+      reply_batch_size_ = replies;
+    }
+
+    void ReplierParamsImpl::reply_flush_delay(const dds::Duration & delay)
+    {
+      if (delay.sec < 0 || (delay.sec == 0 && delay.nanosec == 0))
+        throw std::invalid_argument("reply_flush_delay must be positive");
+
+      reply_flush_delay_ = delay;
+    }
+
+    int ReplierParamsImpl::reply_batch_size() const
+    {
+      return reply_batch_size_;
+    }
+
+    dds::Duration ReplierParamsImpl::reply_flush_delay() const
+    {
+      return reply_flush_delay_;
+    }
+
     connext::RequesterParams
       to_connext_requester_params(const dds::rpc::RequesterParams & params)
     {
@@ -193,8 +340,23 @@ namespace dds { namespace rpc {
       if(!part)
         part = dds::rpc::details::DefaultDomainParticipant::singleton().get();
 
-      return connext::RequesterParams(part)
-              .service_name(params.service_name());
+      connext::RequesterParams connext_params =
+        connext::RequesterParams(part)
+          .service_name(params.service_name());
+
+      if (params.request_batch_size() > 1)
+      {
+        DDS_DataWriterQos qos;
+        if (part->get_default_datawriter_qos(qos) != DDS_RETCODE_OK)
+          throw std::runtime_error("Unable to get the default DataWriter QoS");
+
+        // The Requester flushes after every send, so no flush delay.
+        qos.batch.enable = DDS_BOOLEAN_TRUE;
+        qos.batch.max_samples = params.request_batch_size();
+        connext_params.datawriter_qos(qos);
+      }
+
+      return connext_params;
     }
 
     ServiceProxyImpl::~ServiceProxyImpl()
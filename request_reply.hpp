@@ -3,10 +3,18 @@
 #include "connext_cpp/connext_cpp_requester.h"
 #include "connext_cpp/connext_cpp_replier.h"
 #include "boost/make_shared.hpp"
+#include "boost/bind.hpp"
+#include "boost/scoped_ptr.hpp"
+#include "boost/thread.hpp"
 
-#include <map>
+#include <atomic>
 
 #include "common.h"
+#include "concurrency_limit.h"
+#include "executor.h"
+#include "pending_request_table.h"
+#include "trace.h"
+#include "unique_data.h"
 
 #ifdef RTI_WIN32
 #define strcpy(dest, src) strcpy_s(dest, 255, src);
@@ -61,32 +69,498 @@ connext::RequesterParams
   to_connext_requester_params(
     const dds::rpc::RequesterParams & params);
 
+// Identity of the sample itself, as Sample::identity() reports it.
+inline DDS::SampleIdentity_t sample_identity(const dds::SampleInfo & info)
+{
+  DDS::SampleIdentity_t identity;
+  identity.writer_guid = info.original_publication_virtual_guid;
+  identity.sequence_number = info.original_publication_virtual_sequence_number;
+  return identity;
+}
+
+// Identity of the request a reply sample answers.
+inline DDS::SampleIdentity_t related_sample_identity(const dds::SampleInfo & info)
+{
+  DDS::SampleIdentity_t identity;
+  identity.writer_guid = info.related_original_publication_virtual_guid;
+  identity.sequence_number =
+    info.related_original_publication_virtual_sequence_number;
+  return identity;
+}
+
+// Replies that say the service shed the request or ran out of time
+// mean the service is overloaded.
+template <class TRep>
+ConcurrencyLimiter::Outcome limiter_outcome(const TRep & reply)
+{
+  return reply.header.remoteEx == REMOTE_EX_OUT_OF_RESOURCES ||
+         reply.header.remoteEx == REMOTE_EX_DEADLINE_EXCEEDED
+           ? ConcurrencyLimiter::OUTCOME_LOST
+           : ConcurrencyLimiter::OUTCOME_OK;
+}
+
 template <class TReq, class TRep>
 class RequesterImpl : public details::ServiceProxyImpl,
                       public connext::Requester<TReq, TRep>
 {
   private:
+    // A reply the pump threads have taken from the reply DataReader or
+    // a request that is still waiting for one. Replies to send_request_async
+    // complete reply_promise right away. Replies to plain send_request are
+    // parked here until receive_reply picks them up.
+    struct PendingReply
+    {
+      bool async;
+      bool ready;
+      promise<Sample<TRep>> reply_promise;
+      Sample<TRep> reply;
+      // Of an async request, as in RequestHeader; 0: none.
+      boost::uint64_t deadline;
+      // When the reply was parked.
+      boost::chrono::steady_clock::time_point parked;
+
+      PendingReply()
+        : async(false),
+          ready(false),
+          deadline(0)
+      { }
+
+      // Empties the entry for its slot's next request without the
+      // allocations PendingReply() makes. The promise left, never used
+      // or moved from, is swapped out before it is used again. The
+      // sample is assigned over.
+      void reset()
+      {
+        async = false;
+        ready = false;
+        deadline = 0;
+      }
+    };
+
+    // A request receive_reply may be asked about.
+    struct SentRequest
+    {
+      DDS::SampleIdentity_t identity;
+      boost::chrono::steady_clock::time_point sent;
+    };
+
+    // A request over the concurrency limit, sent once a slot frees up.
+    struct QueuedRequest
+    {
+      helper::unique_data<TReq> request;
+      promise<Sample<TRep>> reply_promise;
+    };
+
+    enum { REPLY_BATCH_SIZE = 64,
+           EXPIRE_PERIOD_MS = 1000,
+           PARKED_REPLY_SECONDS = 60 };
+
     std::string service_name_;
     std::string instance_name_;
-    long sn;
+    dds::GUID_t writer_guid_;
+    std::atomic<boost::uint64_t> sn;
     bool suppress_invalid;
-    std::map<DDS::SampleIdentity_t, promise<Sample<TRep>>> dict;
-    std::map<dds::SampleIdentity, DDS::SampleIdentity_t> id2id_map;
+    // Keyed by the sequence number DDS assigned to the request sample.
+    PendingRequestTable<PendingReply> pending_;
+    // Maps RequestHeader.requestId to the DDS identity of the request,
+    // for the requests receive_reply may be asked about. Erased once it
+    // takes their reply or gives up on it, or along with the parked
+    // replies if nobody asks.
+    PendingRequestTable<SentRequest> request_ids_;
+    // When expire_request_ids next looks, in steady clock nanoseconds.
+    std::atomic<boost::int64_t> next_id_expiry_ns_;
+
+    int pump_count_;
+    std::atomic<bool> pumps_running_;
+    boost::thread_group pumps_;
+    boost::mutex mutex_;
+
+    // Null when RequesterParams::max_outstanding_requests is 0.
+    boost::scoped_ptr<ConcurrencyLimiter> limiter_;
+    // Set when a queued request was written, so a pump thread flushes
+    // the request DataWriter.
+    std::atomic<bool> queued_written_;
+    // Completes async replies. Null: the pump thread does.
+    Executor * completion_executor_;
+    // RequesterParams::request_batch_size is above 1.
+    bool batching_;
 
     typedef connext::Requester<TReq, TRep> super;
 
-    struct SyncProxy 
+    // Reserves count consecutive request sequence numbers and returns the
+    // first one. Safe to call from many threads.
+    boost::uint64_t reserve_sequence_numbers(size_t count)
+    {
+      return sn.fetch_add(count) + 1;
+    }
+
+    // Stamps RequestHeader.requestId with this Requester's writer GUID and
+    // the given sequence number.
+    void prepare_request(TReq & req, boost::uint64_t seqnum)
+    {
+      //strcpy(req.header.serviceName, service_name_.c_str());
+
+      if (instance_name_.size() > 0)
+        strcpy(req.header.instanceName, instance_name_.c_str());
+
+      req.header.requestId.writer_guid = writer_guid_;
+      req.header.requestId.sequence_number.high = static_cast<DDS_Long>(seqnum >> 32);
+      req.header.requestId.sequence_number.low = static_cast<DDS_UnsignedLong>(seqnum);
+      req.header.oneway = DDS_BOOLEAN_FALSE;
+    }
+
+    // Writes an already stamped request and returns its DDS identity.
+    DDS::SampleIdentity_t write_request(TReq & req)
+    {
+      DDS::WriteParams_t wparams;
+      WriteSampleRef<TReq> wsref(req, wparams);
+
+      DDS_RPC_TRACE(REQUEST, SEND_REQUEST, req.header.requestId);
+      super::send_request(wsref);
+      return wsref.identity();
+    }
+
+    // Writes a request whose reply receive_reply will be asked for, and
+    // remembers its DDS identity for it. The replies to async requests
+    // are matched by their DDS identity alone.
+    void write_sync_request(TReq & req)
+    {
+      SentRequest sent;
+      sent.identity = write_request(req);
+      sent.sent = boost::chrono::steady_clock::now();
+      request_ids_.insert(sequence_key(req.header.requestId.sequence_number), sent);
+
+      // Without the pumps, nothing else does.
+      if (!pumps_running_)
+        expire_request_ids();
+    }
+
+    // Forgets the requests sent longer than PARKED_REPLY_SECONDS ago.
+    // Looks at most once per EXPIRE_PERIOD_MS.
+    void expire_request_ids()
+    {
+      boost::chrono::steady_clock::time_point now = boost::chrono::steady_clock::now();
+      boost::int64_t now_ns = boost::chrono::duration_cast<boost::chrono::nanoseconds>(
+        now.time_since_epoch()).count();
+      boost::int64_t due = next_id_expiry_ns_;
+
+      if (now_ns < due ||
+          !next_id_expiry_ns_.compare_exchange_strong(
+            due, now_ns + boost::int64_t(EXPIRE_PERIOD_MS) * 1000000))
+        return;
+
+      boost::chrono::steady_clock::time_point stale =
+        now - boost::chrono::seconds(PARKED_REPLY_SECONDS);
+
+      request_ids_.erase_if([&](boost::uint64_t, SentRequest & request) {
+        return request.sent < stale;
+      });
+    }
+
+    // Writes a request that holds a slot of the concurrency limit.
+    void send_with_slot(TReq & request, promise<Sample<TRep>> & reply_promise)
     {
-      RequesterImpl * impl;
+      ConcurrencyLimiter::clock::time_point sent = ConcurrencyLimiter::clock::now();
       DDS::SampleIdentity_t identity;
 
-      SyncProxy(
-        RequesterImpl * i,
-        const DDS::SampleIdentity_t & sid)
-        : impl(i),
-          identity(sid)
-      { }
-    };
+      try {
+        identity = write_request(request);
+      }
+      catch (...) {
+        limiter_->cancel();
+        throw;
+      }
+
+      limiter_->track(sequence_key(identity.sequence_number),
+                      sent,
+                      request.header.deadline);
+      expect_reply(identity, request.header.deadline, reply_promise);
+    }
+
+    // Sends the request now if the concurrency limit allows. Otherwise
+    // queues a copy, which the thread that frees a slot sends.
+    void send_limited(TReq & request, promise<Sample<TRep>> & reply_promise)
+    {
+      if (!limiter_)
+      {
+        expect_reply(write_request(request), request.header.deadline, reply_promise);
+        return;
+      }
+
+      if (limiter_->try_acquire())
+      {
+        send_with_slot(request, reply_promise);
+        return;
+      }
+
+      boost::shared_ptr<QueuedRequest> queued = boost::make_shared<QueuedRequest>();
+      TReq::TypeSupport::copy_data(queued->request.get(), &request);
+      queued->reply_promise.swap(reply_promise);
+
+      limiter_->enqueue([this, queued]() {
+        try {
+          send_with_slot(*queued->request, queued->reply_promise);
+        }
+        catch (...) {
+          // send_with_slot gave the slot back. Nobody but the future
+          // hears of the failure.
+          set_exception_on(completion_executor_,
+                           queued->reply_promise,
+                           details::current_exception());
+          return;
+        }
+        queued_written_ = true;
+      });
+    }
+
+    void release_slot(boost::uint64_t key, const Sample<TRep> & reply)
+    {
+      if (limiter_)
+        limiter_->release(key, limiter_outcome(reply.data()));
+    }
+
+    // Pushes out whatever the request DataWriter has batched so far.
+    void flush_requests()
+    {
+      if (batching_)
+        super::get_request_datawriter()->flush();
+    }
+
+    void check_reader_not_pumped(const char * operation) const
+    {
+      if (pumps_running_)
+        throw std::logic_error(
+          std::string(operation) + 
+          ": the reply pumps own the reply DataReader after send_request_async");
+    }
+
+    void start_reply_pumps()
+    {
+      if (pumps_running_)
+        return;
+
+      boost::lock_guard<boost::mutex> guard(mutex_);
+      if (!pumps_running_)
+      {
+        pumps_running_ = true;
+        for (int i = 0; i < pump_count_; ++i)
+          pumps_.create_thread(boost::bind(&RequesterImpl::pump_replies, this));
+      }
+    }
+
+    void stop_reply_pumps()
+    {
+      pumps_running_ = false;
+      pumps_.join_all();
+    }
+
+    void pump_replies()
+    {
+      boost::chrono::steady_clock::time_point next_expiry =
+        boost::chrono::steady_clock::now();
+
+      while (pumps_running_)
+      {
+        try {
+          LoanedSamples<TRep> replies =
+            super::receive_replies(1,
+                                   REPLY_BATCH_SIZE,
+                                   dds::Duration::from_millis(100));
+
+          for (typename LoanedSamples<TRep>::iterator it = replies.begin();
+               it != replies.end();
+               ++it)
+          {
+            SampleRef<TRep> ref = *it;
+            if (ref.info().valid_data)
+              complete(related_sample_identity(ref.info()),
+                       Sample<TRep>(ref.data(), ref.info()));
+          }
+
+          if (limiter_)
+          {
+            limiter_->expire();
+            if (queued_written_.exchange(false))
+              flush_requests();
+          }
+
+          if (boost::chrono::steady_clock::now() >= next_expiry)
+          {
+            next_expiry = boost::chrono::steady_clock::now() +
+                          boost::chrono::milliseconds(EXPIRE_PERIOD_MS);
+            expire_pending();
+          }
+        }
+        catch (...) {
+          DDS_RPC_TRACE_EVENT(ERROR, REPLY_ERROR);
+          fail_async_requests(details::current_exception());
+        }
+      }
+    }
+
+    // Drops what nobody will ask for anymore: async requests whose
+    // deadline passed without a reply, whose futures get an error, and
+    // replies parked for longer than PARKED_REPLY_SECONDS, such as one
+    // that came after its receive_reply gave up. The requestIds of
+    // requests sent that long ago go with them.
+    void expire_pending()
+    {
+      typedef std::pair<boost::uint64_t,
+                        boost::shared_ptr<promise<Sample<TRep>>>> Expired;
+      std::vector<Expired> expired;
+      boost::chrono::steady_clock::time_point stale =
+        boost::chrono::steady_clock::now() -
+        boost::chrono::seconds(PARKED_REPLY_SECONDS);
+
+      pending_.erase_if([&](boost::uint64_t key, PendingReply & pending) {
+        if (!pending.async)
+          return pending.ready && pending.parked < stale;
+
+        if (!deadline_passed(pending.deadline))
+          return false;
+
+        expired.push_back(Expired(key, boost::make_shared<promise<Sample<TRep>>>()));
+        expired.back().second->swap(pending.reply_promise);
+        return true;
+      });
+
+      expire_request_ids();
+
+      if (expired.empty())
+        return;
+
+      exception_ptr error = to_exception_ptr(
+        std::runtime_error("No reply before the request deadline."));
+
+      for (size_t i = 0; i < expired.size(); ++i)
+      {
+        set_exception_on(completion_executor_, *expired[i].second, error);
+        if (limiter_)
+          limiter_->release(expired[i].first, ConcurrencyLimiter::OUTCOME_LOST);
+      }
+    }
+
+    // The reply DataReader failed, so the replies taken with the failed
+    // batch are gone. Rather than leave their futures waiting for good,
+    // every async request waiting for a reply gets the error.
+    void fail_async_requests(const exception_ptr & error)
+    {
+      typedef std::pair<boost::uint64_t,
+                        boost::shared_ptr<promise<Sample<TRep>>>> Failed;
+      std::vector<Failed> failed;
+
+      pending_.erase_if([&](boost::uint64_t key, PendingReply & pending) {
+        if (!pending.async)
+          return false;
+
+        failed.push_back(Failed(key, boost::make_shared<promise<Sample<TRep>>>()));
+        failed.back().second->swap(pending.reply_promise);
+        return true;
+      });
+
+      // Continuations may run right here. Never under the shard lock.
+      for (size_t i = 0; i < failed.size(); ++i)
+      {
+        set_exception_on(completion_executor_, *failed[i].second, error);
+        if (limiter_)
+          limiter_->release(failed[i].first, ConcurrencyLimiter::OUTCOME_LOST);
+      }
+    }
+
+    void complete(const DDS::SampleIdentity_t & identity, Sample<TRep> reply)
+    {
+      DDS_RPC_TRACE(REQUEST, REPLY_RECEIVED, reply.data().header.relatedRequestId);
+
+      boost::uint64_t key = sequence_key(identity.sequence_number);
+      promise<Sample<TRep>> reply_promise;
+      bool async = false;
+
+      pending_.apply(key, [&](PendingReply & pending) {
+        if (!pending.async)
+        {
+          pending.reply = reply;
+          pending.ready = true;
+          pending.parked = boost::chrono::steady_clock::now();
+          return false;
+        }
+
+        reply_promise.swap(pending.reply_promise);
+        async = true;
+        return true;
+      });
+
+      // Continuations may run right here. Never under the shard lock.
+      // The reply is delivered first: freeing the slot runs the
+      // requests queued behind it.
+      if (async)
+      {
+        set_value_on(completion_executor_, reply_promise, reply);
+        release_slot(key, reply);
+      }
+      else
+        pending_.notify(key);
+    }
+
+    void expect_reply(const DDS::SampleIdentity_t & identity,
+                      boost::uint64_t deadline,
+                      promise<Sample<TRep>> & reply_promise)
+    {
+      Sample<TRep> reply;
+      bool ready = false;
+      boost::uint64_t key = sequence_key(identity.sequence_number);
+
+      pending_.apply(key, [&](PendingReply & pending) {
+        if (!pending.ready)
+        {
+          pending.async = true;
+          pending.deadline = deadline;
+          pending.reply_promise.swap(reply_promise);
+          return false;
+        }
+
+        // The reply beat us to it.
+        reply = pending.reply;
+        ready = true;
+        return true;
+      });
+
+      if (ready)
+      {
+        set_value_on(completion_executor_, reply_promise, reply);
+        release_slot(key, reply);
+      }
+    }
+
+    bool take_pumped_reply(Sample<TRep> & reply,
+                           const dds::SampleIdentity & relatedRequestId,
+                           const dds::Duration & timeout)
+    {
+      boost::chrono::steady_clock::time_point deadline =
+        boost::chrono::steady_clock::now() +
+        boost::chrono::seconds(timeout.sec) +
+        boost::chrono::nanoseconds(timeout.nanosec);
+
+      boost::uint64_t request_key = sequence_key(relatedRequestId.sequence_number);
+      SentRequest request;
+
+      if (!request_ids_.find(request_key, request))
+      {
+        printf("Unknown dds::SampleIdentity\n");
+        return false;
+      }
+
+      // Taken or timed out, the entry for the reply is gone, and with
+      // it the request. A reply that comes late is parked until it
+      // expires. resend_request asks again.
+      bool taken =
+        pending_.wait_take(sequence_key(request.identity.sequence_number),
+                           deadline,
+                           [](PendingReply & pending) { return pending.ready; },
+                           [&](PendingReply & pending) { reply = pending.reply; });
+
+      request_ids_.erase(request_key);
+      return taken;
+    }
 
   public:
     /*
@@ -112,8 +586,27 @@ class RequesterImpl : public details::ServiceProxyImpl,
           connext::Requester<TReq, TRep>(
                 details::to_connext_requester_params(params)),
           sn(0),
-          suppress_invalid(true)
-    { }
+          suppress_invalid(true),
+          next_id_expiry_ns_(0),
+          pump_count_(params.reply_pump_threads()),
+          pumps_running_(false),
+          limiter_(params.max_outstanding_requests()
+                     ? new ConcurrencyLimiter(params.max_outstanding_requests())
+                     : 0),
+          queued_written_(false),
+          completion_executor_(params.completion_executor()),
+          batching_(params.request_batch_size() > 1)
+    {
+      DDS_DataWriterQos qos;
+      memset(&writer_guid_, 0, sizeof(writer_guid_));
+      if (super::get_request_datawriter()->get_qos(qos) == DDS_RETCODE_OK)
+        memcpy(&writer_guid_, &qos.protocol.virtual_guid, sizeof(writer_guid_));
+    }
+
+    ~RequesterImpl()
+    {
+      stop_reply_pumps();
+    }
 
     void bind(const std::string & instance_name) override
     { }
@@ -184,11 +677,14 @@ class RequesterImpl : public details::ServiceProxyImpl,
     }
 
     void close() override
-    { }
+    {
+      stop_reply_pumps();
+    }
 
     void send_request(WriteSampleRef<TReq> & wsref)
     {
       super::send_request(wsref);
+      flush_requests();
     }
 
     bool receive_nondata_samples(bool enable)
@@ -201,17 +697,42 @@ class RequesterImpl : public details::ServiceProxyImpl,
 
     void send_request(TReq & req) 
     {
+      prepare_request(req, reserve_sequence_numbers(1));
+      write_sync_request(req);
+      flush_requests();
+    }
+
+    // Writes a request sent before once more, under the requestId it
+    // already has. Its reply is matched to the new write.
+    void resend_request(TReq & req)
+    {
+      write_sync_request(req);
+      flush_requests();
+    }
+
+    // Nothing waits for a reply, so nothing is remembered about it.
+    void send_request_oneway(TReq & req)
+    {
+      prepare_request(req, reserve_sequence_numbers(1));
+      req.header.oneway = DDS_BOOLEAN_TRUE;
+
       DDS::WriteParams_t wparams;
       WriteSampleRef<TReq> wsref(req, wparams);
-      //strcpy(req.header.serviceName, service_name_.c_str());
-  
-      if(instance_name_.size() > 0)
-        strcpy(req.header.instanceName, instance_name_.c_str());
-  
-      req.header.requestId.sequence_number.low = ++sn;
-
       super::send_request(wsref);
-      id2id_map[req.header.requestId] = wsref.identity();
+      flush_requests();
+    }
+
+    void send_requests(span<TReq> requests)
+    {
+      boost::uint64_t seqnum = reserve_sequence_numbers(requests.size());
+
+      for (size_t i = 0; i < requests.size(); ++i)
+      {
+        prepare_request(requests[i], seqnum + i);
+        write_sync_request(requests[i]);
+      }
+
+      flush_requests();
     }
 
     bool receive_reply(
@@ -219,96 +740,118 @@ class RequesterImpl : public details::ServiceProxyImpl,
       const dds::SampleIdentity & relatedRequestId,
       const dds::Duration & timeout)
     {
-      if (id2id_map.find(relatedRequestId) != id2id_map.end())
+      // Once the pumps run they own the reply DataReader.
+      if (pumps_running_)
+        return take_pumped_reply(reply, relatedRequestId, timeout);
+
+      boost::uint64_t request_key = sequence_key(relatedRequestId.sequence_number);
+      SentRequest request;
+
+      if (!request_ids_.find(request_key, request))
       {
-        if (super::wait_for_replies(1, timeout))
-        {            
-          bool ret = super::take_reply(reply, id2id_map[relatedRequestId]);
-          if (suppress_invalid && !reply.info().valid_data)
-            return false;
-
-          id2id_map.erase(relatedRequestId);
-          return ret;
-        }
+        printf("Unknown dds::SampleIdentity\n");
         return false;
       }
-      else
+
+      // Whatever comes of it, this is the one try at the reply, as with
+      // the pumps. resend_request asks again.
+      bool ret = false;
+      if (super::wait_for_replies(1, timeout))
       {
-        printf("Unknown dds::SampleIdentity\n");
-        return false;
+        ret = super::take_reply(reply, request.identity);
+        if (suppress_invalid && !reply.info().valid_data)
+          ret = false;
+        else if (ret && reply.info().valid_data)
+          DDS_RPC_TRACE(REQUEST, REPLY_RECEIVED, relatedRequestId);
       }
+
+      request_ids_.erase(request_key);
+      return ret;
     }
 
-    static void * execute(void * arg)
+    // The loaned variants hand out the DataReader's own buffers. They
+    // can't be mixed with send_request_async, whose pumps take every reply.
+    LoanedSamples<TRep> receive_replies(const dds::Duration & max_wait)
     {
-      printf("execute: Created thread = %lld\n", RTIOsapiThread_getCurrentThreadID());
-      
-      std::unique_ptr<SyncProxy> sync(static_cast<SyncProxy *>(arg));
+      check_reader_not_pumped("receive_replies");
+      return super::receive_replies(max_wait);
+    }
 
-      if (sync->impl->wait_for_replies(
-            1, dds::Duration::from_seconds(60), sync->identity))
-      {
-        try {
-          Sample<TRep> reply;
+    LoanedSamples<TRep> receive_replies(int min_count,
+                                        int max_count,
+                                        const dds::Duration & max_wait)
+    {
+      check_reader_not_pumped("receive_replies");
+      return super::receive_replies(min_count, max_count, max_wait);
+    }
 
-          if (sync->impl->take_reply(reply, sync->identity))
-          {
-            //if ((reply.data().header.relatedRequestId.sequence_number.low % 10) == 0)
-            //  throw std::runtime_error("% 10 exception!");
+    LoanedSamples<TRep> take_replies(int max_count)
+    {
+      check_reader_not_pumped("take_replies");
+      return super::take_replies(max_count);
+    }
 
-            sync->impl->dict[sync->identity].set_value(reply);
-          }
-          else
-          {
-              sync->impl->dict[sync->identity].
-                set_exception(
-                  std::make_exception_ptr(
-                    std::runtime_error("RequesterImpl::execute: Reply unavailable!")));
-          }
-        }
-        catch (...) {
-          sync->impl->dict[sync->identity].set_exception(std::current_exception());
-        }
-        sync->impl->dict.erase(sync->identity);
-      }
-      else
-        printf("Request timed out\n");
+    LoanedSamples<TRep> take_replies(int max_count,
+                                     const dds::SampleIdentity & relatedRequestId)
+    {
+      check_reader_not_pumped("take_replies");
 
-      //printf("Future set. Thread complete\n");
-      return NULL;
+      SentRequest request;
+      if (!request_ids_.find(sequence_key(relatedRequestId.sequence_number), request))
+        return LoanedSamples<TRep>();
+
+      return super::take_replies(max_count, request.identity);
     }
 
     dds::rpc::future<Sample<TRep>> send_request_async(const TReq &req)
     {
-      struct RTIOsapiThread* tid = 0;
       promise<Sample<TRep>> p;
       dds::rpc::future<Sample<TRep>> future = p.get_future();
-      DDS::WriteParams_t wparams;
-      WriteSampleRef<TReq> wsref(const_cast<TReq &>(req), wparams);
+      TReq & request = const_cast<TReq &>(req);
 
-      //strcpy(req.header.serviceName, service_name_.c_str());
+      prepare_request(request, reserve_sequence_numbers(1));
 
-      if (instance_name_.size() > 0)
-        strcpy(req.header.instanceName, instance_name_.c_str());
+      start_reply_pumps();
+      send_limited(request, p);
+      flush_requests();
 
-      const_cast<TReq &>(req).header.requestId.sequence_number.low = ++sn;
-
-      super::send_request(wsref);
-      SyncProxy * sync = new SyncProxy(this, wsref.identity());
-      dict[wsref.identity()] = std::move(p);
-
-      tid = RTIOsapiThread_new(
-              "Reply Processor Thread", 
-              RTI_OSAPI_THREAD_PRIORITY_NORMAL,
-              RTI_OSAPI_THREAD_OPTION_DEFAULT,
-              8192, // stack size
-              NULL, // cpu bitmap
-              execute, 
-              sync);
-      
-      RTIOsapiThread_delete(tid);
       return future;
     }
+
+    future<void> slot_available_async()
+    {
+      boost::shared_ptr<promise<void>> p = boost::make_shared<promise<void>>();
+      dds::rpc::future<void> available = p->get_future();
+
+      if (limiter_)
+        limiter_->when_available([p]() { p->set_value(); });
+      else
+        p->set_value();
+
+      return available;
+    }
+
+    std::vector<dds::rpc::future<Sample<TRep>>> 
+      send_requests_async(span<TReq> requests)
+    {
+      std::vector<dds::rpc::future<Sample<TRep>>> futures;
+      futures.reserve(requests.size());
+
+      boost::uint64_t seqnum = reserve_sequence_numbers(requests.size());
+      start_reply_pumps();
+
+      for (size_t i = 0; i < requests.size(); ++i)
+      {
+        promise<Sample<TRep>> p;
+        futures.push_back(p.get_future());
+
+        prepare_request(requests[i], seqnum + i);
+        send_limited(requests[i], p);
+      }
+
+      flush_requests();
+      return futures;
+    }
 };
 
 template <class TReq, class TRep>
@@ -319,8 +862,23 @@ connext::ReplierParams<TReq, TRep>
   if (!part)
     part = dds::rpc::details::DefaultDomainParticipant::singleton().get();
 
-  return connext::ReplierParams<TReq, TRep>(part)
-            .service_name(replier_params.service_name());
+  connext::ReplierParams<TReq, TRep> params =
+    connext::ReplierParams<TReq, TRep>(part)
+      .service_name(replier_params.service_name());
+
+  if (replier_params.reply_batch_size() > 1)
+  {
+    DDS_DataWriterQos qos;
+    if (part->get_default_datawriter_qos(qos) != DDS_RETCODE_OK)
+      throw std::runtime_error("Unable to get the default DataWriter QoS");
+
+    qos.batch.enable = DDS_BOOLEAN_TRUE;
+    qos.batch.max_samples = replier_params.reply_batch_size();
+    qos.batch.max_flush_delay = replier_params.reply_flush_delay();
+    params.datawriter_qos(qos);
+  }
+
+  return params;
 }
 
 
@@ -332,6 +890,8 @@ class ReplierImpl : public connext::Replier<TReq, TRep>,
     std::string service_name_;
     std::string instance_name_;
     bool suppress_invalid;
+    DDS::ReadCondition * request_condition_;
+    bool batching_;
 
     typedef connext::Replier<TReq, TRep> super;
   
@@ -347,9 +907,30 @@ class ReplierImpl : public connext::Replier<TReq, TRep>,
     ReplierImpl(
         const ReplierParams & params)
         : connext::Replier<TReq, TRep>(to_connext_replier_params<TReq, TRep>(params)),
-          suppress_invalid(true)
+          suppress_invalid(true),
+          request_condition_(0),
+          batching_(params.reply_batch_size() > 1)
     {
       service_name_ = params.service_name();
+      request_condition_ =
+        super::get_request_datareader()->create_readcondition(
+          DDS_ANY_SAMPLE_STATE,
+          DDS_ANY_VIEW_STATE,
+          DDS_ANY_INSTANCE_STATE);
+
+      if (!request_condition_)
+        throw std::runtime_error("Unable to create request read condition");
+    }
+
+    ~ReplierImpl()
+    {
+      super::get_request_datareader()->delete_readcondition(request_condition_);
+    }
+
+    // Triggered while the request DataReader has samples to take.
+    DDS::Condition * request_condition()
+    {
+      return request_condition_;
     }
 
 	/*
@@ -370,10 +951,15 @@ class ReplierImpl : public connext::Replier<TReq, TRep>,
 		DDS::SampleIdentity_t connext_identity;
 		memcpy(&connext_identity, &identity, sizeof(DDS::SampleIdentity_t));
 		reply.header.relatedRequestId = identity;
-		reply.header.remoteEx = REMOTE_EX_OK;
 		super::send_reply(reply, connext_identity);
 	}
 
+    void flush_replies()
+    {
+      if (batching_)
+        super::get_reply_datawriter()->flush();
+    }
+
     bool receive_request(Sample<TReq> & sample, const dds::Duration & timeout)
     {
       bool ret = super::receive_request(sample, timeout);
@@ -383,6 +969,25 @@ class ReplierImpl : public connext::Replier<TReq, TRep>,
       return ret;
     }
 
+    // The loaned variants return the DataReader's buffers as they are,
+    // including samples without valid data. Check info().valid_data.
+    LoanedSamples<TReq> receive_requests(const dds::Duration & max_wait)
+    {
+      return super::receive_requests(max_wait);
+    }
+
+    LoanedSamples<TReq> receive_requests(int min_count,
+                                         int max_count,
+                                         const dds::Duration & max_wait)
+    {
+      return super::receive_requests(min_count, max_count, max_wait);
+    }
+
+    LoanedSamples<TReq> take_requests(int max_count)
+    {
+      return super::take_requests(max_count);
+    }
+
     bool receive_nondata_samples(bool enable)
     {
       bool old = suppress_invalid;
@@ -402,15 +1007,27 @@ class RequesterParamsImpl
 {
   DDSDomainParticipant * participant_;
   std::string service_name_;
+  int reply_pump_threads_;
+  int max_outstanding_requests_;
+  Executor * completion_executor_;
+  int request_batch_size_;
 
 public:
   RequesterParamsImpl();
 
   void domain_participant(DDSDomainParticipant *participant);
   void service_name(const std::string & service_name);
+  void reply_pump_threads(int count);
+  void max_outstanding_requests(int count);
+  void completion_executor(Executor * executor);
+  void request_batch_size(int requests);
 
   DDSDomainParticipant *	domain_participant() const;
   std::string service_name() const;
+  int reply_pump_threads() const;
+  int max_outstanding_requests() const;
+  Executor * completion_executor() const;
+  int request_batch_size() const;
 
 };
 
@@ -422,19 +1039,34 @@ class ReplierParamsImpl
 {
   DDSDomainParticipant * participant_;
   std::string service_name_;
+  int reply_batch_size_;
+  dds::Duration reply_flush_delay_;
 
 public:
   ReplierParamsImpl();
 
   void domain_participant(DDSDomainParticipant *participant);
   void service_name(const std::string & service_name);
+  void reply_batch_size(int replies);
+  void reply_flush_delay(const dds::Duration & delay);
 
   DDSDomainParticipant *	domain_participant() const;
   std::string service_name() const;
+  int reply_batch_size() const;
+  dds::Duration reply_flush_delay() const;
 
 };
 
 } // namespace details 
+} // namespace rpc
+} // namespace dds
+
+#ifdef USE_LOOPBACK
+#include "loopback_request_reply.hpp"
+#endif
+
+namespace dds {
+namespace rpc {
 
 template <class Impl>
 RPCEntity::RPCEntity(Impl impl, int)
@@ -453,12 +1085,12 @@ ServiceProxy::ServiceProxy(Impl impl, int)
 
 template <typename TReq, typename TRep>
 Requester<TReq, TRep>::Requester()
-: ServiceProxy(new rpc::details::RequesterImpl<TReq, TRep>())
+: ServiceProxy(new details::impl_of<Requester>())
 { }
 
 template <typename TReq, typename TRep>
 Requester<TReq, TRep>::Requester(const RequesterParams& params)
-: ServiceProxy(new rpc::details::RequesterImpl<TReq, TRep>(params), 0)
+: ServiceProxy(new details::impl_of<Requester>(params), 0)
 { }
 
 template <typename TReq, typename TRep>
@@ -469,37 +1101,136 @@ Requester<TReq, TRep>::Requester(const Requester & requester)
 template <typename TReq, typename TRep>
 void Requester<TReq, TRep>::send_request(TReq & req)
 {
-  auto impl = dynamic_cast<details::RequesterImpl<TReq, TRep> *>(impl_.get());
+  auto impl = static_cast<details::impl_of<Requester> *>(impl_.get());
   impl->send_request(req);
 }
 
+#ifdef OMG_DDS_RPC_BASIC_PROFILE
+
+template <typename TReq, typename TRep>
+void Requester<TReq, TRep>::send_request_oneway(TReq & req)
+{
+  auto impl = static_cast<details::impl_of<Requester> *>(impl_.get());
+  impl->send_request_oneway(req);
+}
+
+template <typename TReq, typename TRep>
+void Requester<TReq, TRep>::resend_request(TReq & req)
+{
+  auto impl = static_cast<details::impl_of<Requester> *>(impl_.get());
+  impl->resend_request(req);
+}
+
+#endif // OMG_DDS_RPC_BASIC_PROFILE
+
+#ifdef OMG_DDS_RPC_ENHANCED_PROFILE
+
+template <typename TReq, typename TRep>
+void Requester<TReq, TRep>::send_request_oneway(const TReq & req)
+{
+  auto impl = static_cast<details::impl_of<Requester> *>(impl_.get());
+  impl->send_request_oneway(const_cast<TReq &>(req));
+}
+
+template <typename TReq, typename TRep>
+void Requester<TReq, TRep>::resend_request(const TReq & req)
+{
+  auto impl = static_cast<details::impl_of<Requester> *>(impl_.get());
+  impl->resend_request(const_cast<TReq &>(req));
+}
+
+#endif // OMG_DDS_RPC_ENHANCED_PROFILE
+
+template <typename TReq, typename TRep>
+void Requester<TReq, TRep>::send_requests(span<TReq> requests)
+{
+  auto impl = static_cast<details::impl_of<Requester> *>(impl_.get());
+  impl->send_requests(requests);
+}
+
+template <class TReq, class TRep>
+std::vector<future<Sample<TRep>>> 
+  Requester<TReq, TRep>::send_requests_async(span<TReq> requests)
+{
+  auto impl = static_cast<details::impl_of<Requester> *>(impl_.get());
+  return impl->send_requests_async(requests);
+}
+
 template <typename TReq, typename TRep>
 bool Requester<TReq, TRep>::receive_reply(Sample<TRep> & sample, const dds::Duration & timeout)
 {
-  auto impl = static_cast<details::RequesterImpl<TReq, TRep> *>(impl_.get());
+  auto impl = static_cast<details::impl_of<Requester> *>(impl_.get());
   return impl->receive_reply(sample, timeout);
 }
 
 template <class TReq, class TRep>
 future<Sample<TRep>> Requester<TReq, TRep>::send_request_async(const TReq & req)
 {
-  auto impl = static_cast<details::RequesterImpl<TReq, TRep> *>(impl_.get());
+  auto impl = static_cast<details::impl_of<Requester> *>(impl_.get());
   return impl->send_request_async(req);
 }
 
+template <class TReq, class TRep>
+future<void> Requester<TReq, TRep>::slot_available_async()
+{
+  auto impl = static_cast<details::impl_of<Requester> *>(impl_.get());
+  return impl->slot_available_async();
+}
+
 template <class TReq, class TRep>
 bool Requester<TReq, TRep>::wait_for_replies(const dds::Duration & max_wait)
 {
-  auto impl = static_cast<details::RequesterImpl<TReq, TRep> *>(impl_.get());
+  auto impl = static_cast<details::impl_of<Requester> *>(impl_.get());
   return impl->wait_for_replies(max_wait);
 }
 
+template <class TReq, class TRep>
+LoanedSamples<TRep> Requester<TReq, TRep>::receive_replies(const dds::Duration & max_wait)
+{
+  auto impl = static_cast<details::impl_of<Requester> *>(impl_.get());
+  return impl->receive_replies(max_wait);
+}
+
+template <class TReq, class TRep>
+LoanedSamples<TRep> Requester<TReq, TRep>::receive_replies(
+    int min_count,
+    int max_count,
+    const dds::Duration & max_wait)
+{
+  auto impl = static_cast<details::impl_of<Requester> *>(impl_.get());
+  return impl->receive_replies(min_count, max_count, max_wait);
+}
+
+template <class TReq, class TRep>
+LoanedSamples<TRep> Requester<TReq, TRep>::take_replies(int max_count)
+{
+  auto impl = static_cast<details::impl_of<Requester> *>(impl_.get());
+  return impl->take_replies(max_count);
+}
+
+template <class TReq, class TRep>
+LoanedSamples<TRep> Requester<TReq, TRep>::take_replies(
+    int max_count,
+    const dds::SampleIdentity & related_request_id)
+{
+  auto impl = static_cast<details::impl_of<Requester> *>(impl_.get());
+  return impl->take_replies(max_count, related_request_id);
+}
+
+template <class TReq, class TRep>
+LoanedSamples<TRep> Requester<TReq, TRep>::take_replies(
+    const dds::SampleIdentity & related_request_id)
+{
+  auto impl = static_cast<details::impl_of<Requester> *>(impl_.get());
+  return impl->take_replies(DDS_LENGTH_UNLIMITED, related_request_id);
+}
+
 #ifdef OMG_DDS_RPC_ENHANCED_PROFILE
 
 template <class TReq, class TRep>
 void Requester<TReq, TRep>::send_request(WriteSampleRef<TReq> & wsref)
 {
-  auto impl = static_cast<details::RequesterImpl<TReq, TRep> *>(impl_.get());
+  auto impl = static_cast<details::impl_of<Requester> *>(impl_.get());
   impl->send_request(wsref);
 }
 
@@ -508,7 +1239,7 @@ void Requester<TReq, TRep>::send_request(WriteSampleRef<TReq> & wsref)
 template <typename TReq, typename TRep>
 bool Requester<TReq, TRep>::receive_nondata_samples(bool enable)
 {
-  auto impl = static_cast<details::RequesterImpl<TReq, TRep> *>(impl_.get());
+  auto impl = static_cast<details::impl_of<Requester> *>(impl_.get());
   return impl->receive_nondata_samples(enable);
 }
 
@@ -518,7 +1249,7 @@ bool Requester<TReq, TRep>::receive_reply(
     const dds::SampleIdentity & relatedRequestId, 
     const dds::Duration & timeout)
 {
-  auto impl = static_cast<details::RequesterImpl<TReq, TRep> *>(impl_.get());
+  auto impl = static_cast<details::impl_of<Requester> *>(impl_.get());
   return impl->receive_reply(reply, relatedRequestId, timeout);
 }
 
@@ -526,7 +1257,7 @@ template <class TReq, class TRep>
 typename Requester<TReq, TRep>::RequestDataWriter
 Requester<TReq, TRep>::get_request_datawriter() const
 {
-  auto impl = static_cast<details::RequesterImpl<TReq, TRep> *>(impl_.get());
+  auto impl = static_cast<details::impl_of<Requester> *>(impl_.get());
   return impl->get_request_datawriter();
 }
 
@@ -534,11 +1265,18 @@ template <class TReq, class TRep>
 typename Requester<TReq, TRep>::ReplyDataReader
 Requester<TReq, TRep>::get_reply_datareader() const
 {
-  auto impl = static_cast<details::RequesterImpl<TReq, TRep> *>(impl_.get());
+  auto impl = static_cast<details::impl_of<Requester> *>(impl_.get());
   return impl->get_reply_datareader();
 }
 
 
+template <class TReq, class TRep>
+typename Requester<TReq, TRep>::VendorDependent
+Requester<TReq, TRep>::get_impl()
+{
+  return boost::static_pointer_cast<details::impl_of<Requester>>(impl_);
+}
+
 template <class TReq, class TRep>
 Requester<TReq, TRep>::~Requester()
 { }
@@ -550,18 +1288,57 @@ Requester<TReq, TRep>::~Requester()
 
 template <typename TReq, typename TRep>
 Replier<TReq, TRep>::Replier()
-: RPCEntity(boost::make_shared<details::ReplierImpl<TReq, TRep>>(), 0)
+: RPCEntity(boost::make_shared<details::impl_of<Replier>>(), 0)
 { }
 
 template <typename TReq, typename TRep>
 Replier<TReq, TRep>::Replier(const ReplierParams& params)
-: RPCEntity(boost::make_shared<details::ReplierImpl<TReq, TRep>>(params), 0)
+: RPCEntity(boost::make_shared<details::impl_of<Replier>>(params), 0)
 { }
 
 template <typename TReq, typename TRep>
 bool Replier<TReq, TRep>::receive_request(Sample<TReq> & sample, const dds::Duration & timeout)
 {
-  return static_cast<details::ReplierImpl<TReq, TRep> *>(impl_.get())->receive_request(sample, timeout);
+  return static_cast<details::impl_of<Replier> *>(impl_.get())->receive_request(sample, timeout);
+}
+
+template <typename TReq, typename TRep>
+typename Replier<TReq, TRep>::LoanedSamplesType 
+Replier<TReq, TRep>::receive_requests(const dds::Duration & max_wait)
+{
+  return static_cast<details::impl_of<Replier> *>(impl_.get())->receive_requests(max_wait);
+}
+
+template <typename TReq, typename TRep>
+typename Replier<TReq, TRep>::LoanedSamplesType 
+Replier<TReq, TRep>::receive_requests(
+    int min_request_count,
+    int max_request_count,
+    const dds::Duration & max_wait)
+{
+  return static_cast<details::impl_of<Replier> *>(impl_.get())->receive_requests(
+           min_request_count, max_request_count, max_wait);
+}
+
+template <typename TReq, typename TRep>
+typename Replier<TReq, TRep>::LoanedSamplesType 
+Replier<TReq, TRep>::take_requests(int max_samples)
+{
+  return static_cast<details::impl_of<Replier> *>(impl_.get())->take_requests(max_samples);
+}
+
+template <typename TReq, typename TRep>
+typename Replier<TReq, TRep>::RequestDataReader
+Replier<TReq, TRep>::get_request_datareader() const
+{
+  return static_cast<details::impl_of<Replier> *>(impl_.get())->get_request_datareader();
+}
+
+template <typename TReq, typename TRep>
+typename Replier<TReq, TRep>::ReplyDataWriter
+Replier<TReq, TRep>::get_reply_datawriter() const
+{
+  return static_cast<details::impl_of<Replier> *>(impl_.get())->get_reply_datawriter();
 }
 /*
 template <typename TReq, typename TRep>
@@ -578,13 +1355,26 @@ void Replier<TReq, TRep>::send_reply(
 	TRep & reply,
 	const dds::SampleIdentity & identity)
 {
-	static_cast<details::ReplierImpl<TReq, TRep> *>(impl_.get())->send_reply(reply, identity);
+	static_cast<details::impl_of<Replier> *>(impl_.get())->send_reply(reply, identity);
+}
+
+template <typename TReq, typename TRep>
+void Replier<TReq, TRep>::flush_replies()
+{
+  static_cast<details::impl_of<Replier> *>(impl_.get())->flush_replies();
 }
 
 template <typename TReq, typename TRep>
 bool Replier<TReq, TRep>::receive_nondata_samples(bool enable)
 {
-  return static_cast<details::ReplierImpl<TReq, TRep> *>(impl_.get())->receive_nondata_samples(enable);
+  return static_cast<details::impl_of<Replier> *>(impl_.get())->receive_nondata_samples(enable);
+}
+
+template <class TReq, class TRep>
+typename Replier<TReq, TRep>::VendorDependent
+Replier<TReq, TRep>::get_impl() const
+{
+  return boost::static_pointer_cast<details::impl_of<Replier>>(impl_);
 }
 
 template <class TReq, class TRep>
@@ -0,0 +1,759 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <ndds/ndds_cpp.h>
+
+#include "common.h"
+#include "pending_request_table.h"
+#include "RobotControlSupport.h"
+#include "trace.h"
+
+#include "boost/thread.hpp"
+
+#ifdef RTI_WIN32
+#define strcpy(dst, src) strcpy_s(dst, 255, src);
+#endif
+
+using namespace dds::rpc;
+using namespace robot;
+
+/* Throughput and latency of the RPC paths, against a Server running in
+   the same process. Every call is a getStatus whose reply carries
+   `payload` bytes in Status.msg. Each of `threads` client threads keeps
+   up to `depth` calls outstanding on the asynchronous paths. */
+
+typedef std::chrono::steady_clock bench_clock;
+
+struct BenchConfig
+{
+  std::string service_name;
+  std::string scenario;
+  std::string output;
+  std::string trace;
+  int domainid;
+  int requests;
+  int payload;
+  int depth;
+  int threads;
+  int latency_us;
+
+  BenchConfig()
+    : service_name("RobotBench"),
+      scenario("all"),
+      domainid(65),
+      requests(100000),
+      payload(32),
+      depth(64),
+      threads(1),
+      latency_us(0)
+  { }
+};
+
+struct BenchResult
+{
+  std::string scenario;
+  int requests;
+  double seconds;
+  double throughput;
+  double p50_us;
+  double p99_us;
+  double p999_us;
+};
+
+// Largest string rtiddsgen allocates for the unbounded Status.msg.
+static const int MAX_PAYLOAD = 255;
+
+class BenchRobot : public robot::RobotControl
+{
+  Status status_;
+
+public:
+
+  explicit BenchRobot(int payload)
+  {
+    robot::Status_initialize(&status_);
+    memset(status_.msg, 'x', payload);
+    status_.msg[payload] = '\0';
+  }
+
+  ~BenchRobot()
+  {
+    robot::Status_finalize(&status_);
+  }
+
+  void command(const Command &) override
+  { }
+
+  float setSpeed(float speed) override
+  {
+    return speed;
+  }
+
+  float getSpeed() override
+  {
+    return 0;
+  }
+
+  void getStatus(Status & status) override
+  {
+    Status_copy(&status, &status_);
+  }
+};
+
+static double elapsed_us(const bench_clock::time_point & start)
+{
+  return std::chrono::duration<double, std::micro>(bench_clock::now() - start).count();
+}
+
+static double percentile(const std::vector<double> & sorted_us, double p)
+{
+  if (sorted_us.empty())
+    return 0;
+
+  size_t index = static_cast<size_t>(p * (sorted_us.size() - 1));
+  return sorted_us[index];
+}
+
+/* Runs body(latencies, count) on config.threads threads, each issuing
+   its share of config.requests calls, and summarizes the latencies. */
+template <class Body>
+static BenchResult run_threads(const std::string & scenario,
+                               const BenchConfig & config,
+                               Body body)
+{
+  int per_thread = config.requests / config.threads;
+  std::vector<std::vector<double>> latencies(config.threads);
+  boost::thread_group threads;
+
+  bench_clock::time_point start = bench_clock::now();
+
+  for (int t = 0; t < config.threads; ++t)
+  {
+    latencies[t].reserve(per_thread);
+    threads.create_thread([&body, &latencies, per_thread, t]() {
+      try {
+        body(latencies[t], per_thread);
+      }
+      catch (std::exception & ex)
+      {
+        printf("robot_bench: client thread failed: %s\n", ex.what());
+      }
+    });
+  }
+  threads.join_all();
+
+  double seconds = elapsed_us(start) / 1e6;
+
+  std::vector<double> all;
+  for (int t = 0; t < config.threads; ++t)
+    all.insert(all.end(), latencies[t].begin(), latencies[t].end());
+  std::sort(all.begin(), all.end());
+
+  BenchResult result;
+  result.scenario = scenario;
+  result.requests = static_cast<int>(all.size());
+  result.seconds = seconds;
+  result.throughput = all.size() / seconds;
+  result.p50_us = percentile(all, 0.50);
+  result.p99_us = percentile(all, 0.99);
+  result.p999_us = percentile(all, 0.999);
+
+  printf("%-10s %8d calls %10.0f calls/s  p50 %8.1f us  p99 %8.1f us  p99.9 %8.1f us\n",
+         result.scenario.c_str(),
+         result.requests,
+         result.throughput,
+         result.p50_us,
+         result.p99_us,
+         result.p999_us);
+
+  return result;
+}
+
+typedef Requester<RobotControl_Request, RobotControl_Reply> BenchRequester;
+
+static void make_getStatus(RobotControl_Request & request)
+{
+  request.data._d = RobotControl_getStatus_Hash;
+  request.data._u.getStatus.dummy = 0;
+}
+
+/* Blocks until the service answers, so discovery is not measured. */
+static void warm_up(BenchRequester & requester)
+{
+  helper::unique_data<RobotControl_Request> request;
+  make_getStatus(*request);
+
+  dds::Sample<RobotControl_Reply> reply;
+  requester.send_request(*request);
+  if (!requester.receive_reply(reply,
+                               request->header.requestId,
+                               dds::Duration::from_seconds(20)))
+    throw std::runtime_error("robot_bench: service not found");
+}
+
+typedef Replier<RobotControl_Request, RobotControl_Reply> BenchReplier;
+
+// In robot_reqrep.cxx.
+dds::SampleIdentity to_rpc_sample_identity(const DDS::SampleIdentity_t & inid);
+
+/* Answers every request with getStatus until done is set. */
+static void rr_replier(BenchReplier & replier,
+                       BenchRobot & robot,
+                       const std::atomic<bool> & done)
+{
+  helper::unique_data<RobotControl_Reply> reply;
+  reply->data._d = RobotControl_getStatus_Hash;
+  reply->data._u.getStatus._d = RETCODE_OK;
+  robot.getStatus(reply->data._u.getStatus._u.result.status);
+
+  while (!done)
+  {
+    dds::Sample<RobotControl_Request> request;
+
+    if (replier.receive_request(request, dds::Duration::from_millis(100)))
+      replier.send_reply(*reply, to_rpc_sample_identity(request.identity()));
+  }
+}
+
+/* send_request_async against a bare Replier, with no Server dispatch
+   in the way: the Requester's reply path alone. It only uses the public
+   API, so it also runs on builds from before the reply pumps. */
+static BenchResult bench_rr(const BenchConfig & config)
+{
+  typedef std::pair<bench_clock::time_point,
+                    dds::rpc::future<dds::Sample<RobotControl_Reply>>> InFlight;
+
+  std::string service_name = config.service_name + "_rr";
+  std::atomic<bool> done(false);
+  BenchRobot robot(config.payload);
+
+  BenchReplier replier(ReplierParams().service_name(service_name));
+  BenchRequester requester(RequesterParams().service_name(service_name));
+
+  boost::thread replier_thread([&replier, &robot, &done]() {
+    rr_replier(replier, robot, done);
+  });
+
+  BenchResult result;
+  try {
+    warm_up(requester);
+
+    int depth = config.depth;
+    result = run_threads("rr", config,
+      [&requester, depth](std::vector<double> & latencies, int count) {
+        helper::unique_data<RobotControl_Request> request;
+        make_getStatus(*request);
+        std::deque<InFlight> in_flight;
+
+        for (int sent = 0; sent < count || !in_flight.empty(); )
+        {
+          while (sent < count && static_cast<int>(in_flight.size()) < depth)
+          {
+            in_flight.push_back(
+              InFlight(bench_clock::now(), requester.send_request_async(*request)));
+            ++sent;
+          }
+
+          in_flight.front().second.get();
+          latencies.push_back(elapsed_us(in_flight.front().first));
+          in_flight.pop_front();
+        }
+      });
+  }
+  catch (...)
+  {
+    done = true;
+    replier_thread.join();
+    throw;
+  }
+
+  done = true;
+  replier_thread.join();
+  return result;
+}
+
+static BenchResult bench_rr_sync(const BenchConfig & config)
+{
+  BenchRequester requester(RequesterParams().service_name(config.service_name));
+  warm_up(requester);
+
+  return run_threads("rr_sync", config,
+    [&requester](std::vector<double> & latencies, int count) {
+      helper::unique_data<RobotControl_Request> request;
+      dds::Sample<RobotControl_Reply> reply;
+      make_getStatus(*request);
+
+      for (int i = 0; i < count; ++i)
+      {
+        bench_clock::time_point start = bench_clock::now();
+        requester.send_request(*request);
+        if (requester.receive_reply(reply,
+                                    request->header.requestId,
+                                    dds::Duration::from_seconds(20)))
+          latencies.push_back(elapsed_us(start));
+      }
+    });
+}
+
+static BenchResult bench_rr_future(const BenchConfig & config)
+{
+  typedef std::pair<bench_clock::time_point,
+                    dds::rpc::future<dds::Sample<RobotControl_Reply>>> InFlight;
+
+  BenchRequester requester(RequesterParams().service_name(config.service_name));
+  warm_up(requester);
+
+  int depth = config.depth;
+  return run_threads("rr_future", config,
+    [&requester, depth](std::vector<double> & latencies, int count) {
+      helper::unique_data<RobotControl_Request> request;
+      make_getStatus(*request);
+      std::deque<InFlight> in_flight;
+
+      for (int sent = 0; sent < count || !in_flight.empty(); )
+      {
+        while (sent < count && static_cast<int>(in_flight.size()) < depth)
+        {
+          in_flight.push_back(
+            InFlight(bench_clock::now(), requester.send_request_async(*request)));
+          ++sent;
+        }
+
+        in_flight.front().second.get();
+        latencies.push_back(elapsed_us(in_flight.front().first));
+        in_flight.pop_front();
+      }
+    });
+}
+
+static BenchResult bench_rr_then(const BenchConfig & config)
+{
+  BenchRequester requester(RequesterParams().service_name(config.service_name));
+  warm_up(requester);
+
+  int depth = config.depth;
+  return run_threads("rr_then", config,
+    [&requester, depth](std::vector<double> & latencies, int count) {
+      helper::unique_data<RobotControl_Request> request;
+      make_getStatus(*request);
+      std::deque<dds::rpc::future<double>> in_flight;
+
+      for (int sent = 0; sent < count || !in_flight.empty(); )
+      {
+        while (sent < count && static_cast<int>(in_flight.size()) < depth)
+        {
+          bench_clock::time_point start = bench_clock::now();
+          in_flight.push_back(
+            requester.send_request_async(*request)
+              .then([start](dds::rpc::future<dds::Sample<RobotControl_Reply>> && reply) {
+                reply.get();
+                return elapsed_us(start);
+              }));
+          ++sent;
+        }
+
+        latencies.push_back(in_flight.front().get());
+        in_flight.pop_front();
+      }
+    });
+}
+
+static BenchResult bench_func_sync(const BenchConfig & config)
+{
+  RobotControlSupport::Client client(ClientParams().service_name(config.service_name));
+  client.wait_for_service(dds::Duration::from_seconds(20));
+
+  return run_threads("func_sync", config,
+    [&client](std::vector<double> & latencies, int count) {
+      Status status;
+      Status_initialize(&status);
+
+      for (int i = 0; i < count; ++i)
+      {
+        bench_clock::time_point start = bench_clock::now();
+        client.getStatus(status);
+        latencies.push_back(elapsed_us(start));
+      }
+
+      Status_finalize(&status);
+    });
+}
+
+static BenchResult bench_func_async(const BenchConfig & config)
+{
+  typedef std::pair<bench_clock::time_point,
+                    dds::rpc::future<RobotControl_getStatus_AsyncOut>> InFlight;
+
+  RobotControlSupport::Client client(ClientParams().service_name(config.service_name));
+  client.wait_for_service(dds::Duration::from_seconds(20));
+
+  int depth = config.depth;
+  return run_threads("func_async", config,
+    [&client, depth](std::vector<double> & latencies, int count) {
+      std::deque<InFlight> in_flight;
+
+      for (int sent = 0; sent < count || !in_flight.empty(); )
+      {
+        while (sent < count && static_cast<int>(in_flight.size()) < depth)
+        {
+          in_flight.push_back(
+            InFlight(bench_clock::now(), client.getStatus_async()));
+          ++sent;
+        }
+
+        in_flight.front().second.get();
+        latencies.push_back(elapsed_us(in_flight.front().first));
+        in_flight.pop_front();
+      }
+    });
+}
+
+#ifdef USE_AWAIT
+
+static dds::rpc::future<void> await_calls(
+  RobotControlSupport::Client & client,
+  std::vector<double> & latencies,
+  int count)
+{
+  for (int i = 0; i < count; ++i)
+  {
+    bench_clock::time_point start = bench_clock::now();
+    co_await client.getStatus_async();
+    latencies.push_back(elapsed_us(start));
+  }
+}
+
+static BenchResult bench_await(const BenchConfig & config)
+{
+  RobotControlSupport::Client client(ClientParams().service_name(config.service_name));
+  client.wait_for_service(dds::Duration::from_seconds(20));
+
+  return run_threads("await", config,
+    [&client](std::vector<double> & latencies, int count) {
+      await_calls(client, latencies, count).get();
+    });
+}
+
+#endif // USE_AWAIT
+
+struct TableEntry
+{
+  char payload[64];
+};
+
+/* Outstanding requests as RequesterImpl kept them before
+   PendingRequestTable: one std::map behind one mutex. */
+class MapPendingTable
+{
+  boost::mutex mutex_;
+  std::map<DDS::SampleIdentity_t, TableEntry> dict_;
+
+  static DDS::SampleIdentity_t to_identity(boost::uint64_t key)
+  {
+    DDS::SampleIdentity_t identity = DDS::SampleIdentity_t();
+    identity.sequence_number.high = static_cast<DDS_Long>(key >> 32);
+    identity.sequence_number.low = static_cast<DDS_UnsignedLong>(key);
+    return identity;
+  }
+
+public:
+  void insert(boost::uint64_t key, const TableEntry & entry)
+  {
+    boost::lock_guard<boost::mutex> guard(mutex_);
+    dict_[to_identity(key)] = entry;
+  }
+
+  bool erase(boost::uint64_t key)
+  {
+    boost::lock_guard<boost::mutex> guard(mutex_);
+    return dict_.erase(to_identity(key)) > 0;
+  }
+};
+
+/* Each thread keeps `outstanding` requests in the table: every step
+   inserts a new request and completes the oldest one. Returns ns per
+   insert/complete pair. */
+template <class Table>
+static double bench_table_run(int outstanding, int thread_count)
+{
+  const int steps = 1000000 / thread_count;
+  Table table;
+  TableEntry entry = TableEntry();
+
+  for (int t = 0; t < thread_count; ++t)
+    for (int i = 0; i < outstanding; ++i)
+      table.insert(static_cast<boost::uint64_t>(i) * thread_count + t + 1, entry);
+
+  bench_clock::time_point start = bench_clock::now();
+  boost::thread_group threads;
+
+  for (int t = 0; t < thread_count; ++t)
+  {
+    threads.create_thread([&table, &entry, outstanding, thread_count, steps, t]() {
+      for (int i = 0; i < steps; ++i)
+      {
+        boost::uint64_t oldest = static_cast<boost::uint64_t>(i) * thread_count + t + 1;
+        table.insert(oldest + static_cast<boost::uint64_t>(outstanding) * thread_count, entry);
+        table.erase(oldest);
+      }
+    });
+  }
+  threads.join_all();
+
+  return elapsed_us(start) * 1000 / (static_cast<double>(steps) * thread_count);
+}
+
+/* The Requester pending-request table against the std::map it
+   replaced, on 1 and 4 threads and on --threads. No DDS traffic
+   involved. Returns JSON objects. */
+static std::vector<std::string> bench_table(const BenchConfig & config)
+{
+  const int outstanding[] = { 10, 1000, 100000 };
+  std::vector<int> thread_counts;
+  thread_counts.push_back(1);
+  thread_counts.push_back(4);
+  if (config.threads != 1 && config.threads != 4)
+    thread_counts.push_back(config.threads);
+
+  std::vector<std::string> results;
+
+  for (size_t t = 0; t < thread_counts.size(); ++t)
+  {
+    for (int o = 0; o < 3; ++o)
+    {
+      double map_ns =
+        bench_table_run<MapPendingTable>(outstanding[o], thread_counts[t]);
+      double table_ns =
+        bench_table_run<dds::rpc::details::PendingRequestTable<TableEntry>>(
+          outstanding[o], thread_counts[t]);
+
+      printf("%-10s %d thread(s), %6d outstanding: "
+             "std::map %7.1f ns/op, PendingRequestTable %7.1f ns/op\n",
+             "table",
+             thread_counts[t],
+             outstanding[o],
+             map_ns,
+             table_ns);
+
+      char json[256];
+      sprintf(json,
+              "{ \"scenario\": \"table\", \"threads\": %d, \"outstanding\": %d, "
+              "\"map_ns\": %.1f, \"table_ns\": %.1f }",
+              thread_counts[t], outstanding[o], map_ns, table_ns);
+      results.push_back(json);
+    }
+  }
+
+  return results;
+}
+
+static std::string to_json(const BenchResult & result)
+{
+  char json[512];
+  sprintf(json,
+          "{ \"scenario\": \"%s\", \"requests\": %d, \"seconds\": %.3f, "
+          "\"throughput\": %.1f, \"p50_us\": %.1f, \"p99_us\": %.1f, "
+          "\"p999_us\": %.1f }",
+          result.scenario.c_str(),
+          result.requests,
+          result.seconds,
+          result.throughput,
+          result.p50_us,
+          result.p99_us,
+          result.p999_us);
+  return json;
+}
+
+static void write_json(const BenchConfig & config,
+                       const std::vector<std::string> & results)
+{
+  FILE * out = config.output.empty() ? stdout : fopen(config.output.c_str(), "w");
+  if (!out)
+    throw std::runtime_error("robot_bench: can't open " + config.output);
+
+  fprintf(out,
+          "{\n  \"config\": { \"requests\": %d, \"payload\": %d, "
+          "\"depth\": %d, \"threads\": %d, \"latency_us\": %d },\n"
+          "  \"results\": [\n",
+          config.requests,
+          config.payload,
+          config.depth,
+          config.threads,
+          config.latency_us);
+
+  for (size_t i = 0; i < results.size(); ++i)
+    fprintf(out, "    %s%s\n", results[i].c_str(), i + 1 < results.size() ? "," : "");
+
+  fprintf(out, "  ]\n}\n");
+
+  if (out != stdout)
+    fclose(out);
+}
+
+static bool selected(const BenchConfig & config, const char * scenario)
+{
+  return config.scenario == "all" || config.scenario == scenario;
+}
+
+void usage()
+{
+  printf("Usage: robot_bench [options]\n"
+         "  --domain N        domain id (65)\n"
+         "  --scenario NAME   all|rr|rr_sync|rr_future|rr_then|func_sync|func_async|"
+#ifdef USE_AWAIT
+         "await|"
+#endif
+         "table (all)\n"
+         "  --requests N      calls per scenario, split among threads (100000)\n"
+         "  --payload BYTES   Status.msg size in each reply, at most %d (32)\n"
+         "  --depth N         outstanding calls per thread on async paths (64)\n"
+         "  --threads N       client threads (1)\n"
+         "  --output FILE     JSON results (stdout)\n"
+         "  --trace FILE      dump the trace rings here, for trace_dump\n"
+#ifdef USE_LOOPBACK
+         "  --latency-us N    one-way latency injected by the loopback backend (0)\n"
+#endif
+         ,
+         MAX_PAYLOAD);
+}
+
+static BenchConfig parse_args(int argc, char *argv[])
+{
+  BenchConfig config;
+
+  for (int i = 1; i < argc; ++i)
+  {
+    std::string arg = argv[i];
+    if (i + 1 >= argc)
+      throw std::invalid_argument("missing value for " + arg);
+
+    const char * value = argv[++i];
+    if (arg == "--domain")
+      config.domainid = atoi(value);
+    else if (arg == "--scenario")
+      config.scenario = value;
+    else if (arg == "--requests")
+      config.requests = atoi(value);
+    else if (arg == "--payload")
+      config.payload = atoi(value);
+    else if (arg == "--depth")
+      config.depth = atoi(value);
+    else if (arg == "--threads")
+      config.threads = atoi(value);
+    else if (arg == "--output")
+      config.output = value;
+    else if (arg == "--trace")
+      config.trace = value;
+#ifdef USE_LOOPBACK
+    else if (arg == "--latency-us")
+      config.latency_us = atoi(value);
+#endif
+    else
+      throw std::invalid_argument("unknown option " + arg);
+  }
+
+  const char * scenarios[] = { "all", "rr", "rr_sync", "rr_future", "rr_then",
+                               "func_sync", "func_async", "await", "table" };
+  if (std::find(scenarios, scenarios + 9, config.scenario) == scenarios + 9)
+    throw std::invalid_argument("unknown scenario " + config.scenario);
+
+#ifndef USE_AWAIT
+  if (config.scenario == "await")
+    throw std::invalid_argument("the await scenario needs USE_AWAIT");
+#endif
+
+  if (config.requests < 1 || config.depth < 1 || config.threads < 1 ||
+      config.payload < 0 || config.payload > MAX_PAYLOAD ||
+      config.latency_us < 0)
+    throw std::invalid_argument("option out of range");
+
+  return config;
+}
+
+int main(int argc, char *argv[])
+{
+  try {
+    BenchConfig config = parse_args(argc, argv);
+
+#ifdef USE_LOOPBACK
+    dds::Duration latency = { config.latency_us / 1000000,
+                              static_cast<DDS_UnsignedLong>(config.latency_us % 1000000) * 1000 };
+    dds::rpc::details::LoopbackFaults::instance().latency(latency);
+#endif
+
+    dds::rpc::details::DefaultDomainParticipant::singleton()
+      .set_domainid(config.domainid)
+      .get();
+
+    std::vector<std::string> results;
+
+    if (selected(config, "table"))
+    {
+      std::vector<std::string> table = bench_table(config);
+      results.insert(results.end(), table.begin(), table.end());
+    }
+
+    if (selected(config, "rr"))
+      results.push_back(to_json(bench_rr(config)));
+
+    if (config.scenario != "table" && config.scenario != "rr")
+    {
+      BenchRobot robot(config.payload);
+      dds::rpc::Server server;
+      RobotControlSupport::Service service(
+        robot,
+        server,
+        dds::rpc::ServiceParams().service_name(config.service_name));
+
+      boost::thread server_thread([&server]() { server.run(); });
+
+      if (selected(config, "rr_sync"))
+        results.push_back(to_json(bench_rr_sync(config)));
+      if (selected(config, "rr_future"))
+        results.push_back(to_json(bench_rr_future(config)));
+      if (selected(config, "rr_then"))
+        results.push_back(to_json(bench_rr_then(config)));
+      if (selected(config, "func_sync"))
+        results.push_back(to_json(bench_func_sync(config)));
+      if (selected(config, "func_async"))
+        results.push_back(to_json(bench_func_async(config)));
+#ifdef USE_AWAIT
+      if (selected(config, "await"))
+        results.push_back(to_json(bench_await(config)));
+#endif
+
+      server.close();
+      server_thread.join();
+    }
+
+    write_json(config, results);
+
+    if (!config.trace.empty() && !trace::dump(config.trace.c_str()))
+      printf("robot_bench: can't write %s\n", config.trace.c_str());
+
+    return 0;
+  }
+  catch (std::invalid_argument & ex)
+  {
+    printf("robot_bench: %s\n", ex.what());
+    usage();
+  }
+  catch (std::exception & ex)
+  {
+    printf("Exception in main: %s\n", ex.what());
+  }
+  catch (...)
+  {
+    printf("Unknown exception in main\n");
+  }
+  return 1;
+}
@@ -2,6 +2,7 @@
 #include <stdlib.h>
 
 #include "boost/make_shared.hpp"
+#include "boost/thread/mutex.hpp"
 
 #include "RobotControlSupport.h"
 
@@ -18,6 +19,7 @@ class MyRobot : public robot::RobotControl
 {
   float speed_;
   Status status_;
+  boost::mutex mutex_; // the Server calls in from several threads
 
 public:
 
@@ -52,6 +54,7 @@ public:
   float setSpeed(float speed) override
   {
     printf("setSpeed = %f\n", speed);
+    boost::lock_guard<boost::mutex> guard(mutex_);
     float oldspeed = speed_;
 
     if (speed <= MAX_SPEED)
@@ -65,6 +68,7 @@ public:
   float getSpeed() override
   {
     printf("getSpeed\n");
+    boost::lock_guard<boost::mutex> guard(mutex_);
     return speed_;
   }
 
@@ -157,10 +161,10 @@ dds::rpc::future<void> test_iterative_await(
 
   robot_client.setSpeed(0);
 
-  while ((speed = await robot_client.getSpeed_async()) + increment <= MAX_SPEED)
+  while ((speed = co_await robot_client.getSpeed_async()) + increment <= MAX_SPEED)
   {
     printf("test_iterative_await: thread id = %lld\n", RTIOsapiThread_getCurrentThreadID());
-    await robot_client.setSpeed_async(speed + increment);
+    co_await robot_client.setSpeed_async(speed + increment);
     printf("test_iterative_await: current speed = %f, thread id = %lld\n", 
            speed + increment, RTIOsapiThread_getCurrentThreadID());
   }
@@ -252,8 +256,8 @@ future<void> test_await(robot::RobotControlSupport::Client & robot_client)
 
   for (int i = 0; i < 10; i++)
   {
-    float speed = await robot_client.getSpeed_async();
-    float oldspeed = await robot_client.setSpeed_async(speed + 2);
+    float speed = co_await robot_client.getSpeed_async();
+    float oldspeed = co_await robot_client.setSpeed_async(speed + 2);
     assert(speed == oldspeed);
     printf("test_await: old speed = %f\n", oldspeed);
   }
@@ -226,7 +226,7 @@ future<void> test_await(
     while (speed < 100)
     {
         request->data._d = robot::RobotControl_getSpeed_Hash;
-        dds::Sample<RobotControl_Reply> reply = await requester.send_request_async(*request);
+        dds::Sample<RobotControl_Reply> reply = co_await requester.send_request_async(*request);
         speed = reply.data().data._u.getSpeed._u.result.return_;
         printf("test_await: current speed = %f threadid = %lld\n", 
                speed,
@@ -234,7 +234,7 @@ future<void> test_await(
 
         request->data._d = robot::RobotControl_setSpeed_Hash;
         request->data._u.setSpeed.speed = speed + 10;
-        await requester.send_request_async(*request);
+        co_await requester.send_request_async(*request);
     }
     printf("after. threadid = %lld\n", RTIOsapiThread_getCurrentThreadID());
 }
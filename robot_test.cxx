@@ -43,6 +43,10 @@ int main(int argc, char *argv[])
                 client_func(service_name);
             else if (strcmp(argv[2], "server_func") == 0)
                 server_func(service_name);
+            else if (strcmp(argv[2], "bench_rr") == 0)
+                printf("bench_rr is now: robot_bench --domain %d --scenario rr\n", domainid);
+            else if (strcmp(argv[2], "bench_table") == 0)
+                printf("bench_table is now: robot_bench --scenario table\n");
             else
                 usage();
         }
@@ -0,0 +1,772 @@
+#include <stdio.h>
+#include <atomic>
+#include <chrono>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <ndds/ndds_cpp.h>
+
+#include "boost/thread/condition_variable.hpp"
+#include "boost/thread/mutex.hpp"
+#include "boost/thread/thread.hpp"
+
+#include "common.h"
+#include "concurrency_limit.h"
+#include "operation_stats.h"
+#include "operation_table.h"
+#include "reply_cache.h"
+#include "RobotControlSupport.h"
+#include "single_flight.h"
+#include "slab.h"
+
+// Checks that run within one process. Those that need a service run it
+// on a thread of their own, over DDS in the default domain, or over
+// in-process queues with -DUSE_LOOPBACK. Prints every failed check and
+// exits with the number of failed tests.
+
+static int failed_checks = 0;
+
+#define CHECK(condition)                                          \
+  do {                                                            \
+    if (!(condition)) {                                           \
+      printf("  %s:%d: CHECK(%s) failed\n",                       \
+             __FILE__, __LINE__, #condition);                     \
+      ++failed_checks;                                            \
+    }                                                             \
+  } while (0)
+
+using namespace dds::rpc;
+using namespace dds::rpc::details;
+using namespace robot;
+
+typedef Requester<RobotControl_Request, RobotControl_Reply> TestRequester;
+
+// Counts the calls to setSpeed and getSpeed. getSpeed waits while the
+// gate is closed, so calls can be held in flight.
+class CountingRobot : public robot::RobotControl
+{
+  boost::mutex mutex_;
+  boost::condition_variable opened_;
+  bool open_;
+  float speed_;
+
+public:
+  std::atomic<int> setSpeed_calls;
+  std::atomic<int> getSpeed_calls;
+
+  CountingRobot()
+    : open_(true),
+      speed_(0),
+      setSpeed_calls(0),
+      getSpeed_calls(0)
+  { }
+
+  void gate(bool open)
+  {
+    boost::lock_guard<boost::mutex> guard(mutex_);
+    open_ = open;
+    opened_.notify_all();
+  }
+
+  void command(const Command &) override
+  { }
+
+  float setSpeed(float speed) override
+  {
+    ++setSpeed_calls;
+    boost::lock_guard<boost::mutex> guard(mutex_);
+    speed_ = speed;
+    return speed;
+  }
+
+  float getSpeed() override
+  {
+    ++getSpeed_calls;
+    boost::unique_lock<boost::mutex> lock(mutex_);
+    while (!open_)
+      opened_.wait(lock);
+    return speed_;
+  }
+
+  void getStatus(Status &) override
+  { }
+};
+
+// Serves robot on a thread of its own until destroyed.
+class TestService
+{
+  Server server_;
+  RobotControlSupport::Service service_;
+  boost::thread thread_;
+
+public:
+
+  TestService(robot::RobotControl & robot, const ServiceParams & params)
+    : service_(robot, server_, params),
+      thread_([this]() { server_.run(); })
+  { }
+
+  ~TestService()
+  {
+    server_.close();
+    thread_.join();
+  }
+};
+
+// Waits until requester reaches the service, as robot_bench does.
+static bool reaches_service(TestRequester & requester)
+{
+  helper::unique_data<RobotControl_Request> request;
+  request->data._d = RobotControl_getSpeed_Hash;
+
+  dds::Sample<RobotControl_Reply> reply;
+  requester.send_request(*request);
+  return requester.receive_reply(reply,
+                                 request->header.requestId,
+                                 dds::Duration::from_seconds(20));
+}
+
+// Every bucket holds the values from one past the limit of the bucket
+// before it up to its own limit, and is at most 1/SUB_BUCKETS of them
+// wide.
+static void test_histogram_bucket_boundaries()
+{
+  for (boost::uint64_t ns = 0; ns < LatencyHistogram::SUB_BUCKETS; ++ns)
+  {
+    CHECK(LatencyHistogram::bucket_of(ns) == ns);
+    CHECK(LatencyHistogram::bucket_limit_ns(ns) == ns);
+  }
+
+  for (size_t b = 1; b < LatencyHistogram::BUCKET_COUNT; ++b)
+  {
+    boost::uint64_t low = LatencyHistogram::bucket_limit_ns(b - 1) + 1;
+    boost::uint64_t high = LatencyHistogram::bucket_limit_ns(b);
+
+    CHECK(low <= high);
+    CHECK(LatencyHistogram::bucket_of(low) == b);
+    CHECK(LatencyHistogram::bucket_of(high) == b);
+    CHECK(high - low <= low / LatencyHistogram::SUB_BUCKETS);
+  }
+
+  // Beyond the last limit everything counts in the last bucket.
+  boost::uint64_t last =
+    LatencyHistogram::bucket_limit_ns(LatencyHistogram::BUCKET_COUNT - 1);
+  CHECK(LatencyHistogram::bucket_of(last + 1) == LatencyHistogram::BUCKET_COUNT - 1);
+  CHECK(LatencyHistogram::bucket_of(~static_cast<boost::uint64_t>(0)) ==
+        LatencyHistogram::BUCKET_COUNT - 1);
+}
+
+static void test_histogram_percentiles()
+{
+  LatencyHistogram histogram;
+  CHECK(histogram.percentile_ns(50) == 0);
+  CHECK(histogram.mean_ns() == 0);
+
+  // 90 calls of 10 ns, 9 of 1000 ns and one of 1 ms.
+  histogram.add(LatencyHistogram::bucket_of(10), 90);
+  histogram.add(LatencyHistogram::bucket_of(1000), 9);
+  histogram.add(LatencyHistogram::bucket_of(1000000), 1);
+  histogram.add_sum(90 * 10 + 9 * 1000 + 1000000, 1000000);
+
+  CHECK(histogram.count() == 100);
+  CHECK(histogram.max_ns() == 1000000);
+  CHECK(histogram.mean_ns() == (90 * 10 + 9 * 1000 + 1000000) / 100.0);
+
+  CHECK(histogram.percentile_ns(0) == 10);
+  CHECK(histogram.percentile_ns(50) == 10);
+  CHECK(histogram.percentile_ns(90) == 10);
+
+  // Rounded up to the limit of the bucket, within 1/SUB_BUCKETS.
+  boost::uint64_t p99 = histogram.percentile_ns(99);
+  CHECK(p99 >= 1000);
+  CHECK(p99 <= 1000 + 1000 / LatencyHistogram::SUB_BUCKETS);
+
+  // Never above the largest latency seen.
+  CHECK(histogram.percentile_ns(99.9) == 1000000);
+  CHECK(histogram.percentile_ns(100) == 1000000);
+
+  LatencyHistogram merged;
+  merged.merge(histogram);
+  merged.merge(histogram);
+  CHECK(merged.count() == 200);
+  CHECK(merged.percentile_ns(99) == p99);
+  CHECK(merged.mean_ns() == histogram.mean_ns());
+}
+
+static void test_recorder_counts_outcomes()
+{
+  static const char * const operations[] = { "getSpeed", "setSpeed" };
+  OperationStatsRecorder recorder(operations);
+  OperationStatsRecorder::clock::time_point start = OperationStatsRecorder::clock::now();
+
+  recorder.record(operation_id("getSpeed"), start, OperationStatsRecorder::OUTCOME_OK);
+  recorder.record(operation_id("getSpeed"), start, OperationStatsRecorder::OUTCOME_ERROR);
+  recorder.record(operation_id("getSpeed"), start, OperationStatsRecorder::OUTCOME_TIMEOUT);
+  recorder.record(operation_id("setSpeed"), start, OperationStatsRecorder::OUTCOME_REJECTED);
+
+  std::vector<OperationStats> stats = recorder.snapshot();
+  CHECK(stats.size() == 2);
+  CHECK(stats[0].name == "getSpeed");
+  CHECK(stats[0].operation == operation_id("getSpeed"));
+  CHECK(stats[0].requests == 3);
+  CHECK(stats[0].errors == 1);
+  CHECK(stats[0].timeouts == 1);
+  CHECK(stats[0].rejected == 0);
+  CHECK(stats[0].latency.count() == 2);
+  CHECK(stats[1].requests == 1);
+  CHECK(stats[1].rejected == 1);
+  CHECK(stats[1].latency.count() == 0);
+
+  recorder.record(operation_id("fly"), start, OperationStatsRecorder::OUTCOME_OK);
+  stats = recorder.snapshot();
+  CHECK(stats.size() == 3);
+  CHECK(stats[2].operation == 0);
+  CHECK(stats[2].requests == 1);
+}
+
+static void test_single_flight_coalesces()
+{
+  typedef SingleFlight<int, int> Flights;
+  Flights flights;
+  Flights::Flight first_flight, other_flight, flight;
+  dds::rpc::future<int> first, second, other;
+
+  CHECK(!flights.join(1, first, first_flight));
+  CHECK(flights.join(1, first, flight));
+  CHECK(flights.join(1, second, flight));
+  CHECK(!flights.join(2, other, other_flight));
+
+  int value = 7;
+  flights.land(first_flight, value);
+  CHECK(first.get() == 7);
+  CHECK(second.get() == 7);
+
+  // Landed: the next call leads a flight of its own.
+  Flights::Flight next_flight;
+  dds::rpc::future<int> next;
+  CHECK(!flights.join(1, next, next_flight));
+  CHECK(flights.join(1, next, flight));
+
+  // An abandoned flight hands its leader's error to the followers.
+  flights.abandon(next_flight,
+                  dds::rpc::details::to_exception_ptr(std::runtime_error("lost")));
+  bool forwarded = false;
+  try {
+    next.get();
+  }
+  catch (std::runtime_error & ex) {
+    forwarded = std::string(ex.what()) == "lost";
+  }
+  CHECK(forwarded);
+
+  flights.abandon(other_flight,
+                  dds::rpc::details::to_exception_ptr(std::runtime_error("lost")));
+  CHECK(!flights.join(2, other, other_flight));
+
+  // A read after a write doesn't follow a flight from before it.
+  Flights::Flight stale_flight, fresh_flight;
+  dds::rpc::future<int> stale, fresh;
+  CHECK(!flights.join(3, stale, stale_flight));
+  flights.invalidate();
+  CHECK(!flights.join(3, fresh, fresh_flight));
+  CHECK(flights.join(3, fresh, flight));
+
+  int old_value = 1;
+  flights.land(stale_flight, old_value);
+  CHECK(!fresh.is_ready());
+
+  int new_value = 2;
+  flights.land(fresh_flight, new_value);
+  CHECK(fresh.get() == 2);
+}
+
+static void test_reply_cache_generations()
+{
+  ReplyCache<int, int> cache(std::chrono::seconds(60));
+  int value = 0;
+
+  CHECK(!cache.find(1, value));
+  cache.store(1, 10, cache.generation());
+  CHECK(cache.find(1, value));
+  CHECK(value == 10);
+
+  // A read sent before a write may carry the state from before it.
+  boost::uint64_t read_sent = cache.generation();
+  cache.invalidate();
+  CHECK(!cache.find(1, value));
+  cache.store(1, 11, read_sent);
+  CHECK(!cache.find(1, value));
+
+  cache.store(1, 12, cache.generation());
+  CHECK(cache.find(1, value));
+  CHECK(value == 12);
+
+  ReplyCache<int, int> short_lived(std::chrono::milliseconds(10));
+  short_lived.store(1, 10, short_lived.generation());
+  boost::this_thread::sleep_for(boost::chrono::milliseconds(30));
+  CHECK(!short_lived.find(1, value));
+}
+
+// Blocks freed on another thread go back to their class and are handed
+// out again, most recently freed first.
+static void test_slab_recycles_across_threads()
+{
+  enum { BLOCKS = 100, SIZE = 1000 };
+
+  std::vector<void *> blocks;
+  for (int i = 0; i < BLOCKS; ++i)
+    blocks.push_back(slab::allocate(SIZE));
+
+  boost::thread freer([&blocks]() {
+    for (size_t i = 0; i < blocks.size(); ++i)
+      slab::deallocate(blocks[i], SIZE);
+  });
+  freer.join();
+
+  std::set<void *> freed(blocks.begin(), blocks.end());
+  CHECK(freed.size() == BLOCKS);
+
+  for (int i = 0; i < BLOCKS; ++i)
+  {
+    void * block = slab::allocate(SIZE);
+    CHECK(freed.count(block) == 1);
+    blocks[i] = block;
+  }
+
+  for (int i = 0; i < BLOCKS; ++i)
+    slab::deallocate(blocks[i], SIZE);
+
+  // Larger than any class: straight from and back to the heap.
+  void * large = slab::allocate(64 * 1024);
+  CHECK(large != 0);
+  slab::deallocate(large, 64 * 1024);
+}
+
+#ifdef USE_LIGHT_FUTURE
+
+// True if fut.get() throws std::runtime_error.
+template <class T>
+static bool breaks(dds::rpc::future<T> & fut)
+{
+  try {
+    fut.get();
+  }
+  catch (std::runtime_error &) {
+    return true;
+  }
+  return false;
+}
+
+static void test_light_future_then()
+{
+  // Armed before the value is set: runs where it is set.
+  dds::rpc::details::promise<int> later;
+  dds::rpc::future<int> doubled =
+    later.get_future().then([](dds::rpc::future<int> fut) { return 2 * fut.get(); });
+  CHECK(!doubled.is_ready());
+
+  boost::thread setter([&later]() { later.set_value(21); });
+  CHECK(doubled.get() == 42);
+  setter.join();
+
+  // Ready already: runs right away.
+  bool ran = false;
+  dds::rpc::future<void> done =
+    make_ready_future(1).then([&ran](dds::rpc::future<int> fut) { ran = fut.get() == 1; });
+  CHECK(ran);
+  CHECK(done.is_ready());
+  done.get();
+
+  // What a continuation throws comes out of get().
+  dds::rpc::future<int> thrown =
+    make_ready_future(1).then([](dds::rpc::future<int>) -> int {
+      throw std::runtime_error("continuation failed");
+    });
+  CHECK(breaks(thrown));
+}
+
+static void test_light_future_unwrap()
+{
+  dds::rpc::details::promise<int> outer;
+  dds::rpc::details::promise<int> inner;
+  dds::rpc::future<int> inner_future = inner.get_future();
+
+  // A continuation that returns future<int> gives a future<int>.
+  dds::rpc::future<int> chained =
+    outer.get_future().then([&inner_future](dds::rpc::future<int> fut) {
+      int offset = fut.get();
+      return inner_future.then([offset](dds::rpc::future<int> f) { return f.get() + offset; });
+    });
+
+  outer.set_value(1);
+  CHECK(!chained.is_ready());
+  inner.set_value(41);
+  CHECK(chained.get() == 42);
+}
+
+static void test_light_future_broken_promise()
+{
+  dds::rpc::future<int> orphan;
+  {
+    dds::rpc::details::promise<int> dropped;
+    orphan = dropped.get_future();
+  }
+  CHECK(orphan.is_ready());
+  CHECK(breaks(orphan));
+
+  // Through a continuation, too.
+  dds::rpc::future<int> chained;
+  {
+    dds::rpc::details::promise<int> dropped;
+    chained = dropped.get_future().then([](dds::rpc::future<int> fut) { return fut.get(); });
+  }
+  CHECK(breaks(chained));
+
+  dds::rpc::details::promise<int> twice;
+  twice.set_value(1);
+  bool rejected = false;
+  try {
+    twice.set_value(2);
+  }
+  catch (std::logic_error &) {
+    rejected = true;
+  }
+  CHECK(rejected);
+}
+
+// Completed on one thread, consumed and freed on another, so states go
+// back to the slab from a thread other than the one that made them.
+static void test_light_future_across_threads()
+{
+  enum { CALLS = 10000 };
+
+  std::vector<dds::rpc::details::promise<int>> promises(CALLS);
+  std::vector<dds::rpc::future<int>> futures;
+  for (int i = 0; i < CALLS; ++i)
+    futures.push_back(promises[i].get_future().then(
+      [](dds::rpc::future<int> fut) { return fut.get() + 1; }));
+
+  boost::thread producer([&promises]() {
+    for (int i = 0; i < CALLS; ++i)
+      promises[i].set_value(i);
+  });
+
+  long long sum = 0;
+  for (int i = 0; i < CALLS; ++i)
+    sum += futures[i].get();
+  producer.join();
+
+  CHECK(sum == static_cast<long long>(CALLS) * (CALLS + 1) / 2);
+}
+
+#endif // USE_LIGHT_FUTURE
+
+// Replies to requests sent without a deadline get lost. The limiter must
+// hand their slots back once the replies are long overdue, or the
+// Requester stops sending for good.
+static void test_limiter_frees_lost_slots()
+{
+  ConcurrencyLimiter limiter(400);
+
+  int sent = 0;
+  while (limiter.try_acquire())
+  {
+    limiter.track(++sent, ConcurrencyLimiter::clock::now(), 0);
+    CHECK(sent <= 400);
+  }
+  CHECK(sent == limiter.limit());
+
+  // No reply ever comes.
+  std::atomic<int> queued_sent(0);
+  limiter.enqueue([&queued_sent]() { ++queued_sent; });
+  CHECK(queued_sent == 0);
+  CHECK(limiter.waiting() == 1);
+
+  ConcurrencyLimiter::clock::time_point give_up =
+    ConcurrencyLimiter::clock::now() + std::chrono::seconds(10);
+  while (queued_sent == 0 && ConcurrencyLimiter::clock::now() < give_up)
+  {
+    boost::this_thread::sleep_for(boost::chrono::milliseconds(50));
+    limiter.expire();
+  }
+
+  CHECK(queued_sent == 1);
+  CHECK(limiter.waiting() == 0);
+  CHECK(limiter.in_flight() == 1);
+  CHECK(limiter.try_acquire());
+
+  // A reply that comes after all is ignored.
+  limiter.release(1, ConcurrencyLimiter::OUTCOME_OK);
+  CHECK(limiter.in_flight() == 2);
+}
+
+// A queued request whose send throws gives its slot back, and the
+// requests queued behind it still go out.
+static void test_limiter_survives_throwing_waiter()
+{
+  ConcurrencyLimiter limiter(400);
+
+  int sent = 0;
+  while (limiter.try_acquire())
+    limiter.track(++sent, ConcurrencyLimiter::clock::now(), 0);
+
+  int thrown = 0;
+  int queued_sent = 0;
+  limiter.enqueue([&thrown]() { ++thrown; throw std::runtime_error("write failed"); });
+  limiter.enqueue([&queued_sent]() { ++queued_sent; });
+  CHECK(limiter.waiting() == 2);
+
+  // Frees one slot without touching the limit.
+  limiter.cancel();
+
+  CHECK(thrown == 1);
+  CHECK(queued_sent == 1);
+  CHECK(limiter.waiting() == 0);
+  CHECK(limiter.in_flight() == limiter.limit());
+}
+
+// A retry keeps the requestId, and with it the deadline, of the first
+// try. A service that kept the reply must send it again rather than
+// turn the retry down because that deadline passed.
+static void test_retry_after_deadline_gets_kept_reply()
+{
+  CountingRobot robot;
+  TestService service(robot,
+                      ServiceParams()
+                        .service_name("UnitTestRetry")
+                        .duplicate_reply_cache_size(16));
+  TestRequester requester(RequesterParams().service_name("UnitTestRetry"));
+  CHECK(reaches_service(requester));
+
+  helper::unique_data<RobotControl_Request> request;
+  dds::Sample<RobotControl_Reply> reply;
+  request->data._d = RobotControl_setSpeed_Hash;
+  request->data._u.setSpeed.speed = 42;
+  request->header.deadline = deadline_after(dds::Duration::from_seconds(20));
+
+  requester.send_request(*request);
+  CHECK(requester.receive_reply(reply,
+                                request->header.requestId,
+                                dds::Duration::from_seconds(20)));
+  CHECK(reply.data().header.remoteEx == REMOTE_EX_OK);
+  CHECK(robot.setSpeed_calls == 1);
+
+  // Long past by the time the retry goes out.
+  request->header.deadline = 1;
+  requester.resend_request(*request);
+  CHECK(requester.receive_reply(reply,
+                                request->header.requestId,
+                                dds::Duration::from_seconds(20)));
+  CHECK(reply.data().header.remoteEx == REMOTE_EX_OK);
+  CHECK(reply.data().data._d == RobotControl_setSpeed_Hash);
+  CHECK(reply.data().data._u.setSpeed._u.result.return_ == 42);
+  CHECK(robot.setSpeed_calls == 1);
+
+  // A request the service never served still gets turned down.
+  requester.send_request(*request);
+  CHECK(requester.receive_reply(reply,
+                                request->header.requestId,
+                                dds::Duration::from_seconds(20)));
+  CHECK(reply.data().header.remoteEx == REMOTE_EX_DEADLINE_EXCEEDED);
+  CHECK(robot.setSpeed_calls == 1);
+}
+
+// Async reads that find the same read waiting share its reply. The
+// service holds the first one until all of them are sent.
+static void test_client_coalesces_reads()
+{
+  CountingRobot robot;
+  TestService service(robot, ServiceParams().service_name("UnitTestCoalesce"));
+  RobotControlSupport::Client client(
+    ClientParams().service_name("UnitTestCoalesce").coalesce_reads(true));
+
+  client.setSpeed(5);
+  CHECK(client.getSpeed() == 5);
+  CHECK(robot.getSpeed_calls == 1);
+
+  robot.gate(false);
+  dds::rpc::future<float> first = client.getSpeed_async();
+  dds::rpc::future<float> second = client.getSpeed_async();
+  dds::rpc::future<float> third = client.getSpeed_async();
+  robot.gate(true);
+
+  CHECK(first.get() == 5);
+  CHECK(second.get() == 5);
+  CHECK(third.get() == 5);
+  CHECK(robot.getSpeed_calls == 2);
+
+  // Landed: the next read goes out again.
+  CHECK(client.getSpeed_async().get() == 5);
+  CHECK(robot.getSpeed_calls == 3);
+}
+
+// Reads are answered from the cache until a write through the client
+// clears it.
+static void test_client_read_cache_invalidation()
+{
+  CountingRobot robot;
+  TestService service(robot, ServiceParams().service_name("UnitTestReadCache"));
+  RobotControlSupport::Client client(
+    ClientParams()
+      .service_name("UnitTestReadCache")
+      .read_cache_staleness(dds::Duration::from_seconds(60)));
+
+  client.setSpeed(5);
+  CHECK(client.getSpeed() == 5);
+  CHECK(client.getSpeed() == 5);
+  CHECK(client.getSpeed_async().get() == 5);
+  CHECK(robot.getSpeed_calls == 1);
+
+  client.setSpeed(6);
+  CHECK(client.getSpeed() == 6);
+  CHECK(robot.getSpeed_calls == 2);
+}
+
+static bool rejects_batch_params(int replies, const dds::Duration & delay)
+{
+  try {
+    ServiceParams().reply_batch_size(replies).reply_flush_delay(delay);
+  }
+  catch (std::invalid_argument &) {
+    return true;
+  }
+  return false;
+}
+
+// Replies wait for the batch to fill up, but no longer than it takes to
+// serve the requests taken with them: a flush delay far longer than the
+// receive timeout must never be waited out.
+static void test_batched_replies_flush_when_served()
+{
+  enum { BURST = 5 };
+
+  CHECK(rejects_batch_params(0, dds::Duration::from_millis(1)));
+  CHECK(rejects_batch_params(8, dds::Duration::from_seconds(0)));
+  CHECK(!rejects_batch_params(8, dds::Duration::from_millis(1)));
+
+  CountingRobot robot;
+  TestService service(robot,
+                      ServiceParams()
+                        .service_name("UnitTestBatch")
+                        .reply_batch_size(8)
+                        .reply_flush_delay(dds::Duration::from_seconds(60)));
+  TestRequester requester(RequesterParams().service_name("UnitTestBatch"));
+  CHECK(reaches_service(requester));
+
+  // Fewer than a batch, one at a time and all at once.
+  helper::unique_data<RobotControl_Request> requests[BURST];
+  dds::Sample<RobotControl_Reply> reply;
+
+  for (int i = 0; i < BURST; ++i)
+  {
+    requests[i]->data._d = RobotControl_setSpeed_Hash;
+    requests[i]->data._u.setSpeed.speed = static_cast<float>(i);
+    requester.send_request(*requests[i]);
+    CHECK(requester.receive_reply(reply,
+                                  requests[i]->header.requestId,
+                                  dds::Duration::from_seconds(5)));
+  }
+
+  for (int i = 0; i < BURST; ++i)
+    requester.send_request(*requests[i]);
+
+  for (int i = 0; i < BURST; ++i)
+  {
+    CHECK(requester.receive_reply(reply,
+                                  requests[i]->header.requestId,
+                                  dds::Duration::from_seconds(5)));
+    CHECK(reply.data().data._u.setSpeed._u.result.return_ == i);
+  }
+
+  CHECK(robot.setSpeed_calls == 2 * BURST);
+}
+
+#ifdef USE_AWAIT
+
+static dds::rpc::future<float> await_setSpeed(TestRequester & requester, float speed)
+{
+  helper::unique_data<RobotControl_Request> request;
+  request->data._d = RobotControl_setSpeed_Hash;
+  request->data._u.setSpeed.speed = speed;
+
+  dds::Sample<RobotControl_Reply> reply =
+    co_await requester.send_request_async(*request);
+  co_return reply.data().data._u.setSpeed._u.result.return_;
+}
+
+// The coroutine suspends on a Requester future and resumes, with the
+// reply, on the thread that completes it.
+static void test_co_await_requester_future()
+{
+  CountingRobot robot;
+  TestService service(robot, ServiceParams().service_name("UnitTestAwait"));
+  TestRequester requester(RequesterParams().service_name("UnitTestAwait"));
+  CHECK(reaches_service(requester));
+
+  for (int i = 1; i <= 3; ++i)
+  {
+    dds::rpc::future<float> speed = await_setSpeed(requester, static_cast<float>(i));
+    CHECK(speed.get() == i);
+  }
+  CHECK(robot.setSpeed_calls == 3);
+}
+
+#endif // USE_AWAIT
+
+typedef void (*Test)();
+
+struct NamedTest
+{
+  const char * name;
+  Test test;
+};
+
+static const NamedTest tests[] = {
+  { "histogram_bucket_boundaries", test_histogram_bucket_boundaries },
+  { "histogram_percentiles", test_histogram_percentiles },
+  { "recorder_counts_outcomes", test_recorder_counts_outcomes },
+  { "single_flight_coalesces", test_single_flight_coalesces },
+  { "reply_cache_generations", test_reply_cache_generations },
+  { "slab_recycles_across_threads", test_slab_recycles_across_threads },
+#ifdef USE_LIGHT_FUTURE
+  { "light_future_then", test_light_future_then },
+  { "light_future_unwrap", test_light_future_unwrap },
+  { "light_future_broken_promise", test_light_future_broken_promise },
+  { "light_future_across_threads", test_light_future_across_threads },
+#endif
+  { "limiter_frees_lost_slots", test_limiter_frees_lost_slots },
+  { "limiter_survives_throwing_waiter", test_limiter_survives_throwing_waiter },
+  { "retry_after_deadline_gets_kept_reply", test_retry_after_deadline_gets_kept_reply },
+  { "client_coalesces_reads", test_client_coalesces_reads },
+  { "client_read_cache_invalidation", test_client_read_cache_invalidation },
+  { "batched_replies_flush_when_served", test_batched_replies_flush_when_served },
+#ifdef USE_AWAIT
+  { "co_await_requester_future", test_co_await_requester_future },
+#endif
+};
+
+int main()
+{
+  int failed_tests = 0;
+
+  for (size_t i = 0; i < sizeof(tests) / sizeof(tests[0]); ++i)
+  {
+    int before = failed_checks;
+    try {
+      tests[i].test();
+    }
+    catch (std::exception & ex) {
+      printf("  exception: %s\n", ex.what());
+      ++failed_checks;
+    }
+
+    bool ok = failed_checks == before;
+    printf("%s %s\n", ok ? "PASS" : "FAIL", tests[i].name);
+    if (!ok)
+      ++failed_tests;
+  }
+
+  return failed_tests;
+}
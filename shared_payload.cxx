@@ -0,0 +1,395 @@
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <random>
+#include <stdexcept>
+#include <string>
+
+#include "ndds/ndds_cpp.h"
+#include "shared_payload.h"
+
+#include "boost/chrono.hpp"
+#include "boost/cstdint.hpp"
+#include "boost/interprocess/managed_shared_memory.hpp"
+#include "boost/interprocess/mapped_region.hpp"
+#include "boost/interprocess/shared_memory_object.hpp"
+#include "boost/make_shared.hpp"
+#include "boost/scoped_ptr.hpp"
+#include "boost/thread/lock_guard.hpp"
+#include "boost/thread/mutex.hpp"
+
+#ifdef RTI_WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
+namespace bip = boost::interprocess;
+
+namespace dds {
+namespace rpc {
+namespace details {
+
+  class SharedPayloadMapping
+  {
+  public:
+    bip::managed_shared_memory segment;
+
+    explicit SharedPayloadMapping(const char * name)
+      : segment(bip::open_only, name)
+    { }
+  };
+
+} // namespace details
+} // namespace rpc
+} // namespace dds
+
+namespace {
+
+  using dds::rpc::details::SharedPayloadMapping;
+
+  typedef boost::chrono::steady_clock clock_type;
+
+  static_assert(ATOMIC_LLONG_LOCK_FREE == 2,
+                "shared payload blocks need lock-free 64-bit atomics");
+
+  // Precedes the bytes of every block. tag holds the generation of the
+  // block in the upper bits and its state in the lowest two. Only the
+  // writer allocates and frees blocks. The reader claims a READY block
+  // and marks it CONSUMED when done. The writer expires a block that
+  // stayed READY for the whole lease, and takes back one that stayed
+  // CLAIMED for another lease after that.
+  struct BlockHeader
+  {
+    std::atomic<boost::uint64_t> tag;
+    boost::uint64_t length;
+  };
+
+  enum BlockState
+  {
+    BLOCK_EXPIRED  = 0,
+    BLOCK_READY    = 1,
+    BLOCK_CLAIMED  = 2,
+    BLOCK_CONSUMED = 3
+  };
+
+  boost::uint64_t block_tag(boost::uint64_t generation, BlockState state)
+  {
+    return (generation << 2) | state;
+  }
+
+  // This process's segment. Created with the first payload and
+  // removed when the process exits.
+  class SharedPayloadWriter
+  {
+    enum { SEGMENT_SIZE = 64 * 1024 * 1024 };
+
+    struct Outstanding
+    {
+      BlockHeader * block;
+      boost::uint64_t generation;
+      clock_type::time_point placed;
+    };
+
+    boost::mutex mutex_;
+    std::string name_;
+    boost::scoped_ptr<bip::managed_shared_memory> segment_;
+    std::deque<Outstanding> outstanding_;
+    boost::uint64_t next_generation_;
+
+    SharedPayloadWriter()
+      : next_generation_(1)
+    {
+      char name[64];
+      sprintf(name, "dds_rpc_payload_%d_%llu",
+              static_cast<int>(getpid()),
+              static_cast<unsigned long long>(
+                clock_type::now().time_since_epoch().count() & 0xffffffffULL));
+      name_ = name;
+
+      bip::shared_memory_object::remove(name_.c_str());
+      segment_.reset(
+        new bip::managed_shared_memory(bip::create_only, name_.c_str(), SEGMENT_SIZE));
+    }
+
+    // Frees the block if the reader is done with it or it has expired.
+    bool reclaim(const Outstanding & entry, const clock_type::time_point & now)
+    {
+      const boost::chrono::seconds lease(dds::rpc::details::SHARED_PAYLOAD_LEASE_SEC);
+      const boost::uint64_t consumed = block_tag(entry.generation, BLOCK_CONSUMED);
+      boost::uint64_t tag = entry.block->tag.load();
+
+      if (tag == block_tag(entry.generation, BLOCK_READY) &&
+          now - entry.placed < lease)
+        return false;
+
+      // A reader that died holding the block never marks it consumed.
+      if (tag == block_tag(entry.generation, BLOCK_CLAIMED) &&
+          now - entry.placed < 2 * lease)
+        return false;
+
+      // The reader may claim or release it at the last moment. If they
+      // claimed it, it's theirs until the next sweep looks again.
+      if (tag != consumed &&
+          !entry.block->tag.compare_exchange_strong(
+            tag, block_tag(entry.generation, BLOCK_EXPIRED)) &&
+          tag != consumed)
+        return false;
+
+      segment_->deallocate(entry.block);
+      return true;
+    }
+
+    void sweep(bool everything)
+    {
+      clock_type::time_point now = clock_type::now();
+
+      while (!outstanding_.empty() && reclaim(outstanding_.front(), now))
+        outstanding_.pop_front();
+
+      if (!everything)
+        return;
+
+      std::deque<Outstanding> kept;
+      for (size_t i = 0; i < outstanding_.size(); ++i)
+        if (!reclaim(outstanding_[i], now))
+          kept.push_back(outstanding_[i]);
+
+      outstanding_.swap(kept);
+    }
+
+  public:
+
+    ~SharedPayloadWriter()
+    {
+      // Readers that still have it mapped keep their mapping.
+      segment_.reset();
+      bip::shared_memory_object::remove(name_.c_str());
+    }
+
+    static SharedPayloadWriter & instance()
+    {
+      static SharedPayloadWriter writer;
+      return writer;
+    }
+
+    bool place(const void * data, size_t size, dds::rpc::SharedPayloadRef & ref)
+    {
+      boost::lock_guard<boost::mutex> guard(mutex_);
+
+      sweep(false);
+
+      void * memory = segment_->allocate(sizeof(BlockHeader) + size, std::nothrow);
+      if (!memory)
+      {
+        sweep(true);
+        memory = segment_->allocate(sizeof(BlockHeader) + size, std::nothrow);
+        if (!memory)
+          return false;
+      }
+
+      boost::uint64_t generation = next_generation_++;
+      BlockHeader * block = new (memory) BlockHeader;
+      block->length = size;
+      memcpy(reinterpret_cast<char *>(block + 1), data, size);
+      block->tag.store(block_tag(generation, BLOCK_READY));
+
+      Outstanding entry = { block, generation, clock_type::now() };
+      outstanding_.push_back(entry);
+
+      strcpy(ref.segment, name_.c_str());
+      ref.offset = segment_->get_handle_from_address(block);
+      ref.length = static_cast<DDS_UnsignedLong>(size);
+      ref.generation = generation;
+      return true;
+    }
+  };
+
+  // Segments of other processes, mapped once and kept for reuse.
+  class SharedPayloadMappings
+  {
+    boost::mutex mutex_;
+    std::map<std::string, boost::shared_ptr<SharedPayloadMapping>> mappings_;
+
+  public:
+
+    static SharedPayloadMappings & instance()
+    {
+      static SharedPayloadMappings * mappings = new SharedPayloadMappings();
+      return *mappings;
+    }
+
+    boost::shared_ptr<SharedPayloadMapping> open(const char * name)
+    {
+      boost::lock_guard<boost::mutex> guard(mutex_);
+
+      boost::shared_ptr<SharedPayloadMapping> & mapping = mappings_[name];
+      if (!mapping)
+      {
+        try {
+          mapping = boost::make_shared<SharedPayloadMapping>(name);
+        }
+        catch (bip::interprocess_exception & ex) {
+          mappings_.erase(name);
+          throw std::runtime_error(
+            std::string("Can't map shared payload segment ") + name + ": " + ex.what());
+        }
+      }
+      return mapping;
+    }
+  };
+
+} // anonymous namespace
+
+namespace dds {
+namespace rpc {
+
+  SharedPayload::SharedPayload(const SharedPayloadRef & ref)
+    : mapping_(SharedPayloadMappings::instance().open(ref.segment)),
+      block_(0),
+      generation_(ref.generation),
+      data_(0),
+      size_(0)
+  {
+    bip::managed_shared_memory & segment = mapping_->segment;
+
+    if (ref.offset + sizeof(BlockHeader) + ref.length > segment.get_size())
+      throw std::runtime_error("Shared payload lies outside its segment");
+
+    BlockHeader * block =
+      static_cast<BlockHeader *>(segment.get_address_from_handle(
+        static_cast<bip::managed_shared_memory::handle_t>(ref.offset)));
+
+    boost::uint64_t tag = block_tag(generation_, BLOCK_READY);
+    if (!block->tag.compare_exchange_strong(tag, block_tag(generation_, BLOCK_CLAIMED)))
+      throw std::runtime_error("Shared payload has expired");
+
+    block_ = block;
+    data_ = reinterpret_cast<const char *>(block + 1);
+    size_ = static_cast<std::size_t>(block->length);
+  }
+
+  SharedPayload::~SharedPayload()
+  {
+    // Held past the lease, the block may be expired and reused already.
+    boost::uint64_t tag = block_tag(generation_, BLOCK_CLAIMED);
+    static_cast<BlockHeader *>(block_)->tag.compare_exchange_strong(
+      tag, block_tag(generation_, BLOCK_CONSUMED));
+  }
+
+  const char * SharedPayload::data() const
+  {
+    return data_;
+  }
+
+  std::size_t SharedPayload::size() const
+  {
+    return size_;
+  }
+
+  namespace details {
+
+    bool place_shared_payload(const void * data,
+                              std::size_t size,
+                              SharedPayloadRef & ref)
+    {
+      try {
+        return SharedPayloadWriter::instance().place(data, size, ref);
+      }
+      catch (bip::interprocess_exception & ex) {
+        throw std::runtime_error(
+          std::string("Can't create shared payload segment: ") + ex.what());
+      }
+    }
+
+    bool share_string(char *& str,
+                      SharedPayloadRefSeq & payload,
+                      std::size_t threshold)
+    {
+      if (!str)
+        return false;
+
+      std::size_t length = strlen(str);
+      if (length < threshold)
+        return false;
+
+      if (!payload.ensure_length(1, 1))
+        return false;
+
+      try {
+        if (!place_shared_payload(str, length, payload[0]))
+        {
+          payload.length(0);
+          return false;
+        }
+      }
+      catch (...) {
+        payload.length(0);
+        throw;
+      }
+
+      // Keeps the buffer for the next reply out of the same pooled sample.
+      str[0] = '\0';
+      return true;
+    }
+
+    void unshare_string(char *& str, const SharedPayloadRefSeq & payload)
+    {
+      if (payload.length() == 0)
+        return;
+
+      SharedPayload shared(payload[0]);
+
+      if (str)
+        DDS_String_free(str);
+
+      str = DDS_String_alloc(shared.size());
+      if (!str)
+        throw std::runtime_error("Can't allocate string");
+
+      memcpy(str, shared.data(), shared.size());
+      str[shared.size()] = '\0';
+    }
+
+    boost::uint64_t shared_payload_host()
+    {
+      static const boost::uint64_t host = []() -> boost::uint64_t {
+        try {
+          bip::shared_memory_object object(
+            bip::open_or_create, "dds_rpc_payload_host", bip::read_write);
+          object.truncate(sizeof(boost::uint64_t));
+          bip::mapped_region region(object, bip::read_write);
+
+          // A fresh segment reads as zero. The first process to get
+          // here fills in its token, every later one reads that.
+          std::atomic<boost::uint64_t> * shared =
+            static_cast<std::atomic<boost::uint64_t> *>(region.get_address());
+
+          std::random_device seed;
+          std::mt19937_64 random(
+            (static_cast<boost::uint64_t>(seed()) << 32) | seed());
+          boost::uint64_t token;
+          do {
+            token = random();
+          } while (token == 0);
+
+          boost::uint64_t expected = 0;
+          if (!shared->compare_exchange_strong(expected, token))
+            token = expected;
+
+          return token;
+        }
+        catch (std::exception &) {
+          return 0;
+        }
+      }();
+
+      return host;
+    }
+
+  } // namespace details
+} // namespace rpc
+} // namespace dds
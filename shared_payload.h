@@ -0,0 +1,96 @@
+#ifndef OMG_DDS_RPC_SHARED_PAYLOAD_H
+#define OMG_DDS_RPC_SHARED_PAYLOAD_H
+
+#include <cstddef>
+
+#include "rpc_types.h"
+#include "boost/cstdint.hpp"
+#include "boost/shared_ptr.hpp"
+
+/* Non-normative: large payloads can skip serialization and the
+   transport. The writer copies the bytes into a shared-memory segment
+   of its own and sends only a SharedPayloadRef, in the payload member
+   of RequestHeader or ReplyHeader. A reader on the same host maps the
+   segment and reads the bytes in place, e.g. straight out of
+   LoanedSamples.
+
+   Only callers that put shared_payload_host() in RequestHeader.payloadHost
+   get shared payloads, and only from a service that computes the same
+   value: one whose segments they can map.
+
+   The writer reclaims a block once the reader is done with it. A block
+   nobody maps within SHARED_PAYLOAD_LEASE_SEC seconds, or that a reader
+   mapped and then held for that long again, e.g. because it died, is
+   reclaimed too, so lost samples and readers don't leak segment
+   space. */
+
+namespace dds {
+  namespace rpc {
+
+    namespace details {
+
+      class SharedPayloadMapping;
+
+    } // namespace details
+
+    // One shared payload, mapped in place. Map each SharedPayloadRef
+    // once: the writer may reuse the block after the SharedPayload is
+    // destroyed, or once it has been mapped for SHARED_PAYLOAD_LEASE_SEC
+    // seconds. Throws std::runtime_error if the segment can't be mapped
+    // or the block has expired.
+    class SharedPayload
+    {
+      boost::shared_ptr<details::SharedPayloadMapping> mapping_;
+      void * block_;
+      unsigned long long generation_;
+      const char * data_;
+      std::size_t size_;
+
+      SharedPayload(const SharedPayload &);
+      SharedPayload & operator = (const SharedPayload &);
+
+    public:
+      explicit SharedPayload(const SharedPayloadRef & ref);
+      ~SharedPayload();
+
+      const char * data() const;
+      std::size_t size() const;
+    };
+
+    namespace details {
+
+      enum { SHARED_PAYLOAD_LEASE_SEC = 30 };
+
+      // Copies size bytes into this process's segment and describes
+      // them in ref. Returns false if the segment has no room. The
+      // caller then sends the payload inline. Throws std::runtime_error
+      // if the segment can't be created.
+      bool place_shared_payload(const void * data,
+                                std::size_t size,
+                                SharedPayloadRef & ref);
+
+      // Moves the string str to shared memory if it is at least
+      // threshold bytes long, and records it in payload. str is left
+      // empty. Returns false, leaving both alone, if str is shorter or
+      // there is no room. Throws as place_shared_payload does, leaving
+      // both alone.
+      bool share_string(char *& str,
+                        SharedPayloadRefSeq & payload,
+                        std::size_t threshold);
+
+      // The reverse of share_string: copies the shared payload, if there
+      // is one, back into str.
+      void unshare_string(char *& str, const SharedPayloadRefSeq & payload);
+
+      // The same for every process that sees the same shared memory,
+      // so can map the segments of the others, and different for any
+      // other. It is kept in a small segment of its own, which the
+      // first process to need it creates and fills in at random. 0 if
+      // shared memory is unavailable.
+      boost::uint64_t shared_payload_host();
+
+    } // namespace details
+  } // namespace rpc
+} // namespace dds
+
+#endif // OMG_DDS_RPC_SHARED_PAYLOAD_H
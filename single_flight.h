@@ -0,0 +1,118 @@
+#ifndef OMG_DDS_RPC_SINGLE_FLIGHT_H
+#define OMG_DDS_RPC_SINGLE_FLIGHT_H
+
+#include <utility>
+#include <vector>
+
+#include "vendor_dependent.h"
+
+#include "boost/cstdint.hpp"
+#include "boost/shared_ptr.hpp"
+#include "boost/thread/lock_guard.hpp"
+#include "boost/thread/mutex.hpp"
+#include "boost/unordered_map.hpp"
+
+namespace dds {
+  namespace rpc {
+    namespace details {
+
+      // Lets concurrent identical calls share one request. The first
+      // caller for a key leads: it sends the request and reports the
+      // result with land(), or abandon() if there is none. Callers that
+      // arrive while the leader waits follow: they get a future of the
+      // leader's result and send nothing.
+      //
+      // As in ReplyCache, a write that completes makes a new generation.
+      // A call only follows a flight that started in the current one:
+      // a flight started before the write may carry the state from
+      // before it.
+      template <class Key, class T>
+      class SingleFlight
+      {
+      public:
+        // A key, and the generation its flight started in.
+        typedef std::pair<Key, boost::uint64_t> Flight;
+
+      private:
+        typedef std::vector<boost::shared_ptr<promise<T>>> Followers;
+
+        boost::mutex mutex_;
+        boost::uint64_t generation_;
+        // Present while a leader waits for its result.
+        boost::unordered_map<Flight, Followers> flights_;
+
+        SingleFlight(const SingleFlight &);
+        SingleFlight & operator = (const SingleFlight &);
+
+        Followers take(const Flight & flight)
+        {
+          Followers followers;
+          boost::lock_guard<boost::mutex> guard(mutex_);
+          typename boost::unordered_map<Flight, Followers>::iterator it =
+            flights_.find(flight);
+          if (it != flights_.end())
+          {
+            followers.swap(it->second);
+            flights_.erase(it);
+          }
+          return followers;
+        }
+
+      public:
+
+        SingleFlight()
+          : generation_(0)
+        { }
+
+        // True if the caller follows a call in flight. result then
+        // completes with that call. False if the caller leads: flight
+        // then names its flight for land() or abandon().
+        bool join(const Key & key, future<T> & result, Flight & flight)
+        {
+          boost::lock_guard<boost::mutex> guard(mutex_);
+          flight = Flight(key, generation_);
+          typename boost::unordered_map<Flight, Followers>::iterator it =
+            flights_.find(flight);
+          if (it == flights_.end())
+          {
+            flights_[flight];
+            return false;
+          }
+
+          boost::shared_ptr<promise<T>> follower(new promise<T>());
+          result = follower->get_future();
+          it->second.push_back(follower);
+          return true;
+        }
+
+        // A write completed. Calls from now on start new flights. The
+        // flights in the air still land for their own followers.
+        void invalidate()
+        {
+          boost::lock_guard<boost::mutex> guard(mutex_);
+          ++generation_;
+        }
+
+        // The leader's result, for every follower. Calls arriving from
+        // now on start a new flight.
+        void land(const Flight & flight, T & value)
+        {
+          Followers followers = take(flight);
+          for (size_t i = 0; i < followers.size(); ++i)
+            followers[i]->set_value(value);
+        }
+
+        // The leader got error instead of a result. So do its followers.
+        void abandon(const Flight & flight, const exception_ptr & error)
+        {
+          Followers followers = take(flight);
+          for (size_t i = 0; i < followers.size(); ++i)
+            followers[i]->set_exception(error);
+        }
+      };
+
+    } // namespace details
+  } // namespace rpc
+} // namespace dds
+
+#endif // OMG_DDS_RPC_SINGLE_FLIGHT_H
@@ -0,0 +1,84 @@
+#ifndef OMG_DDS_RPC_SLAB_H
+#define OMG_DDS_RPC_SLAB_H
+
+#include <cstddef>
+#include <new>
+
+#include "boost/lockfree/stack.hpp"
+
+namespace dds {
+  namespace rpc {
+    namespace details {
+
+      // Recycles the blocks of small objects that are made on one thread
+      // and dropped on another at a high rate, such as the shared states
+      // of futures. Blocks are sorted by size into classes GRANULE bytes
+      // apart. Each class keeps up to DEPTH free blocks on a lock-free
+      // stack. Larger objects, and blocks freed while their stack is
+      // full, go back to the heap.
+      class slab
+      {
+        enum { GRANULE = 64, CLASSES = 16, DEPTH = 256 };
+
+        typedef boost::lockfree::stack<void *, boost::lockfree::capacity<DEPTH>>
+          FreeList;
+
+        // Never destroyed, so blocks freed during exit still have
+        // somewhere to go.
+        static FreeList * free_lists()
+        {
+          static FreeList * lists = new FreeList[CLASSES];
+          return lists;
+        }
+
+        static std::size_t size_class(std::size_t size)
+        {
+          return (size + GRANULE - 1) / GRANULE - 1;
+        }
+
+      public:
+
+        static void * allocate(std::size_t size)
+        {
+          std::size_t index = size_class(size);
+          if (index >= CLASSES)
+            return ::operator new(size);
+
+          void * block;
+          if (free_lists()[index].pop(block))
+            return block;
+
+          return ::operator new((index + 1) * GRANULE);
+        }
+
+        static void deallocate(void * block, std::size_t size)
+        {
+          std::size_t index = size_class(size);
+          if (index >= CLASSES || !free_lists()[index].bounded_push(block))
+            ::operator delete(block);
+        }
+      };
+
+      // Objects of classes derived from this live in slab blocks. A
+      // virtual destructor makes delete pass the size of the most
+      // derived class.
+      class slab_allocated
+      {
+      public:
+
+        static void * operator new(std::size_t size)
+        {
+          return slab::allocate(size);
+        }
+
+        static void operator delete(void * block, std::size_t size)
+        {
+          slab::deallocate(block, size);
+        }
+      };
+
+    } // namespace details
+  } // namespace rpc
+} // namespace dds
+
+#endif // OMG_DDS_RPC_SLAB_H
@@ -0,0 +1,58 @@
+#ifndef OMG_DDS_RPC_SPAN_H
+#define OMG_DDS_RPC_SPAN_H
+
+#include <cstddef>
+#include <vector>
+
+namespace dds {
+  namespace rpc {
+
+    // Non-owning view over a contiguous sequence of T, in the spirit of
+    // C++20 std::span. Used by the batched Requester APIs.
+    template <class T>
+    class span
+    {
+      T * data_;
+      std::size_t size_;
+
+    public:
+      typedef T           element_type;
+      typedef T *         iterator;
+      typedef std::size_t size_type;
+
+      span()
+        : data_(0),
+          size_(0)
+      { }
+
+      span(T * data, std::size_t size)
+        : data_(data),
+          size_(size)
+      { }
+
+      template <std::size_t N>
+      span(T (&array)[N])
+        : data_(array),
+          size_(N)
+      { }
+
+      template <class Alloc>
+      span(std::vector<T, Alloc> & vec)
+        : data_(vec.empty() ? 0 : &vec[0]),
+          size_(vec.size())
+      { }
+
+      T * data() const          { return data_; }
+      std::size_t size() const  { return size_; }
+      bool empty() const        { return size_ == 0; }
+
+      T & operator [] (std::size_t index) const { return data_[index]; }
+
+      iterator begin() const    { return data_; }
+      iterator end() const      { return data_ + size_; }
+    };
+
+  } // namespace rpc
+} // namespace dds
+
+#endif // OMG_DDS_RPC_SPAN_H
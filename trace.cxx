@@ -0,0 +1,117 @@
+#include <vector>
+
+#include "trace.h"
+
+#include "boost/thread/lock_guard.hpp"
+#include "boost/thread/mutex.hpp"
+
+#ifdef RTI_WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
+namespace dds {
+namespace rpc {
+namespace trace {
+
+namespace {
+
+  // Rings outlive their threads, so a dump still has their events.
+  class Registry
+  {
+    boost::mutex mutex_;
+    std::vector<Ring *> rings_;
+
+  public:
+    static Registry & instance()
+    {
+      static Registry * registry = new Registry();
+      return *registry;
+    }
+
+    Ring * add()
+    {
+      boost::lock_guard<boost::mutex> guard(mutex_);
+      Ring * ring = new Ring(static_cast<boost::uint32_t>(rings_.size() + 1));
+      rings_.push_back(ring);
+      return ring;
+    }
+
+    std::vector<Ring *> rings()
+    {
+      boost::lock_guard<boost::mutex> guard(mutex_);
+      return rings_;
+    }
+  };
+
+} // anonymous namespace
+
+size_t Ring::snapshot(Record * out) const
+{
+  boost::uint64_t end = head_.load(std::memory_order_acquire);
+  boost::uint64_t begin =
+    end > OMG_DDS_RPC_TRACE_RING_SIZE ? end - OMG_DDS_RPC_TRACE_RING_SIZE : 0;
+
+  for (boost::uint64_t i = begin; i < end; ++i)
+    out[i - begin] = records_[i & MASK];
+
+  // Slots the owner has reused since are torn. Drop them.
+  boost::uint64_t now = head_.load(std::memory_order_acquire);
+  boost::uint64_t first_intact =
+    now >= OMG_DDS_RPC_TRACE_RING_SIZE ? now - OMG_DDS_RPC_TRACE_RING_SIZE + 1 : 0;
+
+  if (first_intact <= begin)
+    return static_cast<size_t>(end - begin);
+
+  if (first_intact >= end)
+    return 0;
+
+  size_t torn = static_cast<size_t>(first_intact - begin);
+  memmove(out, out + torn, static_cast<size_t>(end - first_intact) * sizeof(Record));
+  return static_cast<size_t>(end - first_intact);
+}
+
+Ring & this_thread_ring()
+{
+  static thread_local Ring * ring = 0;
+  if (!ring)
+    ring = Registry::instance().add();
+  return *ring;
+}
+
+bool dump(const char * path)
+{
+  std::vector<Ring *> rings = Registry::instance().rings();
+  std::vector<Record> records;
+  std::vector<Record> buffer(OMG_DDS_RPC_TRACE_RING_SIZE);
+
+  for (size_t i = 0; i < rings.size(); ++i)
+  {
+    size_t count = rings[i]->snapshot(&buffer[0]);
+    records.insert(records.end(), buffer.begin(), buffer.begin() + count);
+  }
+
+  FILE * out = fopen(path, "wb");
+  if (!out)
+    return false;
+
+  FileHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, "DDSRPCTR", sizeof(header.magic));
+  header.version = FILE_VERSION;
+  header.pid = static_cast<boost::uint32_t>(getpid());
+  header.record_count = records.size();
+
+  bool ok =
+    fwrite(&header, sizeof(header), 1, out) == 1 &&
+    (records.empty() ||
+     fwrite(&records[0], sizeof(Record), records.size(), out) == records.size());
+
+  return fclose(out) == 0 && ok;
+}
+
+} // namespace trace
+} // namespace rpc
+} // namespace dds
@@ -0,0 +1,166 @@
+#ifndef OMG_DDS_RPC_TRACE_H
+#define OMG_DDS_RPC_TRACE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+#include "boost/cstdint.hpp"
+
+/* Binary event tracing for the request and reply paths.
+
+   Each thread records fixed-size events into its own ring buffer. The
+   owning thread is the only writer, so recording an event is a few
+   stores and one release store, with no lock and no system call. Once
+   a ring is full the oldest events are overwritten.
+
+   dump() writes every ring to a file. trace_dump converts one or more
+   of those files to the Chrome trace format (chrome://tracing,
+   Perfetto).
+
+   Events above OMG_DDS_RPC_TRACE_LEVEL compile to nothing. */
+
+#define OMG_DDS_RPC_TRACE_LEVEL_NONE     0
+#define OMG_DDS_RPC_TRACE_LEVEL_ERROR    1
+#define OMG_DDS_RPC_TRACE_LEVEL_REQUEST  2
+
+#ifndef OMG_DDS_RPC_TRACE_LEVEL
+#define OMG_DDS_RPC_TRACE_LEVEL OMG_DDS_RPC_TRACE_LEVEL_ERROR
+#endif
+
+// Events per thread. Must be a power of two.
+#ifndef OMG_DDS_RPC_TRACE_RING_SIZE
+#define OMG_DDS_RPC_TRACE_RING_SIZE 8192
+#endif
+
+#define DDS_RPC_TRACE(level, event, identity)                        \
+  do {                                                               \
+    if (OMG_DDS_RPC_TRACE_LEVEL_##level <= OMG_DDS_RPC_TRACE_LEVEL)  \
+      ::dds::rpc::trace::record(::dds::rpc::trace::event, identity); \
+  } while (0)
+
+#define DDS_RPC_TRACE_EVENT(level, event)                            \
+  do {                                                               \
+    if (OMG_DDS_RPC_TRACE_LEVEL_##level <= OMG_DDS_RPC_TRACE_LEVEL)  \
+      ::dds::rpc::trace::record(::dds::rpc::trace::event);           \
+  } while (0)
+
+namespace dds {
+  namespace rpc {
+    namespace trace {
+
+      enum Event
+      {
+        SEND_REQUEST     = 1,  // a Requester wrote the request
+        REPLY_RECEIVED   = 2,  // a Requester took the reply
+        DISPATCH_START   = 3,  // a service started serving the request
+        DISPATCH_END     = 4,  // and sent the reply
+        DISPATCH_TIMEOUT = 5,  // Dispatcher::dispatch got no request
+        DISPATCH_ERROR   = 6,  // serving requests threw
+        DISPATCH_SHED    = 7,  // an overloaded service shed the request
+        REPLY_ERROR      = 8,  // a reply pump failed to take replies
+        JOB_ERROR        = 9,  // an executor job threw
+        SHARE_ERROR      = 10  // a payload couldn't go to shared memory
+      };
+
+      // Request ids are RequestHeader.requestId: writer GUID and
+      // sequence number.
+      struct Record
+      {
+        boost::uint64_t timestamp_ns;
+        boost::uint32_t event;
+        boost::uint32_t thread;
+        boost::uint64_t guid[2];
+        boost::uint64_t sequence_number;
+      };
+
+      // File layout written by dump() and read by trace_dump.
+      struct FileHeader
+      {
+        char magic[8];             // "DDSRPCTR"
+        boost::uint32_t version;   // FILE_VERSION
+        boost::uint32_t pid;
+        boost::uint64_t record_count;
+      };
+
+      enum { FILE_VERSION = 1 };
+
+      class Ring
+      {
+        enum { MASK = OMG_DDS_RPC_TRACE_RING_SIZE - 1 };
+
+        static_assert((OMG_DDS_RPC_TRACE_RING_SIZE & MASK) == 0,
+                      "OMG_DDS_RPC_TRACE_RING_SIZE must be a power of two");
+
+        Record records_[OMG_DDS_RPC_TRACE_RING_SIZE];
+        std::atomic<boost::uint64_t> head_;
+        boost::uint32_t thread_;
+
+      public:
+        explicit Ring(boost::uint32_t thread)
+          : head_(0),
+            thread_(thread)
+        { }
+
+        Record & next()
+        {
+          Record & r = records_[head_.load(std::memory_order_relaxed) & MASK];
+          r.thread = thread_;
+          return r;
+        }
+
+        void commit()
+        {
+          head_.store(head_.load(std::memory_order_relaxed) + 1,
+                      std::memory_order_release);
+        }
+
+        // Copies the events still in the ring, oldest first. Events the
+        // owner overwrote while copying are left out.
+        size_t snapshot(Record * out) const;
+      };
+
+      // The calling thread's ring, created and registered on first use.
+      Ring & this_thread_ring();
+
+      inline boost::uint64_t now_ns()
+      {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now().time_since_epoch()).count();
+      }
+
+      template <class Identity>
+      void record(Event event, const Identity & request_id)
+      {
+        Ring & ring = this_thread_ring();
+        Record & r = ring.next();
+        r.timestamp_ns = now_ns();
+        r.event = event;
+        memcpy(r.guid, &request_id.writer_guid, sizeof(r.guid));
+        r.sequence_number =
+          (static_cast<boost::uint64_t>(static_cast<boost::uint32_t>(request_id.sequence_number.high)) << 32) |
+           static_cast<boost::uint32_t>(request_id.sequence_number.low);
+        ring.commit();
+      }
+
+      inline void record(Event event)
+      {
+        Ring & ring = this_thread_ring();
+        Record & r = ring.next();
+        r.timestamp_ns = now_ns();
+        r.event = event;
+        r.guid[0] = r.guid[1] = 0;
+        r.sequence_number = 0;
+        ring.commit();
+      }
+
+      // Writes the events of every thread to path. Returns false if the
+      // file can't be written. Safe to call while threads are tracing.
+      bool dump(const char * path);
+
+    } // namespace trace
+  } // namespace rpc
+} // namespace dds
+
+#endif // OMG_DDS_RPC_TRACE_H
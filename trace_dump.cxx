@@ -0,0 +1,148 @@
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "trace.h"
+
+using namespace dds::rpc;
+
+/* Converts files written by trace::dump() to the Chrome trace format,
+   for chrome://tracing or https://ui.perfetto.dev. A request shows as
+   an async slice from SEND_REQUEST to REPLY_RECEIVED, matched across
+   processes by its request id. Serving it shows as a slice on the
+   service thread from DISPATCH_START to DISPATCH_END. */
+
+struct TraceEvent
+{
+  boost::uint32_t pid;
+  trace::Record record;
+
+  bool operator < (const TraceEvent & other) const
+  {
+    return record.timestamp_ns < other.record.timestamp_ns;
+  }
+};
+
+static void read_dump(const char * path, std::vector<TraceEvent> & events)
+{
+  FILE * in = fopen(path, "rb");
+  if (!in)
+    throw std::runtime_error(std::string("can't open ") + path);
+
+  trace::FileHeader header;
+  if (fread(&header, sizeof(header), 1, in) != 1 ||
+      memcmp(header.magic, "DDSRPCTR", sizeof(header.magic)) != 0 ||
+      header.version != trace::FILE_VERSION)
+  {
+    fclose(in);
+    throw std::runtime_error(std::string(path) + " is not a trace dump");
+  }
+
+  TraceEvent event;
+  event.pid = header.pid;
+  for (boost::uint64_t i = 0; i < header.record_count; ++i)
+  {
+    if (fread(&event.record, sizeof(event.record), 1, in) != 1)
+    {
+      fclose(in);
+      throw std::runtime_error(std::string(path) + " is truncated");
+    }
+    events.push_back(event);
+  }
+
+  fclose(in);
+}
+
+static void write_event(FILE * out,
+                        const TraceEvent & event,
+                        boost::uint64_t origin_ns,
+                        bool & first)
+{
+  const trace::Record & r = event.record;
+  const char * name = 0;
+  const char * phase = 0;
+
+  switch (r.event)
+  {
+    case trace::SEND_REQUEST:     name = "request";  phase = "b"; break;
+    case trace::REPLY_RECEIVED:   name = "request";  phase = "e"; break;
+    case trace::DISPATCH_START:   name = "dispatch"; phase = "B"; break;
+    case trace::DISPATCH_END:     name = "dispatch"; phase = "E"; break;
+    case trace::DISPATCH_TIMEOUT: name = "dispatch timeout"; phase = "i"; break;
+    case trace::DISPATCH_ERROR:   name = "dispatch error";   phase = "i"; break;
+    case trace::DISPATCH_SHED:    name = "shed";             phase = "i"; break;
+    case trace::REPLY_ERROR:      name = "reply error";      phase = "i"; break;
+    case trace::JOB_ERROR:        name = "job error";        phase = "i"; break;
+    case trace::SHARE_ERROR:      name = "share error";      phase = "i"; break;
+    default:
+      return;
+  }
+
+  fprintf(out, first ? "\n" : ",\n");
+  first = false;
+
+  fprintf(out,
+          "{\"name\":\"%s\",\"cat\":\"rpc\",\"ph\":\"%s\",\"ts\":%.3f,"
+          "\"pid\":%u,\"tid\":%u",
+          name, phase,
+          (r.timestamp_ns - origin_ns) / 1000.0,
+          static_cast<unsigned>(event.pid),
+          static_cast<unsigned>(r.thread));
+
+  // Async slices are matched by a global id, so a request can begin in
+  // one process and end in another. Other events carry it as an arg.
+  if (r.guid[0] || r.guid[1] || r.sequence_number)
+    fprintf(out,
+            *phase == 'b' || *phase == 'e'
+              ? ",\"id2\":{\"global\":\"%016llx%016llx:%llu\"}"
+              : ",\"args\":{\"request\":\"%016llx%016llx:%llu\"}",
+            static_cast<unsigned long long>(r.guid[0]),
+            static_cast<unsigned long long>(r.guid[1]),
+            static_cast<unsigned long long>(r.sequence_number));
+
+  if (*phase == 'i')
+    fprintf(out, ",\"s\":\"t\"");
+
+  fprintf(out, "}");
+}
+
+int main(int argc, char *argv[])
+{
+  if (argc < 3)
+  {
+    printf("Usage: trace_dump OUTPUT.json DUMP...\n");
+    return 1;
+  }
+
+  try {
+    std::vector<TraceEvent> events;
+    for (int i = 2; i < argc; ++i)
+      read_dump(argv[i], events);
+
+    // Dumps of processes on one host share the steady clock.
+    std::stable_sort(events.begin(), events.end());
+    boost::uint64_t origin_ns = events.empty() ? 0 : events.front().record.timestamp_ns;
+
+    FILE * out = fopen(argv[1], "w");
+    if (!out)
+      throw std::runtime_error(std::string("can't open ") + argv[1]);
+
+    bool first = true;
+    fprintf(out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+    for (size_t i = 0; i < events.size(); ++i)
+      write_event(out, events[i], origin_ns, first);
+    fprintf(out, "\n]}\n");
+
+    fclose(out);
+    printf("%u events written to %s\n", static_cast<unsigned>(events.size()), argv[1]);
+    return 0;
+  }
+  catch (std::exception & ex)
+  {
+    printf("trace_dump: %s\n", ex.what());
+  }
+  return 1;
+}
@@ -1,10 +1,130 @@
 #ifndef UNIQUE_DATA_H
 #define UNIQUE_DATA_H
 
+#include <cstddef>
+#include <stdexcept>
 #include <utility>
+#include <vector>
+
+#include "ndds/ndds_cpp.h"
+#include "boost/thread/mutex.hpp"
 
 namespace helper {
 
+  // Called on a sample before data_pool hands it out again. The default
+  // copies a freshly created sample over it. TypeSupport::copy_data
+  // reuses the buffers already allocated for bounded strings and
+  // sequences, so no memory is allocated. Specialize this for types
+  // that can be reset more cheaply.
+  template <class T>
+  struct pool_traits
+  {
+    static bool reset(T & sample, const T & pristine)
+    {
+      return T::TypeSupport::copy_data(&sample, &pristine) == DDS_RETCODE_OK;
+    }
+  };
+
+  // Process-wide pool of samples of type T created by
+  // T::TypeSupport::create_data. Up to high_water_mark() idle samples
+  // are kept for reuse. Samples returned beyond that are deleted.
+  template <class T>
+  class data_pool
+  {
+    enum { DEFAULT_HIGH_WATER_MARK = 64 };
+
+    boost::mutex mutex_;
+    std::vector<T *> idle_;
+    std::size_t high_water_mark_;
+    T * pristine_;
+
+    data_pool(const data_pool &);
+    data_pool & operator = (const data_pool &);
+
+    data_pool()
+      : high_water_mark_(DEFAULT_HIGH_WATER_MARK),
+        pristine_(T::TypeSupport::create_data())
+    {
+      if (!pristine_)
+        throw std::runtime_error("Can't create data");
+
+      idle_.reserve(high_water_mark_);
+    }
+
+  public:
+
+    // Never destroyed, so unique_data objects with static storage
+    // duration can still return their samples during exit.
+    static data_pool & instance()
+    {
+      static data_pool * pool = new data_pool();
+      return *pool;
+    }
+
+    T * acquire()
+    {
+      {
+        boost::lock_guard<boost::mutex> guard(mutex_);
+        if (!idle_.empty())
+        {
+          T * sample = idle_.back();
+          idle_.pop_back();
+          return sample;
+        }
+      }
+
+      return T::TypeSupport::create_data();
+    }
+
+    void release(T * sample)
+    {
+      if (pool_traits<T>::reset(*sample, *pristine_))
+      {
+        boost::lock_guard<boost::mutex> guard(mutex_);
+        if (idle_.size() < high_water_mark_)
+        {
+          idle_.push_back(sample);
+          return;
+        }
+      }
+
+      T::TypeSupport::delete_data(sample);
+    }
+
+    // Idle samples kept for reuse. Lowering the mark frees the excess.
+    void high_water_mark(std::size_t count)
+    {
+      std::vector<T *> excess;
+      {
+        boost::lock_guard<boost::mutex> guard(mutex_);
+        high_water_mark_ = count;
+        idle_.reserve(count);
+
+        while (idle_.size() > count)
+        {
+          excess.push_back(idle_.back());
+          idle_.pop_back();
+        }
+      }
+
+      for (std::size_t i = 0; i < excess.size(); ++i)
+        T::TypeSupport::delete_data(excess[i]);
+    }
+
+    std::size_t high_water_mark()
+    {
+      boost::lock_guard<boost::mutex> guard(mutex_);
+      return high_water_mark_;
+    }
+
+    std::size_t idle_count()
+    {
+      boost::lock_guard<boost::mutex> guard(mutex_);
+      return idle_.size();
+    }
+  };
+
+  // Owns a sample of T. Samples come from and go back to data_pool<T>.
   template <class T>
   class unique_data
   {
@@ -15,7 +135,7 @@ namespace helper {
 
   public:
     unique_data()
-      : ptr_(T::TypeSupport::create_data())
+      : ptr_(data_pool<T>::instance().acquire())
     {
       if (!ptr_)
         throw std::runtime_error("Can't create data");
@@ -33,6 +153,7 @@ namespace helper {
       return *this;
     }
 
+    // t must come from T::TypeSupport::create_data.
     unique_data(T *t)
       : ptr_(t)
     {}
@@ -51,7 +172,7 @@ namespace helper {
 
     ~unique_data() {
       if (ptr_)
-        T::TypeSupport::delete_data(ptr_);
+        data_pool<T>::instance().release(ptr_);
     }
   };
 
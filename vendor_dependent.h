@@ -57,6 +57,17 @@ namespace dds {
   using connext::LoanedSamples;
   using connext::SampleIterator;
 
+#ifdef USE_LOOPBACK
+  namespace rpc {
+    namespace details {
+
+      template <class T>
+      class LoopbackSamples;
+
+    } // namespace details
+  } // namespace rpc
+#endif
+
   template <typename T>
   struct dds_type_traits 
   {
@@ -66,7 +77,11 @@ namespace dds {
     typedef SampleRef<T>             SampleRefType;
     typedef SampleRef<T>             SampleIteratorValueType;
     typedef SampleRef<const T>       ConstSampleIteratorValueType;
+#ifdef USE_LOOPBACK
+    typedef rpc::details::LoopbackSamples<T> LoanedSamplesType;
+#else
     typedef LoanedSamples<T>         LoanedSamplesType;
+#endif
     typedef SampleIterator<T, false> iterator;
     typedef SampleIterator<T, true>  const_iterator;
   };
@@ -125,6 +140,12 @@ namespace dds {
       template <class, class>
       class ReplierImpl;
 
+      template <class, class>
+      class LoopbackRequesterImpl;
+
+      template <class, class>
+      class LoopbackReplierImpl;
+
       template <class T>
       struct Unwrapper;
 
@@ -179,6 +200,24 @@ namespace dds {
         typedef boost::shared_ptr<details::ServerImpl> type;
       };
 
+#ifdef USE_LOOPBACK
+
+      // Requesters and Repliers talk over in-process queues instead of
+      // DDS. See loopback_request_reply.hpp.
+      template <class TReq, class TRep>
+      struct vendor_dependent<dds::rpc::Requester<TReq, TRep>>
+      {
+        typedef boost::shared_ptr<details::LoopbackRequesterImpl<TReq, TRep>> type;
+      };
+
+      template <class TReq, class TRep>
+      struct vendor_dependent<dds::rpc::Replier<TReq, TRep>>
+      {
+        typedef boost::shared_ptr<details::LoopbackReplierImpl<TReq, TRep>> type;
+      };
+
+#else
+
       template <class TReq, class TRep>
       struct vendor_dependent<dds::rpc::Requester<TReq, TRep>>
       {
@@ -191,6 +230,12 @@ namespace dds {
         typedef boost::shared_ptr<details::ReplierImpl<TReq, TRep>> type;
       };
 
+#endif // USE_LOOPBACK
+
+      // The implementation class behind a Requester or a Replier.
+      template <class Entity>
+      using impl_of = typename vendor_dependent<Entity>::type::element_type;
+
     } // namespace details 
   } // namespace rpc
 } // namespace dds
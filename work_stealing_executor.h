@@ -0,0 +1,266 @@
+#ifndef OMG_DDS_RPC_WORK_STEALING_EXECUTOR_H
+#define OMG_DDS_RPC_WORK_STEALING_EXECUTOR_H
+
+#include <atomic>
+#include <deque>
+#include <exception>
+#include <vector>
+
+#include "boost/bind.hpp"
+#include "boost/cstdint.hpp"
+#include "boost/function.hpp"
+#include "boost/shared_ptr.hpp"
+#include "boost/thread.hpp"
+#include "boost/unordered_map.hpp"
+
+#include "trace.h"
+
+namespace dds {
+  namespace rpc {
+    namespace details {
+
+      // Runs jobs on a fixed set of threads. Jobs posted with the same key
+      // run one at a time, in the order they were posted. Jobs with
+      // different keys run in parallel.
+      //
+      // The jobs of one key form a strand. A strand with pending jobs is
+      // queued on exactly one worker's deque. A worker pops strands from
+      // the front of its own deque. When its deque is empty, it steals
+      // from the back of the others. After STRAND_BATCH jobs a strand goes
+      // back to the end of the deque, so one busy key can't keep a worker
+      // to itself and its other strands can be stolen.
+      //
+      // The destructor runs everything already posted and joins the threads.
+      class WorkStealingExecutor
+      {
+      public:
+        typedef boost::function<void()> Job;
+
+      private:
+        enum { SHARD_COUNT = 16,
+               STRAND_BATCH = 16,
+               CACHE_LINE = 64 };
+
+        struct Strand
+        {
+          std::deque<Job> jobs;
+        };
+
+        struct StrandShard
+        {
+          boost::mutex mutex;
+          boost::unordered_map<boost::uint64_t, Strand> strands;
+          char pad_[CACHE_LINE];
+        };
+
+        struct Worker
+        {
+          WorkStealingExecutor * owner;
+          size_t index;
+          boost::mutex mutex;
+          std::deque<boost::uint64_t> strands;
+          char pad_[CACHE_LINE];
+        };
+
+        StrandShard shards_[SHARD_COUNT];
+        std::vector<boost::shared_ptr<Worker>> workers_;
+
+        std::atomic<long> queued_;
+        boost::mutex idle_mutex_;
+        boost::condition_variable idle_cond_;
+        bool stopping_;
+        boost::thread_group threads_;
+
+        WorkStealingExecutor(const WorkStealingExecutor &);
+        WorkStealingExecutor & operator = (const WorkStealingExecutor &);
+
+        static Worker *& current_worker()
+        {
+          static thread_local Worker * worker = 0;
+          return worker;
+        }
+
+        static boost::uint64_t mix(boost::uint64_t key)
+        {
+          key ^= key >> 33;
+          key *= 0xff51afd7ed558ccdULL;
+          key ^= key >> 33;
+          return key;
+        }
+
+        StrandShard & shard_of(boost::uint64_t key)
+        {
+          return shards_[mix(key) % SHARD_COUNT];
+        }
+
+        // Queues the strand on the calling worker, or on the worker the
+        // key hashes to when called from outside the pool.
+        void schedule(boost::uint64_t key)
+        {
+          Worker * self = current_worker();
+          Worker & worker =
+            (self && self->owner == this)
+              ? *self
+              : *workers_[(mix(key) >> 32) % workers_.size()];
+
+          {
+            boost::lock_guard<boost::mutex> guard(worker.mutex);
+            worker.strands.push_back(key);
+          }
+
+          ++queued_;
+          {
+            // Pairs with the check in work(), so the wakeup isn't lost.
+            boost::lock_guard<boost::mutex> guard(idle_mutex_);
+          }
+          idle_cond_.notify_one();
+        }
+
+        bool pop_local(Worker & worker, boost::uint64_t & key)
+        {
+          boost::lock_guard<boost::mutex> guard(worker.mutex);
+          if (worker.strands.empty())
+            return false;
+
+          key = worker.strands.front();
+          worker.strands.pop_front();
+          --queued_;
+          return true;
+        }
+
+        bool steal(Worker & thief, boost::uint64_t & key)
+        {
+          for (size_t i = 1; i < workers_.size(); ++i)
+          {
+            Worker & victim = *workers_[(thief.index + i) % workers_.size()];
+            boost::lock_guard<boost::mutex> guard(victim.mutex);
+            if (!victim.strands.empty())
+            {
+              key = victim.strands.back();
+              victim.strands.pop_back();
+              --queued_;
+              return true;
+            }
+          }
+          return false;
+        }
+
+        // Takes the next job of the strand. Erases the strand and returns
+        // false when it has none left.
+        bool next_job(boost::uint64_t key, Job & job)
+        {
+          StrandShard & shard = shard_of(key);
+          boost::lock_guard<boost::mutex> guard(shard.mutex);
+
+          boost::unordered_map<boost::uint64_t, Strand>::iterator it =
+            shard.strands.find(key);
+
+          if (it->second.jobs.empty())
+          {
+            shard.strands.erase(it);
+            return false;
+          }
+
+          job.swap(it->second.jobs.front());
+          it->second.jobs.pop_front();
+          return true;
+        }
+
+        void run_strand(boost::uint64_t key)
+        {
+          Job job;
+          for (int i = 0; i < STRAND_BATCH; ++i)
+          {
+            if (!next_job(key, job))
+              return;
+
+            // Whatever a job throws must not end the worker thread.
+            try {
+              job();
+            }
+            catch (...)
+            {
+              DDS_RPC_TRACE_EVENT(ERROR, JOB_ERROR);
+            }
+          }
+
+          // Still owned by this worker, so nobody else runs the key
+          // before it is queued again.
+          schedule(key);
+        }
+
+        void work(Worker * worker)
+        {
+          current_worker() = worker;
+
+          for (;;)
+          {
+            boost::uint64_t key;
+            if (pop_local(*worker, key) || steal(*worker, key))
+            {
+              run_strand(key);
+              continue;
+            }
+
+            boost::unique_lock<boost::mutex> lock(idle_mutex_);
+            if (queued_ == 0)
+            {
+              if (stopping_)
+                return;
+
+              idle_cond_.wait(lock);
+            }
+          }
+        }
+
+      public:
+
+        explicit WorkStealingExecutor(int thread_count)
+          : queued_(0),
+            stopping_(false)
+        {
+          for (int i = 0; i < thread_count; ++i)
+          {
+            boost::shared_ptr<Worker> worker(new Worker());
+            worker->owner = this;
+            worker->index = i;
+            workers_.push_back(worker);
+          }
+
+          for (size_t i = 0; i < workers_.size(); ++i)
+            threads_.create_thread(
+              boost::bind(&WorkStealingExecutor::work, this, workers_[i].get()));
+        }
+
+        ~WorkStealingExecutor()
+        {
+          {
+            boost::lock_guard<boost::mutex> guard(idle_mutex_);
+            stopping_ = true;
+          }
+          idle_cond_.notify_all();
+          threads_.join_all();
+        }
+
+        void post(boost::uint64_t key, const Job & job)
+        {
+          bool idle;
+          {
+            StrandShard & shard = shard_of(key);
+            boost::lock_guard<boost::mutex> guard(shard.mutex);
+
+            // A strand exists exactly while it is queued or running.
+            idle = (shard.strands.find(key) == shard.strands.end());
+            shard.strands[key].jobs.push_back(job);
+          }
+
+          if (idle)
+            schedule(key);
+        }
+      };
+
+    } // namespace details
+  } // namespace rpc
+} // namespace dds
+
+#endif // OMG_DDS_RPC_WORK_STEALING_EXECUTOR_H